@@ -1,13 +1,27 @@
 #include "ansResidual.h"
+#include "mappedFile.h"
+#include "metrics.h"
+#include "threadPool.h"
+#include "trace.h"
 
 #include <algorithm>
+#include <bit>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <numeric>
+#include <queue>
+#include <span>
 #include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
 namespace ans {
 
 // ------------------ residual / symbol mapping (internal) ------------------
@@ -20,37 +34,42 @@ static inline int16_t unzigzag16(uint32_t z) {
     return static_cast<int16_t>((z >> 1) ^ (~(z & 1) + 1));
 }
 
-struct Symbolized {
-    std::vector<uint16_t> syms; // values in [0..MAX_SYM], ESC_SYM marks escape
-    std::vector<int16_t>  esc;  // raw outliers, in order
-    size_t escapes = 0;
-};
-
-static Symbolized symbolize_residuals(const std::vector<int16_t>& residuals) {
-    Symbolized S;
-    S.syms.resize(residuals.size());
-    for (size_t i = 0; i < residuals.size(); ++i) {
-        uint32_t z = zigzag16(residuals[i]);
-        if (z < MAX_SYM) {
-            S.syms[i] = static_cast<uint16_t>(z);
-        } else {
-            S.syms[i] = ESC_SYM;
-            S.esc.push_back(residuals[i]);
-            ++S.escapes;
+// Zig-zag maps r in place, so its storage becomes the symbol array (values in [0..MAX_SYM],
+// ESC_SYM marks an escape), and appends the raw outliers to esc in order. With counts
+// (ALPHABET entries) the histogram is taken in the same pass.
+static std::span<const uint16_t> symbolize_in_place(std::span<int16_t> r, std::vector<int16_t>& esc,
+                                                    uint64_t* counts) {
+    uint16_t* syms = reinterpret_cast<uint16_t*>(r.data());
+    for (size_t i = 0; i < r.size(); ++i) {
+        const int16_t v = r[i];
+        uint32_t z = zigzag16(v);
+        if (z >= MAX_SYM) {
+            z = ESC_SYM;
+            esc.push_back(v);
         }
+        syms[i] = static_cast<uint16_t>(z);
+        if (counts) counts[z]++;
     }
-    return S;
+    return {syms, r.size()};
 }
 
+// esc: raw little-endian int16 values as stored in the file (not necessarily 2-byte aligned)
 static std::vector<int16_t> unsymbolize_residuals(const std::vector<uint16_t>& syms,
-                                                  const std::vector<int16_t>& esc)
+                                                  std::span<const uint8_t> esc)
 {
     std::vector<int16_t> out;
     out.resize(syms.size());
-    size_t ei = 0;
+    const uint8_t* e = esc.data();
     for (size_t i = 0; i < syms.size(); ++i) {
         uint16_t s = syms[i];
-        out[i] = (s == ESC_SYM) ? esc[ei++] : unzigzag16(s);
+        if (s == ESC_SYM) {
+            int16_t v;
+            std::memcpy(&v, e, 2);
+            e += 2;
+            out[i] = v;
+        } else {
+            out[i] = unzigzag16(s);
+        }
     }
     return out;
 }
@@ -63,33 +82,56 @@ struct Model {
     std::vector<uint16_t> lut_sym;  // size = L
 };
 
-static Model build_model(const std::vector<uint16_t>& syms) {
+// counts are kept 64-bit: a 16-bit freq wraps on large images.
+// L = 2^prec slots; every occurring symbol gets >= 1, absent ones none. Rounding error
+// is fixed greedily with a heap: each step moves the slot that costs the fewest bits.
+static Model build_model(const std::vector<uint64_t>& counts, int prec = RANS_PREC) {
+    if (prec < RANS_PREC || prec > MAX_PREC) throw std::invalid_argument("build_model: precision out of range");
     Model m;
+    m.L = 1u << prec;
     m.freq.assign(ALPHABET, 0);
-    for (auto s : syms) m.freq[s]++;
 
     uint64_t total = 0;
-    for (auto f : m.freq) total += f;
-    if (total == 0) { m.freq[0] = static_cast<uint16_t>(m.L); total = m.L; }
+    uint32_t used = 0;
+    for (auto n : counts) { total += n; used += (n != 0); }
+
+    if (used <= 1) {
+        // freq is 16 bits: with L = 2^16 a lone symbol leaves one slot to a neighbour
+        uint32_t s = 0;
+        while (s + 1 < ALPHABET && counts[s] == 0) ++s;
+        m.freq[s] = static_cast<uint16_t>(std::min<uint32_t>(m.L, 0xFFFF));
+        if (m.freq[s] != m.L) m.freq[s == 0 ? 1 : s - 1] = 1;
+    } else {
+        // floor of the exact share, at least 1
+        int64_t sum = 0;
+        for (size_t s = 0; s < ALPHABET; ++s) {
+            if (counts[s] == 0) continue;
+            uint64_t f = counts[s] * m.L / total;
+            m.freq[s] = static_cast<uint16_t>(std::max<uint64_t>(1, f));
+            sum += m.freq[s];
+        }
 
-    std::vector<double> prob(ALPHABET, 0.0);
-    for (size_t s = 0; s < ALPHABET; ++s)
-        prob[s] = static_cast<double>(m.freq[s]) / static_cast<double>(std::max<uint64_t>(1, total));
+        // bits saved by moving s one slot in the direction of step (negative when taking one away)
+        const int step = sum < m.L ? 1 : -1;
+        auto gain = [&](uint32_t s) {
+            double f = m.freq[s];
+            return static_cast<double>(counts[s]) * std::log2((f + step) / f);
+        };
+        auto movable = [&](uint32_t s) {
+            return step > 0 ? (m.freq[s] != 0 && m.freq[s] < 0xFFFF) : m.freq[s] > 1;
+        };
+        std::priority_queue<std::pair<double, uint32_t>> heap; // largest gain first
+        for (uint32_t s = 0; s < ALPHABET; ++s)
+            if (movable(s)) heap.emplace(gain(s), s);
 
-    uint32_t sum = 0;
-    for (size_t s = 0; s < ALPHABET; ++s) {
-        m.freq[s] = static_cast<uint16_t>(std::max(1, static_cast<int>(std::lround(prob[s] * m.L))));
-        sum += m.freq[s];
-    }
-    while (sum > m.L) {
-        size_t idx = static_cast<size_t>(std::distance(m.freq.begin(),
-                       std::max_element(m.freq.begin(), m.freq.end())));
-        if (m.freq[idx] > 1) { m.freq[idx]--; sum--; } else break;
-    }
-    while (sum < m.L) {
-        size_t idx = static_cast<size_t>(std::distance(m.freq.begin(),
-                       std::min_element(m.freq.begin(), m.freq.end())));
-        m.freq[idx]++; sum++;
+        while (sum != static_cast<int64_t>(m.L)) {
+            if (heap.empty()) throw std::runtime_error("build_model: cannot normalize");
+            uint32_t s = heap.top().second;
+            heap.pop();
+            m.freq[s] = static_cast<uint16_t>(m.freq[s] + step);
+            sum += step;
+            if (movable(s)) heap.emplace(gain(s), s);
+        }
     }
 
     m.cdf.resize(ALPHABET);
@@ -104,14 +146,32 @@ static Model build_model(const std::vector<uint16_t>& syms) {
     return m;
 }
 
+// --------------------------- activity contexts ----------------------------
+// Adaptive mode codes each residual with one of N_CTX tables, chosen by the local
+// error energy of already coded neighbours in the same channel (CALIC/JPEG-LS style):
+// W + N + (NW + NE)/2 in zigzag units, log2-quantized. Residuals only, so the decoder
+// sees the same context before decoding the symbol.
+static constexpr int N_CTX = 8;
+
+// i = sample index in the chunk, x = its column; chunk rows are w*c samples
+static inline int activity_ctx(const uint16_t* z, size_t i, int x, int w, int c) {
+    const size_t row = static_cast<size_t>(w) * c;
+    uint32_t a = 0;
+    if (x > 0) a += z[i - c];
+    if (i >= row) {
+        uint32_t d = 0;
+        if (x > 0)     d += z[i - row - c];
+        if (x + 1 < w) d += z[i - row + c];
+        a += z[i - row] + (d >> 1);
+    }
+    return std::min(N_CTX - 1, static_cast<int>(std::bit_width(a >> 1)));
+}
+
 // ------------------------------- rANS32 -----------------------------------
 namespace rans32 {
-    static constexpr int PREC = 12;            // log2(L)
-    static constexpr uint32_t L  = RANS_L;     // 4096
-
-    static std::vector<uint8_t> encode(const std::vector<uint16_t>& syms,
-                                       const Model& m)
-    {
+    // model_of(i) -> model that codes symbol i
+    template <class ModelOf>
+    static std::vector<uint8_t> encode_with(std::span<const uint16_t> syms, ModelOf&& model_of) {
         std::vector<uint8_t> out;
         out.reserve(syms.size() / 2 + 16);
 
@@ -119,15 +179,18 @@ namespace rans32 {
         auto put  = [&](uint8_t b) { out.push_back(b); };
 
         for (size_t i = syms.size(); i-- > 0;) {
+            const Model& m = model_of(i);
             uint16_t s  = syms[i];
             uint32_t f  = m.freq[s];
             uint32_t cf = m.cdf[s];
+            const int prec = std::countr_zero(m.L);
 
-            while (x >= (f << (32 - PREC))) {
+            // state stays in [2^16, 2^24): renormalize before it could leave after the update
+            while (x >= (f << (24 - prec))) {
                 put(static_cast<uint8_t>(x & 0xFF));
                 x >>= 8;
             }
-            x = (x / f) * L + (x % f) + cf;
+            x = ((x / f) << prec) + (x % f) + cf;
         }
         // flush 4 bytes of state
         put(static_cast<uint8_t>(x & 0xFF)); x >>= 8;
@@ -137,9 +200,15 @@ namespace rans32 {
         return out;
     }
 
-    static std::vector<uint16_t> decode(const std::vector<uint8_t>& in,
-                                        size_t n_syms,
-                                        const Model& m)
+    static std::vector<uint8_t> encode(std::span<const uint16_t> syms, const Model& m) {
+        return encode_with(syms, [&](size_t) -> const Model& { return m; });
+    }
+
+    // model_of(i, out) -> model of symbol i; out[0..i) is already decoded
+    template <class ModelOf>
+    static std::vector<uint16_t> decode_with(std::span<const uint8_t> in,
+                                             size_t n_syms,
+                                             ModelOf&& model_of)
     {
         std::vector<uint16_t> out(n_syms);
         size_t ip = in.size();
@@ -149,155 +218,872 @@ namespace rans32 {
             return static_cast<uint32_t>(in[--ip]);
         };
 
+        // state was flushed LSB first, so reading backwards yields the MSB first
         uint32_t x = 0;
-        x |= get();
-        x |= get() << 8;
-        x |= get() << 16;
         x |= get() << 24;
+        x |= get() << 16;
+        x |= get() << 8;
+        x |= get();
 
         for (size_t i = 0; i < n_syms; ++i) {
-            uint32_t slot = x & (L - 1);
+            const Model& m = model_of(i, out.data());
+            const int prec = std::countr_zero(m.L);
+            uint32_t slot = x & (m.L - 1);
             uint16_t s    = m.lut_sym[slot];
             out[i]        = s;
 
             uint32_t cf = m.cdf[s], f = m.freq[s];
-            x = f * (x >> PREC) + (slot - cf);
+            x = f * (x >> prec) + (slot - cf);
 
             while (x < (1u << 16)) x = (x << 8) | get();
         }
         return out;
     }
+
+    static std::vector<uint16_t> decode(std::span<const uint8_t> in, size_t n_syms, const Model& m) {
+        return decode_with(in, n_syms, [&](size_t, const uint16_t*) -> const Model& { return m; });
+    }
 } // namespace rans32
 
+// --------------------------- rANS32 x8 (interleaved) -----------------------
+// 8 independent states, symbol i uses state i % 8, renormalization in 16-bit words.
+// Stream: 8 initial states (uint32 LE), then words in the order the decoder consumes them.
+// Decode lanes have no dependency on each other, so full groups of 8 run in AVX2 lanes.
+namespace rans32x8 {
+    static constexpr int LANES = 8;
+    static constexpr uint32_t LOW = 1u << 16;  // states live in [2^16, 2^32)
+
+    static int prec_of(const Model& m) {
+        return std::countr_zero(m.L);
+    }
+
+    static std::vector<uint8_t> encode(std::span<const uint16_t> syms, const Model& m) {
+        const int prec = prec_of(m);
+        uint32_t x[LANES];
+        std::fill(x, x + LANES, LOW);
+
+        std::vector<uint16_t> words;
+        words.reserve(syms.size() / 4 + 16);
+
+        // backwards, so lanes of a group run 7..0 and the reversed stream reads 0..7
+        for (size_t i = syms.size(); i-- > 0;) {
+            uint32_t& xs = x[i % LANES];
+            uint16_t s  = syms[i];
+            uint32_t f  = m.freq[s];
+            uint32_t cf = m.cdf[s];
+
+            if (xs >= (((uint64_t)(LOW >> prec) << 16) * f)) { // one word is always enough
+                words.push_back(static_cast<uint16_t>(xs & 0xFFFF));
+                xs >>= 16;
+            }
+            xs = ((xs / f) << prec) + (xs % f) + cf;
+        }
+
+        std::vector<uint8_t> out(4 * LANES + 2 * words.size());
+        uint8_t* o = out.data();
+        for (uint32_t v : x) {
+            for (int b = 0; b < 4; ++b) *o++ = static_cast<uint8_t>(v >> (8*b));
+        }
+        for (size_t i = words.size(); i-- > 0;) {
+            *o++ = static_cast<uint8_t>(words[i] & 0xFF);
+            *o++ = static_cast<uint8_t>(words[i] >> 8);
+        }
+        return out;
+    }
+
+    struct DecodeTables {
+        std::vector<uint32_t> fb;  // per slot: freq | (slot - cdf) << 16
+        std::vector<uint32_t> sym; // per slot: symbol
+    };
+
+    static DecodeTables make_tables(const Model& m) {
+        DecodeTables T;
+        T.fb.resize(m.L);
+        T.sym.resize(m.L);
+        for (uint32_t slot = 0; slot < m.L; ++slot) {
+            uint16_t s = m.lut_sym[slot];
+            T.fb[slot]  = m.freq[s] | ((slot - m.cdf[s]) << 16);
+            T.sym[slot] = s;
+        }
+        return T;
+    }
+
+    // One decode step per symbol from i onwards, picks up where the SIMD loop stopped
+    static void decode_scalar(const uint8_t* in, size_t n_words, size_t& p,
+                              uint32_t* x, int prec, const DecodeTables& T,
+                              uint16_t* out, size_t i, size_t n_syms) {
+        const uint32_t mask = (1u << prec) - 1;
+        for (; i < n_syms; ++i) {
+            uint32_t& xs  = x[i % LANES];
+            uint32_t slot = xs & mask;
+            uint32_t fb   = T.fb[slot];
+            out[i] = static_cast<uint16_t>(T.sym[slot]);
+            xs = (fb & 0xFFFF) * (xs >> prec) + (fb >> 16);
+            if (xs < LOW) {
+                if (p >= n_words) throw std::runtime_error("rANS underflow");
+                xs = (xs << 16) | (uint32_t)(in[2*p] | (in[2*p + 1] << 8));
+                ++p;
+            }
+        }
+    }
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ANS_HAVE_AVX2 1
+    // For each 8-bit "needs a word" lane mask: which of the next words each lane takes
+    struct PermTable {
+        uint32_t idx[256][8];
+        constexpr PermTable() : idx{} {
+            for (int m = 0; m < 256; ++m) {
+                int k = 0;
+                for (int j = 0; j < 8; ++j) idx[m][j] = (m >> j & 1) ? k++ : 0;
+            }
+        }
+    };
+    static constexpr PermTable PERM{};
+
+    // Full groups of 8 while 8 words are still readable; returns the first symbol not decoded
+    __attribute__((target("avx2")))
+    static size_t decode_avx2(const uint8_t* in, size_t n_words, size_t& p,
+                              uint32_t* x, int prec, const DecodeTables& T,
+                              uint16_t* out, size_t n_syms) {
+        const __m256i vmask = _mm256_set1_epi32((int)((1u << prec) - 1));
+        const __m256i lo16  = _mm256_set1_epi32(0xFFFF);
+        const __m256i zero  = _mm256_setzero_si256();
+        const __m128i shp   = _mm_cvtsi32_si128(prec);
+        const __m128i sh16  = _mm_cvtsi32_si128(16);
+        const int* fb  = reinterpret_cast<const int*>(T.fb.data());
+        const int* sym = reinterpret_cast<const int*>(T.sym.data());
+
+        __m256i xv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x));
+        size_t i = 0;
+        for (; i + LANES <= n_syms && p + LANES <= n_words; i += LANES) {
+            __m256i slot = _mm256_and_si256(xv, vmask);
+            __m256i f_b  = _mm256_i32gather_epi32(fb, slot, 4);
+            __m256i s    = _mm256_i32gather_epi32(sym, slot, 4);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                             _mm_packus_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1)));
+
+            __m256i freq = _mm256_and_si256(f_b, lo16);
+            __m256i bias = _mm256_srl_epi32(f_b, sh16);
+            xv = _mm256_add_epi32(_mm256_mullo_epi32(freq, _mm256_srl_epi32(xv, shp)), bias);
+
+            // lanes below 2^16 take the next words, in lane order
+            __m256i need = _mm256_cmpeq_epi32(_mm256_srl_epi32(xv, sh16), zero);
+            int m = _mm256_movemask_ps(_mm256_castsi256_ps(need));
+            if (m) {
+                __m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2*p)));
+                w = _mm256_permutevar8x32_epi32(w, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(PERM.idx[m])));
+                xv = _mm256_blendv_epi8(xv, _mm256_or_si256(_mm256_sll_epi32(xv, sh16), w), need);
+                p += (size_t)__builtin_popcount((unsigned)m);
+            }
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(x), xv);
+        return i;
+    }
+#endif
+
+    static std::vector<uint16_t> decode(std::span<const uint8_t> in, size_t n_syms, const Model& m) {
+        if (in.size() < 4 * LANES || (in.size() & 1)) throw std::runtime_error("rANS x8: truncated stream");
+        const int prec = prec_of(m);
+        DecodeTables T = make_tables(m);
+
+        uint32_t x[LANES];
+        for (int j = 0; j < LANES; ++j) {
+            x[j] = 0;
+            for (int b = 0; b < 4; ++b) x[j] |= (uint32_t)in[4*j + b] << (8*b);
+        }
+        const uint8_t* words = in.data() + 4 * LANES;
+        const size_t n_words = (in.size() - 4 * LANES) / 2;
+        size_t p = 0;
+
+        std::vector<uint16_t> out(n_syms);
+        size_t i = 0;
+#ifdef ANS_HAVE_AVX2
+        if (__builtin_cpu_supports("avx2")) i = decode_avx2(words, n_words, p, x, prec, T, out.data(), n_syms);
+#endif
+        decode_scalar(words, n_words, p, x, prec, T, out.data(), i, n_syms);
+        return out;
+    }
+} // namespace rans32x8
+
 // --------------------------- container I/O --------------------------------
-struct Packed {
-    int mode = 0;              // 0 = u8/RGB residuals; 1 = s16 domain residuals
-    int w = 0, h = 0, c = 0;
+// v1 ('RANS') files are rejected: the pre-v2 encoder renormalized and flushed its state
+// wrongly, so none of them can be decoded.
+// v2 ('RNS2'): header + stripe table, one independent chunk per stripe:
+//   magic, version, [flags (version >= 3)], mode, w, h, c, stripe_rows, n_stripes,
+//   [version >= 5: uint8 predictor, ls_n, ls_inter, format, uint16 ls_win_w, ls_win_h],
+//   [FLAG_LS_REUSE: uint8 ls_reuse],
+//   [FLAG_CHECKSUM: uint32 crc32c of the source pixels],
+//   n_stripes x { uint64 offset (from file start), uint64 size },
+//   chunks: n_syms, models, esc_count, esc_bytes, ans_size, escapes, ans payload
+//     [FLAG_SIDE: then a chunk of the stripe's side data, one model, coded x8 or scalar]
+//   models: N_CTX of them with FLAG_CONTEXT, else one
+//     version <= 3: L, ALPH, freq[ALPH]
+//     version 4:    uint8 log2(L), uint16 lo, uint16 hi, uint32 n_bytes, then Elias-gamma
+//                   codes (MSB first) of {freq, gap to next used symbol} for every used
+//                   symbol below hi, starting at lo; freq[hi] = L - sum
+struct Chunk {
     uint64_t n_syms = 0;
-    Model model;
+    std::vector<Model> models;
+    std::vector<uint8_t>  packed_models; // models as written (pack_model), sized and written from here
     std::vector<uint8_t>  ans_bytes;
     std::vector<int16_t>  escapes;
+    std::vector<Chunk>    side;      // FLAG_SIDE: one chunk
+};
+
+static int model_count(uint32_t flags) {
+    return (flags & FLAG_CONTEXT) ? N_CTX : 1;
+}
+
+static constexpr uint32_t CONTAINER_VERSION = 5;
+
+struct BitWriter {
+    std::vector<uint8_t> bytes;
+    uint64_t acc = 0;
+    int n = 0;
+
+    void put(uint32_t v, int bits) { // bits <= 32
+        acc = (acc << bits) | (v & ((1ull << bits) - 1));
+        n += bits;
+        while (n >= 8) { n -= 8; bytes.push_back(static_cast<uint8_t>(acc >> n)); }
+    }
+    void gamma(uint32_t v) { // v >= 1
+        int nb = static_cast<int>(std::bit_width(v));
+        put(0, nb - 1);
+        put(v, nb);
+    }
+    std::vector<uint8_t> finish() {
+        if (n > 0) put(0, 8 - n);
+        return std::move(bytes);
+    }
+};
+
+struct BitReader {
+    const uint8_t* p;
+    size_t n_bits;
+    size_t pos = 0;
+
+    uint32_t bit() {
+        if (pos >= n_bits) throw std::runtime_error("bad model: bit stream overrun");
+        uint32_t b = (p[pos >> 3] >> (7 - (pos & 7))) & 1u;
+        ++pos;
+        return b;
+    }
+    uint32_t gamma() {
+        int zeros = 0;
+        while (bit() == 0) if (++zeros > 16) throw std::runtime_error("bad model: gamma code");
+        uint32_t v = 1;
+        for (int i = 0; i < zeros; ++i) v = (v << 1) | bit();
+        return v;
+    }
 };
 
-static void save_file(const std::string& path, const Packed& P) {
-    std::ofstream f(path, std::ios::binary);
-    if (!f) throw std::runtime_error("open write: " + path);
+static std::vector<uint8_t> pack_model(const Model& m) {
+    uint32_t lo = 0, hi = static_cast<uint32_t>(m.freq.size()) - 1;
+    while (lo < hi && m.freq[lo] == 0) ++lo;
+    while (hi > lo && m.freq[hi] == 0) --hi;
+
+    // the escape symbol sits at the top of the alphabet, so used symbols are sparse: code gaps
+    BitWriter bw;
+    for (uint32_t s = lo; s < hi;) {
+        uint32_t next = s + 1;
+        while (m.freq[next] == 0) ++next;
+        bw.gamma(m.freq[s]);
+        bw.gamma(next - s);
+        s = next;
+    }
+    std::vector<uint8_t> bits = bw.finish();
+
+    std::vector<uint8_t> out(9 + bits.size());
+    out[0] = static_cast<uint8_t>(std::bit_width(m.L) - 1);
+    uint32_t n_bytes = static_cast<uint32_t>(bits.size());
+    std::memcpy(&out[1], &lo, 2);
+    std::memcpy(&out[3], &hi, 2);
+    std::memcpy(&out[5], &n_bytes, 4);
+    std::copy(bits.begin(), bits.end(), out.begin() + 9);
+    return out;
+}
+
+static uint64_t chunk_bytes(const Chunk& C) {
+    uint64_t bytes = 8 + 3*8 + 2 * C.escapes.size() + C.ans_bytes.size();
+    bytes += C.packed_models.size();
+    for (const auto& s : C.side) bytes += chunk_bytes(s);
+    return bytes;
+}
 
-    uint32_t magic = FILE_MAGIC;
-    uint32_t L     = P.model.L;
-    uint32_t ALPH  = static_cast<uint32_t>(P.model.freq.size());
-    uint64_t esc_count = static_cast<uint64_t>(P.escapes.size());
+template <class T>
+static void put(const ByteSink& out, const T& v) {
+    out(reinterpret_cast<const uint8_t*>(&v), sizeof(T));
+}
+
+static void write_chunk(const ByteSink& out, const Chunk& C) {
+    uint64_t esc_count = static_cast<uint64_t>(C.escapes.size());
     uint64_t esc_bytes = esc_count * 2;
-    uint64_t ans_size  = static_cast<uint64_t>(P.ans_bytes.size());
-
-    f.write(reinterpret_cast<const char*>(&magic), 4);
-    f.write(reinterpret_cast<const char*>(&P.mode), 4);
-    f.write(reinterpret_cast<const char*>(&P.w), 4);
-    f.write(reinterpret_cast<const char*>(&P.h), 4);
-    f.write(reinterpret_cast<const char*>(&P.c), 4);
-    f.write(reinterpret_cast<const char*>(&P.n_syms), 8);
-    f.write(reinterpret_cast<const char*>(&L), 4);
-    f.write(reinterpret_cast<const char*>(&ALPH), 4);
-    f.write(reinterpret_cast<const char*>(P.model.freq.data()),
-            static_cast<std::streamsize>(sizeof(uint16_t) * ALPH));
-    f.write(reinterpret_cast<const char*>(&esc_count), 8);
-    f.write(reinterpret_cast<const char*>(&esc_bytes), 8);
-    f.write(reinterpret_cast<const char*>(&ans_size), 8);
-    if (esc_bytes)
-        f.write(reinterpret_cast<const char*>(P.escapes.data()),
-                static_cast<std::streamsize>(esc_bytes));
-    if (ans_size)
-        f.write(reinterpret_cast<const char*>(P.ans_bytes.data()),
-                static_cast<std::streamsize>(ans_size));
-
-    if (!f) throw std::runtime_error("write failed: " + path);
-}
-
-static Packed load_file(const std::string& path) {
-    std::ifstream f(path, std::ios::binary);
-    if (!f) throw std::runtime_error("open read: " + path);
-
-    Packed P{};
-    uint32_t magic = 0;
-    f.read(reinterpret_cast<char*>(&magic), 4);
-    if (magic != FILE_MAGIC) throw std::runtime_error("bad magic");
-
-    f.read(reinterpret_cast<char*>(&P.mode), 4);
-    f.read(reinterpret_cast<char*>(&P.w), 4);
-    f.read(reinterpret_cast<char*>(&P.h), 4);
-    f.read(reinterpret_cast<char*>(&P.c), 4);
-    f.read(reinterpret_cast<char*>(&P.n_syms), 8);
-
-    uint32_t L = 0, ALPH = 0;
-    f.read(reinterpret_cast<char*>(&L), 4);
-    f.read(reinterpret_cast<char*>(&ALPH), 4);
-    P.model.L = L;
-    P.model.freq.resize(ALPH);
-    f.read(reinterpret_cast<char*>(P.model.freq.data()),
-           static_cast<std::streamsize>(sizeof(uint16_t) * ALPH));
-
-    // rebuild CDF + LUT
-    P.model.cdf.resize(ALPH);
+    uint64_t ans_size  = static_cast<uint64_t>(C.ans_bytes.size());
+
+    put(out, C.n_syms);
+    if (!C.packed_models.empty()) out(C.packed_models.data(), C.packed_models.size());
+    put(out, esc_count);
+    put(out, esc_bytes);
+    put(out, ans_size);
+    if (esc_bytes) out(reinterpret_cast<const uint8_t*>(C.escapes.data()), esc_bytes);
+    if (ans_size)  out(C.ans_bytes.data(), ans_size);
+    for (const auto& s : C.side) write_chunk(out, s);
+}
+
+// CDF + LUT from freq; symbols past freq.size() never occur
+static void finish_model(Model& m) {
+    const uint32_t ALPH = static_cast<uint32_t>(m.freq.size());
+    m.cdf.resize(ALPH);
     uint32_t cdf = 0;
-    for (uint32_t s = 0; s < ALPH; ++s) { P.model.cdf[s] = cdf; cdf += P.model.freq[s]; }
-    P.model.lut_sym.resize(L);
+    for (uint32_t s = 0; s < ALPH; ++s) { m.cdf[s] = cdf; cdf += m.freq[s]; }
+    if (cdf != m.L) throw std::runtime_error("bad model: freq sum != L");
+    m.lut_sym.resize(m.L);
     for (uint32_t s = 0; s < ALPH; ++s) {
-        uint32_t fsz = P.model.freq[s], start = P.model.cdf[s];
-        for (uint32_t i = 0; i < fsz; ++i) P.model.lut_sym[start + i] = static_cast<uint16_t>(s);
+        uint32_t fsz = m.freq[s], start = m.cdf[s];
+        std::fill_n(m.lut_sym.begin() + start, fsz, static_cast<uint16_t>(s));
+    }
+}
+
+static Model read_model_raw(ByteReader& r) {
+    Model m;
+    uint32_t L = r.get<uint32_t>(), ALPH = r.get<uint32_t>();
+    if (!std::has_single_bit(L) || L > (1u << MAX_PREC) || ALPH == 0 || ALPH > ALPHABET)
+        throw std::runtime_error("bad model header");
+    m.L = L;
+    m.freq.resize(ALPH);
+    std::memcpy(m.freq.data(), r.take(sizeof(uint16_t) * ALPH).data(), sizeof(uint16_t) * ALPH);
+    finish_model(m);
+    return m;
+}
+
+static Model read_model(ByteReader& r) {
+    uint8_t  prec    = r.get<uint8_t>();
+    uint16_t lo      = r.get<uint16_t>();
+    uint16_t hi      = r.get<uint16_t>();
+    uint32_t n_bytes = r.get<uint32_t>();
+    if (prec > MAX_PREC || lo > hi || hi >= ALPHABET || n_bytes > 4u * ALPHABET)
+        throw std::runtime_error("bad model header");
+    std::span<const uint8_t> bits = r.take(n_bytes);
+
+    Model m;
+    m.L = 1u << prec;
+    m.freq.assign(hi + 1u, 0);
+    BitReader br{bits.data(), 8ull * n_bytes};
+    uint32_t sum = 0;
+    for (uint32_t s = lo; s < hi;) {
+        uint32_t fs  = br.gamma();
+        uint32_t gap = br.gamma();
+        if (fs >= m.L - sum) throw std::runtime_error("bad model: freq sum != L");
+        if (gap > hi - s) throw std::runtime_error("bad model: symbol past hi");
+        m.freq[s] = static_cast<uint16_t>(fs);
+        sum += fs;
+        s += gap;
+    }
+    if (m.L - sum > 0xFFFF) throw std::runtime_error("bad model: freq out of range");
+    m.freq[hi] = static_cast<uint16_t>(m.L - sum);
+    finish_model(m);
+    return m;
+}
+
+static constexpr uint64_t HEADER_BYTES = 9 * 4 + 8; // as written (current version), without the optional fields
+
+static uint64_t header_bytes(const Header& H) {
+    return HEADER_BYTES + ((H.flags & FLAG_LS_REUSE) ? 1 : 0) + ((H.flags & FLAG_CHECKSUM) ? 4 : 0);
+}
+
+static void write_header(const ByteSink& out, const Header& H) {
+    uint32_t magic   = FILE_MAGIC_V2;
+    uint32_t version = CONTAINER_VERSION;
+    uint32_t n_stripes = static_cast<uint32_t>(H.n_stripes);
+
+    put(out, magic);
+    put(out, version);
+    put(out, H.flags);
+    put(out, H.mode);
+    put(out, H.w);
+    put(out, H.h);
+    put(out, H.c);
+    put(out, H.stripe_rows);
+    put(out, n_stripes);
+    put(out, H.info.predictor);
+    put(out, H.info.ls_n);
+    put(out, H.info.ls_inter);
+    put(out, H.info.format);
+    put(out, H.info.ls_win_w);
+    put(out, H.info.ls_win_h);
+    if (H.flags & FLAG_LS_REUSE) put(out, H.info.ls_reuse);
+    if (H.flags & FLAG_CHECKSUM) put(out, H.info.checksum);
+}
+
+// Whole container in file order, returns its size
+static uint64_t write_container(const ByteSink& out, const Header& H, const std::vector<Chunk>& chunks) {
+    write_header(out, H);
+    uint64_t offset = header_bytes(H) + 16ull * chunks.size();
+    for (const auto& C : chunks) {
+        uint64_t size = chunk_bytes(C);
+        put(out, offset);
+        put(out, size);
+        offset += size;
+    }
+    for (const auto& C : chunks) write_chunk(out, C);
+    return offset;
+}
+
+static ByteSink stream_sink(std::ofstream& f) {
+    return [&f](const uint8_t* data, size_t n) {
+        f.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(n));
+    };
+}
+
+struct StripeTable {
+    Header hdr;
+    uint32_t version = 2;
+    std::vector<std::pair<uint64_t, uint64_t>> entries; // offset, size
+};
+
+// Decoder side of a chunk: the models are rebuilt, payload and escapes stay in the file bytes
+struct ChunkView {
+    uint64_t n_syms = 0;
+    std::vector<Model> models;
+    std::span<const uint8_t> ans_bytes;
+    std::span<const uint8_t> escapes;   // esc_count little-endian int16
+    std::vector<ChunkView> side;
+};
+
+static size_t stripe_samples(const Header& H, int s) {
+    int y0 = s * H.stripe_rows;
+    int n  = std::min(H.stripe_rows, H.h - y0);
+    return static_cast<size_t>(n) * H.w * H.c;
+}
+
+// Every count and offset is checked against the file length before it is used
+static StripeTable read_table(std::span<const uint8_t> file) {
+    StripeTable T;
+    ByteReader r{file};
+    uint32_t magic = r.get<uint32_t>();
+
+    if (magic == FILE_MAGIC) {
+        throw std::runtime_error("unsupported legacy container ('RANS' v1): its rANS stream cannot be decoded");
+    } else if (magic == FILE_MAGIC_V2) {
+        uint32_t version = r.get<uint32_t>();
+        if (version < 2 || version > CONTAINER_VERSION) throw std::runtime_error("unsupported container version");
+        T.version = version;
+        if (version >= 3) T.hdr.flags = r.get<uint32_t>();
+        if (T.hdr.flags & ~(FLAG_RANS_X8 | FLAG_CONTEXT | FLAG_CHECKSUM | FLAG_SIDE | FLAG_LS_REUSE)) throw std::runtime_error("unknown container flags");
+        T.hdr.mode        = r.get<int32_t>();
+        T.hdr.w           = r.get<int32_t>();
+        T.hdr.h           = r.get<int32_t>();
+        T.hdr.c           = r.get<int32_t>();
+        T.hdr.stripe_rows = r.get<int32_t>();
+        uint32_t n_stripes = r.get<uint32_t>();
+        if (T.hdr.h <= 0 || T.hdr.stripe_rows <= 0 ||
+            n_stripes != (uint32_t)((T.hdr.h + T.hdr.stripe_rows - 1) / T.hdr.stripe_rows))
+            throw std::runtime_error("bad stripe table");
+        T.hdr.n_stripes = (int)n_stripes;
+        if (version >= 5) {
+            T.hdr.info.predictor = r.get<uint8_t>();
+            T.hdr.info.ls_n      = r.get<uint8_t>();
+            T.hdr.info.ls_inter  = r.get<uint8_t>();
+            T.hdr.info.format    = r.get<uint8_t>();
+            T.hdr.info.ls_win_w  = r.get<uint16_t>();
+            T.hdr.info.ls_win_h  = r.get<uint16_t>();
+            if (T.hdr.info.predictor > PRED_BLOCK_LS) throw std::runtime_error("unknown predictor in header");
+        }
+        if (T.hdr.flags & FLAG_LS_REUSE) {
+            if (version < 5) throw std::runtime_error("bad header: LS reuse without codec info");
+            T.hdr.info.ls_reuse = r.get<uint8_t>();
+        }
+        if (T.hdr.flags & FLAG_CHECKSUM) {
+            T.hdr.info.has_checksum = true;
+            T.hdr.info.checksum = r.get<uint32_t>();
+        }
+
+        ByteReader tab{r.take(16ull * n_stripes)};
+        const uint64_t data_start = r.pos;
+        T.entries.resize(n_stripes);
+        for (auto& e : T.entries) {
+            e.first  = tab.get<uint64_t>();
+            e.second = tab.get<uint64_t>();
+            if (e.first < data_start || e.first > file.size() || e.second > file.size() - e.first)
+                throw std::runtime_error("bad stripe table: chunk past end of file");
+        }
+    } else {
+        throw std::runtime_error("bad magic");
     }
+    if (T.hdr.w <= 0 || T.hdr.h <= 0 || T.hdr.c <= 0) throw std::runtime_error("bad header");
+    if (static_cast<uint64_t>(T.hdr.w) * T.hdr.h > (uint64_t)PTRDIFF_MAX / sizeof(int16_t) / T.hdr.c)
+        throw std::runtime_error("bad header: image too large");
+    return T;
+}
+
+// Side data is at most SIDE_PER_SAMPLE values per residual (block LS: 1 + 12 per 1x1 block)
+static constexpr uint64_t SIDE_PER_SAMPLE = 16;
 
-    uint64_t esc_count = 0, esc_bytes = 0, ans_size = 0;
-    f.read(reinterpret_cast<char*>(&esc_count), 8);
-    f.read(reinterpret_cast<char*>(&esc_bytes), 8);
-    f.read(reinterpret_cast<char*>(&ans_size), 8);
+static ChunkView read_chunk_fields(ByteReader& r, int n_models, uint32_t version) {
+    ChunkView C;
+    C.n_syms = r.get<uint64_t>();
+    for (int k = 0; k < n_models; ++k)
+        C.models.push_back(version >= 4 ? read_model(r) : read_model_raw(r));
 
-    P.escapes.resize(static_cast<size_t>(esc_count));
-    if (esc_bytes)
-        f.read(reinterpret_cast<char*>(P.escapes.data()),
-               static_cast<std::streamsize>(esc_bytes));
+    uint64_t esc_count = r.get<uint64_t>();
+    uint64_t esc_bytes = r.get<uint64_t>();
+    uint64_t ans_size  = r.get<uint64_t>();
+    if (esc_count > C.n_syms || esc_bytes != esc_count * 2)
+        throw std::runtime_error("bad chunk header");
+    C.escapes   = r.take(esc_bytes);
+    C.ans_bytes = r.take(ans_size);
+    return C;
+}
+
+static ChunkView read_chunk(std::span<const uint8_t> file, const StripeTable& T, int s) {
+    ByteReader r{file.subspan(T.entries[s].first, T.entries[s].second)};
+    ChunkView C = read_chunk_fields(r, model_count(T.hdr.flags), T.version);
+    if (C.n_syms != stripe_samples(T.hdr, s)) throw std::runtime_error("stripe size mismatch");
+    if (T.hdr.flags & FLAG_SIDE) {
+        C.side.push_back(read_chunk_fields(r, 1, T.version));
+        if (C.side[0].n_syms > SIDE_PER_SAMPLE * C.n_syms) throw std::runtime_error("bad chunk header: side data");
+    }
+    return C;
+}
 
-    P.ans_bytes.resize(static_cast<size_t>(ans_size));
-    if (ans_size)
-        f.read(reinterpret_cast<char*>(P.ans_bytes.data()),
-               static_cast<std::streamsize>(ans_size));
+// Consumes residuals: they are turned into the symbols in place (and counted on the way),
+// then rANS coded straight from there
+static Chunk encode_chunk(std::span<int16_t> residuals, int w, int c, uint32_t flags, int prec) {
+    Chunk C;
+    const size_t n = residuals.size();
+    if (flags & FLAG_CONTEXT) {
+        // contexts need the neighbours' symbols, so they are counted in a second pass
+        std::span<const uint16_t> syms;
+        {
+            metrics::Scope t(metrics::SYMBOLIZE);
+            syms = symbolize_in_place(residuals, C.escapes, nullptr);
+        }
+        std::vector<uint8_t> ctx(n);
+        {
+            metrics::Scope t(metrics::MODEL);
+            std::vector<std::vector<uint64_t>> counts(N_CTX, std::vector<uint64_t>(ALPHABET, 0));
+            for (size_t i = 0, x = 0, ch = 0; i < n; ++i) {
+                ctx[i] = static_cast<uint8_t>(activity_ctx(syms.data(), i, (int)x, w, c));
+                counts[ctx[i]][syms[i]]++;
+                if (++ch == (size_t)c) { ch = 0; if (++x == (size_t)w) x = 0; }
+            }
+            for (const auto& k : counts) C.models.push_back(build_model(k, prec));
+        }
+        metrics::Scope t(metrics::ENCODE);
+        C.ans_bytes = rans32::encode_with(syms, [&](size_t i) -> const Model& { return C.models[ctx[i]]; });
+    } else {
+        std::vector<uint64_t> counts(ALPHABET, 0);
+        std::span<const uint16_t> syms;
+        {
+            metrics::Scope t(metrics::SYMBOLIZE);
+            syms = symbolize_in_place(residuals, C.escapes, counts.data());
+        }
+        {
+            metrics::Scope t(metrics::MODEL);
+            C.models.push_back(build_model(counts, prec));
+        }
+        metrics::Scope t(metrics::ENCODE);
+        C.ans_bytes = (flags & FLAG_RANS_X8) ? rans32x8::encode(syms, C.models[0])
+                                             : rans32::encode(syms, C.models[0]);
+    }
+    {
+        metrics::Scope t(metrics::MODEL);
+        for (const auto& m : C.models) {
+            const std::vector<uint8_t> b = pack_model(m);
+            C.packed_models.insert(C.packed_models.end(), b.begin(), b.end());
+        }
+    }
+    C.n_syms = static_cast<uint64_t>(n);
+    return C;
+}
 
-    if (!f) throw std::runtime_error("read failed: " + path);
-    return P;
+static std::vector<int16_t> decode_chunk(const ChunkView& C, int w, int c, uint32_t flags) {
+    const size_t n = static_cast<size_t>(C.n_syms);
+    std::vector<uint16_t> syms;
+    if (flags & FLAG_CONTEXT) {
+        size_t x = 0, ch = 0;
+        syms = rans32::decode_with(C.ans_bytes, n, [&](size_t i, const uint16_t* z) -> const Model& {
+            const Model& m = C.models[activity_ctx(z, i, (int)x, w, c)];
+            if (++ch == (size_t)c) { ch = 0; if (++x == (size_t)w) x = 0; }
+            return m;
+        });
+    } else {
+        syms = (flags & FLAG_RANS_X8) ? rans32x8::decode(C.ans_bytes, n, C.models[0])
+                                      : rans32::decode(C.ans_bytes, n, C.models[0]);
+    }
+    size_t esc = static_cast<size_t>(std::count(syms.begin(), syms.end(), ESC_SYM));
+    if (2 * esc != C.escapes.size()) throw std::runtime_error("escape count mismatch");
+    return unsymbolize_residuals(syms, C.escapes);
 }
 
 // ---------------------------- public API ----------------------------------
-Encoded compress_to_file(const std::vector<int16_t>& residuals,
+static Header make_header(int mode, int w, int h, int c, const Options& opt) {
+    if (w <= 0 || h <= 0 || c <= 0)
+        throw std::runtime_error("compress: bad image shape");
+    if (opt.precBits < RANS_PREC || opt.precBits > MAX_PREC)
+        throw std::invalid_argument("compress: precBits out of range");
+
+    Header H;
+    H.mode        = mode;
+    H.w           = w;
+    H.h           = h;
+    H.c           = c;
+    H.stripe_rows = (opt.stripeRows <= 0 || opt.stripeRows >= h) ? h : opt.stripeRows;
+    H.n_stripes   = (h + H.stripe_rows - 1) / H.stripe_rows;
+    // context tables are chosen per symbol, which only the single-state coder supports
+    const uint32_t coder = opt.flags & ~(FLAG_CHECKSUM | FLAG_SIDE | FLAG_LS_REUSE);
+    H.flags       = ((coder & FLAG_CONTEXT) ? FLAG_CONTEXT : coder) | (opt.flags & FLAG_SIDE);
+    H.info        = opt.info;
+    if (H.info.ls_reuse) H.flags |= FLAG_LS_REUSE;
+    if (H.info.has_checksum) H.flags |= FLAG_CHECKSUM;
+    return H;
+}
+
+// FLAG_SIDE: the side values as a chunk of their own, one table (no contexts: they are no image)
+static void add_side(Chunk& C, std::vector<int16_t>&& side, uint32_t flags, int prec) {
+    if (!(flags & FLAG_SIDE)) return;
+    std::vector<int16_t> v = std::move(side);
+    C.side.push_back(encode_chunk(v, static_cast<int>(v.size()), 1, flags & FLAG_RANS_X8, prec));
+}
+
+static void add_info(Encoded& info, const Chunk& C) {
+    info.escapes   += C.escapes.size();
+    info.n_syms    += static_cast<size_t>(C.n_syms);
+    info.ans_bytes += C.ans_bytes.size();
+    for (const auto& s : C.side) info.ans_bytes += s.ans_bytes.size();
+}
+
+Encoded compress_to_sink(const std::vector<int16_t>& residuals,
                          int mode, int w, int h, int c,
-                         const std::string& outPath)
+                         const ByteSink& sink,
+                         const Options& opt,
+                         const SideData& side)
 {
+    if (residuals.size() != static_cast<size_t>(w) * h * c)
+        throw std::runtime_error("compress: residual count mismatch");
+
+    // the caller keeps its residuals, so each stripe is coded from a copy
+    const Header H = make_header(mode, w, h, c, opt);
+    if ((H.flags & FLAG_SIDE) && side.size() != static_cast<size_t>(H.n_stripes))
+        throw std::runtime_error("compress: need side data for every stripe");
+    return compress_stripes_to_sink(mode, w, h, c, [&](const StripeSink& emit) {
+        std::vector<metrics::Record> times(H.n_stripes);
+        ThreadPool pool(std::max(1, std::min(opt.threads, H.n_stripes)));
+        pool.parallel_for(H.n_stripes, [&](int s) {
+            const int16_t* first = residuals.data() + static_cast<size_t>(s) * H.stripe_rows * w * c;
+            times[s] = metrics::capture([&] {
+                emit(s, std::vector<int16_t>(first, first + stripe_samples(H, s)),
+                     (H.flags & FLAG_SIDE) ? std::vector<int16_t>(side[s]) : std::vector<int16_t>{});
+            });
+        });
+        for (const auto& t : times) metrics::local().add(t);
+    }, sink, opt);
+}
+
+Encoded compress_stripes_to_sink(int mode, int w, int h, int c,
+                                 const StripeProducer& produce,
+                                 const ByteSink& sink,
+                                 const Options& opt)
+{
+    const Header H = make_header(mode, w, h, c, opt);
+    std::vector<Chunk> chunks(H.n_stripes);
+    std::vector<char> done(H.n_stripes, 0);
+
+    produce(StripeSink{[&](int s, std::vector<int16_t>&& residuals, std::vector<int16_t>&& side) {
+        if (s < 0 || s >= H.n_stripes || done[s]) throw std::runtime_error("compress: bad stripe index");
+        if (residuals.size() != stripe_samples(H, s)) throw std::runtime_error("compress: stripe size mismatch");
+        std::vector<int16_t> r = std::move(residuals);
+        trace::Scope t("code stripe", s);
+        chunks[s] = encode_chunk(r, w, c, H.flags, opt.precBits);
+        add_side(chunks[s], std::move(side), H.flags, opt.precBits);
+        done[s] = 1;
+    }});
+    if (std::count(done.begin(), done.end(), 0)) throw std::runtime_error("compress: missing stripes");
+
+    metrics::Scope t(metrics::WRITE);
     Encoded info{};
+    info.file_bytes = static_cast<size_t>(write_container(sink, H, chunks));
+    for (const auto& C : chunks) add_info(info, C);
+    return info;
+}
 
-    Symbolized S = symbolize_residuals(residuals);
-    Model M      = build_model(S.syms);
-    std::vector<uint8_t> ans_bytes = rans32::encode(S.syms, M);
-
-    Packed P;
-    P.mode     = mode;
-    P.w        = w;
-    P.h        = h;
-    P.c        = c;
-    P.n_syms   = static_cast<uint64_t>(S.syms.size());
-    P.model    = std::move(M);
-    P.ans_bytes= std::move(ans_bytes);
-    P.escapes  = std::move(S.esc);
-
-    save_file(outPath, P);
-
-    info.escapes   = P.escapes.size();
-    info.n_syms    = static_cast<size_t>(P.n_syms);
-    info.ans_bytes = P.ans_bytes.size();
+Encoded compress_to_buffer(const std::vector<int16_t>& residuals,
+                           int mode, int w, int h, int c,
+                           std::vector<uint8_t>& out,
+                           const Options& opt,
+                           const SideData& side)
+{
+    return compress_to_sink(residuals, mode, w, h, c, [&out](const uint8_t* data, size_t n) {
+        out.insert(out.end(), data, data + n);
+    }, opt, side);
+}
+
+Encoded compress_to_file(const std::vector<int16_t>& residuals,
+                         int mode, int w, int h, int c,
+                         const std::string& outPath,
+                         const Options& opt,
+                         const SideData& side)
+{
+    std::ofstream f(outPath, std::ios::binary);
+    if (!f) throw std::runtime_error("open write: " + outPath);
+    Encoded info = compress_to_sink(residuals, mode, w, h, c, stream_sink(f), opt, side);
+    metrics::Scope t(metrics::WRITE);
+    f.close();
+    if (!f) throw std::runtime_error("write failed: " + outPath);
     return info;
 }
 
-std::vector<int16_t> decompress_file(const std::string& inPath) {
-    Packed P = load_file(inPath);
-    std::vector<uint16_t> syms = rans32::decode(P.ans_bytes, static_cast<size_t>(P.n_syms), P.model);
-    return unsymbolize_residuals(syms, P.escapes);
+// ------------------------- incremental writer ------------------------------
+// Same bytes as compress_to_file: header, a zeroed stripe table that finish() fills in
+// (with the checksum, which is only known once every stripe went through),
+// then each chunk as soon as its stripe arrives.
+struct StripeWriter::Impl {
+    std::ofstream f;
+    std::string path;
+    Header H;
+    int precBits = RANS_PREC;
+    std::vector<std::pair<uint64_t, uint64_t>> table; // offset, size of stripes written so far
+    Encoded info{};
+};
+
+StripeWriter::StripeWriter(const std::string& outPath, int mode, int w, int h, int c, const Options& opt)
+    : impl(std::make_unique<Impl>())
+{
+    impl->H = make_header(mode, w, h, c, opt);
+    impl->precBits = opt.precBits;
+    impl->path = outPath;
+    impl->f.open(outPath, std::ios::binary);
+    if (!impl->f) throw std::runtime_error("open write: " + outPath);
+
+    write_header(stream_sink(impl->f), impl->H);
+    const std::vector<char> zeros(16ull * impl->H.n_stripes, 0);
+    impl->f.write(zeros.data(), static_cast<std::streamsize>(zeros.size()));
+}
+
+StripeWriter::~StripeWriter() = default;
+
+const Header& StripeWriter::header() const { return impl->H; }
+
+void StripeWriter::add_stripe(std::vector<int16_t> residuals, std::vector<int16_t> side) {
+    const int s = static_cast<int>(impl->table.size());
+    if (s >= impl->H.n_stripes) throw std::runtime_error("StripeWriter: too many stripes");
+    if (residuals.size() != stripe_samples(impl->H, s))
+        throw std::runtime_error("StripeWriter: stripe size mismatch");
+
+    Chunk C = encode_chunk(residuals, impl->H.w, impl->H.c, impl->H.flags, impl->precBits);
+    add_side(C, std::move(side), impl->H.flags, impl->precBits);
+    metrics::Scope t(metrics::WRITE);
+    uint64_t offset = static_cast<uint64_t>(impl->f.tellp());
+    write_chunk(stream_sink(impl->f), C);
+    impl->table.emplace_back(offset, chunk_bytes(C));
+    add_info(impl->info, C);
+    if (!impl->f) throw std::runtime_error("write failed: " + impl->path);
+}
+
+void StripeWriter::set_checksum(uint32_t crc) {
+    if (!(impl->H.flags & FLAG_CHECKSUM)) throw std::runtime_error("StripeWriter: header has no checksum field");
+    impl->H.info.checksum = crc;
+}
+
+Encoded StripeWriter::finish() {
+    if (static_cast<int>(impl->table.size()) != impl->H.n_stripes)
+        throw std::runtime_error("StripeWriter: missing stripes");
+    metrics::Scope t(metrics::WRITE);
+    impl->info.file_bytes = static_cast<size_t>(impl->f.tellp());
+    const bool crc = impl->H.flags & FLAG_CHECKSUM;
+    impl->f.seekp(static_cast<std::streamoff>(header_bytes(impl->H) - (crc ? 4 : 0)));
+    if (crc) impl->f.write(reinterpret_cast<const char*>(&impl->H.info.checksum), 4);
+    for (const auto& e : impl->table) {
+        impl->f.write(reinterpret_cast<const char*>(&e.first), 8);
+        impl->f.write(reinterpret_cast<const char*>(&e.second), 8);
+    }
+    impl->f.close();
+    if (!impl->f) throw std::runtime_error("write failed: " + impl->path);
+    return impl->info;
+}
+
+// ------------------------------ reader -------------------------------------
+// Both readers decode from a byte range that holds a whole container: the file mapping or
+// the caller's buffer.
+static std::vector<int16_t> decode_stripe(std::span<const uint8_t> bytes, const StripeTable& T, int s) {
+    if (s < 0 || s >= T.hdr.n_stripes) throw std::runtime_error("stripe out of range");
+    trace::Scope t("decode stripe", s);
+    ChunkView C = read_chunk(bytes, T, s);
+    return decode_chunk(C, T.hdr.w, T.hdr.c, T.hdr.flags);
+}
+
+static std::vector<int16_t> decode_side(std::span<const uint8_t> bytes, const StripeTable& T, int s) {
+    if (s < 0 || s >= T.hdr.n_stripes) throw std::runtime_error("stripe out of range");
+    if (!(T.hdr.flags & FLAG_SIDE)) return {};
+    ChunkView C = read_chunk(bytes, T, s);
+    return decode_chunk(C.side[0], static_cast<int>(C.side[0].n_syms), 1, T.hdr.flags & FLAG_RANS_X8);
+}
+
+static std::vector<int16_t> decode_all(std::span<const uint8_t> bytes, const StripeTable& T, int threads) {
+    const Header& H = T.hdr;
+    std::vector<int16_t> out(static_cast<size_t>(H.w) * H.h * H.c);
+
+    // stripes are independent and only read the shared bytes
+    ThreadPool pool(std::max(1, std::min(threads, H.n_stripes)));
+    pool.parallel_for(H.n_stripes, [&](int s) {
+        std::vector<int16_t> r = decode_stripe(bytes, T, s);
+        size_t first = static_cast<size_t>(s) * H.stripe_rows * H.w * H.c;
+        std::copy(r.begin(), r.end(), out.begin() + static_cast<std::ptrdiff_t>(first));
+    });
+    return out;
+}
+
+struct FileReader::Impl {
+    MappedFile file;
+    StripeTable T;
+
+    explicit Impl(const std::string& path) : file(path), T(read_table(file.bytes())) {}
+};
+
+FileReader::FileReader(const std::string& inPath) : impl(std::make_unique<Impl>(inPath)) {}
+
+FileReader::~FileReader() = default;
+
+const Header& FileReader::header() const { return impl->T.hdr; }
+
+std::vector<int16_t> FileReader::stripe(int s) const {
+    return decode_stripe(impl->file.bytes(), impl->T, s);
+}
+
+std::vector<int16_t> FileReader::side(int s) const {
+    return decode_side(impl->file.bytes(), impl->T, s);
+}
+
+std::vector<int16_t> FileReader::decode(int threads) const {
+    return decode_all(impl->file.bytes(), impl->T, threads);
+}
+
+Header read_header(const std::string& inPath) {
+    return FileReader(inPath).header();
+}
+
+std::vector<int16_t> decompress_stripe(const std::string& inPath, int stripe) {
+    return FileReader(inPath).stripe(stripe);
+}
+
+std::vector<int16_t> decompress_file(const std::string& inPath, int threads) {
+    return FileReader(inPath).decode(threads);
+}
+
+Header read_header(std::span<const uint8_t> in) {
+    return read_table(in).hdr;
+}
+
+std::vector<int16_t> decompress_from_buffer(std::span<const uint8_t> in, int threads) {
+    return decode_all(in, read_table(in), threads);
+}
+
+SideData decompress_side(std::span<const uint8_t> in) {
+    const StripeTable T = read_table(in);
+    SideData side(T.hdr.n_stripes);
+    for (int s = 0; s < T.hdr.n_stripes; ++s) side[s] = decode_side(in, T, s);
+    return side;
 }
 
 } // namespace ans
@@ -6,30 +6,166 @@ class ansResidual { };
 
 #pragma once
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace ans {
 
     // ---- Public constants ----
-    static constexpr uint32_t RANS_L     = 1u << 12;   // normalization (L=4096)
+    static constexpr int      RANS_PREC  = 12;         // default log2(L), also the smallest allowed
+    static constexpr int      MAX_PREC   = 16;
+    static constexpr uint32_t RANS_L     = 1u << RANS_PREC; // normalization (L=4096)
     static constexpr uint32_t MAX_SYM    = 4095;       // 0..4095 symbols (12-bit)
     static constexpr uint16_t ESC_SYM    = MAX_SYM;    // escape code
     static constexpr uint32_t ALPHABET   = MAX_SYM + 1;
-    static constexpr uint32_t FILE_MAGIC = 0x534E4152; // 'RANS' (LE)
+    static constexpr uint32_t FILE_MAGIC = 0x534E4152; // 'RANS' (LE), legacy v1, rejected on read
+    static constexpr uint32_t FILE_MAGIC_V2 = 0x32534E52; // 'RNS2' (LE), striped
 
+    // Header flags
+    static constexpr uint32_t FLAG_RANS_X8 = 1u << 0; // 8-way interleaved rANS, 16-bit renorm (SIMD decode)
+    static constexpr uint32_t FLAG_CONTEXT = 1u << 1; // per-symbol table chosen by neighbour activity (scalar coder)
+    static constexpr uint32_t FLAG_CHECKSUM = 1u << 2; // CRC-32C of the source pixels follows the codec info
+    static constexpr uint32_t FLAG_SIDE     = 1u << 3; // every chunk carries predictor side data (block LS weights)
+    static constexpr uint32_t FLAG_LS_REUSE = 1u << 4; // LS skips solves, CodecInfo::ls_reuse follows the window
+
+
+    // How the residuals were made (container v5), so a decoder needs nothing but the file.
+    // The coder itself does not use it; PRED_NONE in older files and for raw residual streams.
+    enum : uint8_t { PRED_NONE = 0, PRED_MED = 1, PRED_LS = 2, PRED_BLOCK_LS = 3 };
+    struct CodecInfo {
+        uint8_t  predictor = PRED_NONE;
+        uint8_t  ls_n = 0, ls_inter = 0;      // LS order and cross-channel terms
+        uint8_t  format = 0;                  // ImageFormat of the source (0 = unknown)
+        uint16_t ls_win_w = 0, ls_win_h = 0;  // LS window (PRED_BLOCK_LS: block size)
+        uint8_t  ls_reuse = 0;                // LS weight reuse K, 0 = solve every sample (FLAG_LS_REUSE)
+        bool     has_checksum = false;        // FLAG_CHECKSUM: crc32c of the interleaved 8-bit source
+        uint32_t checksum = 0;
+    };
 
     struct Encoded {
         size_t escapes   = 0;   // number of escape residuals (|value| >= MAX_SYM/zigzag)
         size_t n_syms    = 0;   // number of symbols encoded
         size_t ans_bytes = 0;   // size of the ANS payload in bytes (container section only)
+        size_t file_bytes = 0;  // whole container: header, stripe table and chunks
+    };
+
+    // Container layout, stripes are coded independently
+    struct Header {
+        int mode = 0;          // 0 = RGB/Gray samples, 1 = YUV (int16, undo with yuv_to_rgb)
+        int w = 0, h = 0, c = 0;
+        int stripe_rows = 0;   // rows per stripe, last one may be shorter
+        int n_stripes = 0;
+        uint32_t flags = 0;    // FLAG_*
+        CodecInfo info;        // predictor and source format, mode gives the colour transform
+    };
+
+    struct Options {
+        int stripeRows = 0;              // <= 0 -> one stripe
+        int threads = 1;                 // stripes are entropy coded on this many workers
+        uint32_t flags = FLAG_RANS_X8;   // 0 = scalar single-state rANS; FLAG_CONTEXT = adaptive tables
+        int precBits = RANS_PREC;        // log2(L) of the frequency tables, RANS_PREC..MAX_PREC
+        CodecInfo info;                  // stored in the header only
     };
 
+    // Receives the container bytes in file order, a few calls per stripe
+    using ByteSink = std::function<void(const uint8_t* data, size_t n)>;
+
+    // Predictor side data per stripe (FLAG_SIDE in Options::flags), e.g. block LS weights.
+    // Each stripe's values are rANS coded with their own table next to its residuals.
+    using SideData = std::vector<std::vector<int16_t>>;
+
+    // Residual stripes must match how they were predicted (see predict_stripes).
+    // side: one entry per stripe with FLAG_SIDE, ignored otherwise
+    Encoded compress_to_sink(const std::vector<int16_t>& residuals,
+                             int mode, int w, int h, int c,
+                             const ByteSink& sink,
+                             const Options& opt = {},
+                             const SideData& side = {});
+
+    // Appends the container to out, so several images can share one blob
+    // (each one takes Encoded::file_bytes, decode from its start).
+    Encoded compress_to_buffer(const std::vector<int16_t>& residuals,
+                               int mode, int w, int h, int c,
+                               std::vector<uint8_t>& out,
+                               const Options& opt = {},
+                               const SideData& side = {});
+
     Encoded compress_to_file(const std::vector<int16_t>& residuals,
                              int mode, int w, int h, int c,
-                             const std::string& outPath);
+                             const std::string& outPath,
+                             const Options& opt = {},
+                             const SideData& side = {});
+
+    // Fused encode: produce(emit) hands over the residuals of every stripe once, in any order
+    // and from any thread (e.g. predict_stripes_to). Each stripe is zig-zag mapped and counted
+    // in place and rANS coded on the calling thread, so no frame-sized residual or symbol
+    // array is kept; the container is written to sink when all stripes are in.
+    // side goes with the stripe when the header has FLAG_SIDE.
+    struct StripeSink {
+        std::function<void(int stripe, std::vector<int16_t>&& residuals, std::vector<int16_t>&& side)> fn;
+        void operator()(int stripe, std::vector<int16_t>&& residuals, std::vector<int16_t>&& side = {}) const {
+            fn(stripe, std::move(residuals), std::move(side));
+        }
+    };
+    using StripeProducer = std::function<void(const StripeSink& emit)>;
+    Encoded compress_stripes_to_sink(int mode, int w, int h, int c,
+                                     const StripeProducer& produce,
+                                     const ByteSink& sink,
+                                     const Options& opt = {});
+
+    // Writes the same file as compress_to_file one stripe at a time, top to bottom,
+    // so only the stripe being coded is held in memory. finish() completes the file.
+    class StripeWriter {
+    public:
+        StripeWriter(const std::string& outPath, int mode, int w, int h, int c,
+                     const Options& opt = {});
+        ~StripeWriter();
+
+        const Header& header() const;  // stripe_rows / n_stripes as resolved from opt
+        void add_stripe(std::vector<int16_t> residuals,     // next stripe, rows*w*c values (coded in place)
+                        std::vector<int16_t> side = {});    // FLAG_SIDE data of the stripe
+        void set_checksum(uint32_t crc); // written by finish(), needs opt.info.has_checksum
+        Encoded finish();
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl;
+    };
+
+    // Decodes from a read-only mapping of the file (see MappedFile): rANS payloads and escapes
+    // are used in place, nothing is copied out first. Header and stripe table sizes are checked
+    // against the file length before use. stripe() may run on several threads at once.
+    class FileReader {
+    public:
+        explicit FileReader(const std::string& inPath);
+        ~FileReader();
+
+        const Header& header() const;
+        std::vector<int16_t> stripe(int s) const;          // residuals of stripe s
+        std::vector<int16_t> side(int s) const;            // its FLAG_SIDE data (empty without)
+        std::vector<int16_t> decode(int threads = 1) const; // whole image
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl;
+    };
+
+    // Reads striped ('RNS2', v2+) files; legacy v1 ('RANS') files throw std::runtime_error
+    std::vector<int16_t> decompress_file(const std::string& inPath, int threads = 1);
+
+    Header read_header(const std::string& inPath);
+    // Residuals of one stripe only (rows [s*stripe_rows, ...)), other stripes are not read
+    std::vector<int16_t> decompress_stripe(const std::string& inPath, int stripe);
 
-    std::vector<int16_t> decompress_file(const std::string& inPath);
+    // Same decoding from memory. in starts at a container, bytes after it are ignored;
+    // sizes are checked against in.size() as they are against the file length.
+    Header read_header(std::span<const uint8_t> in);
+    std::vector<int16_t> decompress_from_buffer(std::span<const uint8_t> in, int threads = 1);
+    SideData decompress_side(std::span<const uint8_t> in); // every stripe's side data
 
 } // namespace ans
 #endif // BYTE2BITPROJECT1_ANSRESIDUAL_H
@@ -0,0 +1,280 @@
+// Throughput microbenchmarks: predictors, colour transforms, rANS container and file I/O
+// on synthetic images. Self-contained (no Google Benchmark): each case runs until
+// --min-ms has passed (at least --min-iters times) and the fastest iteration is reported.
+//
+//   Byte2BitBench [--filter SUBSTR] [--sizes 256,1024] [--min-ms 200] [--min-iters 3] [--csv]
+
+#include "ansResidual.h"
+#include "imageIO.h"
+#include "predictor.h"
+#include "residualIO.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// ---------- synthetic inputs ----------
+// Deterministic per (pattern, size), so runs compare across builds
+enum class Pattern { Gradient, Noise, Flat, Text };
+const char* pattern_name(Pattern p) {
+    switch (p) {
+        case Pattern::Gradient: return "gradient";
+        case Pattern::Noise:    return "noise";
+        case Pattern::Flat:     return "flat";
+        case Pattern::Text:     return "text";
+    }
+    return "?";
+}
+
+Image make_image(Pattern p, int w, int h, int c) {
+    std::mt19937 rng(static_cast<uint32_t>(w * 31 + h * 7 + c + static_cast<int>(p) * 1000));
+    Image im; im.w = w; im.h = h; im.c = c; im.format = ImageFormat::PNG;
+    im.px.resize((size_t)w*h*c);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            // text: dark strokes on paper, glyph-sized cells with a few bars each
+            const int cell = ((x / 8) * 7 + (y / 12) * 13) % 5;
+            const bool ink = (y % 12) < 9 && ((cell == 0 && x % 8 < 2) || (cell == 1 && y % 12 == 4) ||
+                                               (cell == 2 && (x + y) % 8 == 0));
+            for (int ch = 0; ch < c; ++ch) {
+                int v = 0;
+                switch (p) {
+                    case Pattern::Gradient: v = (x * 255 / std::max(1, w - 1) + y * 128 / std::max(1, h - 1) + ch * 40) & 255; break;
+                    case Pattern::Noise:    v = (int)(rng() & 255); break;
+                    case Pattern::Flat:     v = 180 + ch * 20; break;
+                    case Pattern::Text:     v = ink ? 20 + ch * 3 : 235 - ch * 2; break;
+                }
+                im.px[((size_t)y*w + x)*c + ch] = (unsigned char)v;
+            }
+        }
+    }
+    return im;
+}
+
+// ---------- harness ----------
+struct Settings {
+    std::string filter;
+    std::vector<int> sizes{256, 1024};
+    double minMs = 200.0;
+    int minIters = 3;
+    bool csv = false;
+};
+
+// Keeps a result alive so the optimizer cannot drop the work
+template <class T>
+void keep(const T& v) {
+#if defined(__GNUC__)
+    asm volatile("" : : "g"(&v) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &v;
+#endif
+}
+
+struct Case {
+    std::string name;     // stage
+    std::string input;    // pattern WxHxC
+    uint64_t pixels = 0;  // per iteration
+    uint64_t samples = 0;
+    uint64_t bytes = 0;   // processed per iteration (input side)
+    std::function<void()> run;
+};
+
+class Bench {
+public:
+    Bench(const Settings& s, std::ostream& out) : s_(s), out_(out) {
+        if (s_.csv) out_ << "stage,input,iters,ns_per_iter,ns_per_sample,mpix_per_s,mb_per_s\n";
+        else out_ << std::left << std::setw(28) << "stage" << std::setw(22) << "input"
+                  << std::right << std::setw(7) << "iters" << std::setw(14) << "ns/iter"
+                  << std::setw(11) << "ns/sample" << std::setw(10) << "MPix/s" << std::setw(10) << "MB/s" << "\n";
+    }
+
+    void run(const Case& c) {
+        if (!s_.filter.empty() && (c.name + " " + c.input).find(s_.filter) == std::string::npos) return;
+
+        c.run(); // warm-up, page faults, lazy tables
+        double best = 1e300, total = 0;
+        int iters = 0;
+        while (iters < s_.minIters || total < s_.minMs * 1e6) {
+            auto t0 = std::chrono::steady_clock::now();
+            c.run();
+            auto t1 = std::chrono::steady_clock::now();
+            double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+            best = std::min(best, ns);
+            total += ns;
+            ++iters;
+        }
+
+        const double perSample = c.samples ? best / (double)c.samples : 0.0;
+        const double mpix = c.pixels ? (double)c.pixels / best * 1e3 : 0.0;   // pixels/ns * 1e9 / 1e6
+        const double mbs  = c.bytes  ? (double)c.bytes  / best * 1e3 : 0.0;
+        if (s_.csv) {
+            out_ << c.name << "," << c.input << "," << iters << "," << std::fixed << std::setprecision(0) << best
+                 << "," << std::setprecision(3) << perSample << "," << std::setprecision(2) << mpix << "," << mbs << "\n";
+        } else {
+            out_ << std::left << std::setw(28) << c.name << std::setw(22) << c.input << std::right
+                 << std::setw(7) << iters << std::setw(14) << std::fixed << std::setprecision(0) << best
+                 << std::setw(11) << std::setprecision(3) << perSample
+                 << std::setw(10) << std::setprecision(2) << mpix << std::setw(10) << mbs << "\n";
+        }
+        out_.flush();
+    }
+
+private:
+    const Settings& s_;
+    std::ostream& out_;
+};
+
+Settings parse_args(int argc, char** argv) {
+    Settings s;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::invalid_argument("missing value for " + a);
+            return argv[++i];
+        };
+        if (a == "--filter") s.filter = value();
+        else if (a == "--min-ms") s.minMs = std::atof(value().c_str());
+        else if (a == "--min-iters") s.minIters = std::max(1, std::atoi(value().c_str()));
+        else if (a == "--csv") s.csv = true;
+        else if (a == "--sizes") {
+            s.sizes.clear();
+            std::stringstream ss(value());
+            for (std::string t; std::getline(ss, t, ',');) if (int v = std::atoi(t.c_str()); v > 0) s.sizes.push_back(v);
+        } else {
+            throw std::invalid_argument("unknown argument: " + a);
+        }
+    }
+    return s;
+}
+
+// ---------- cases ----------
+std::string label(Pattern p, const Image& im) {
+    return std::string(pattern_name(p)) + " " + std::to_string(im.w) + "x" + std::to_string(im.h) + "x" + std::to_string(im.c);
+}
+
+Case make_case(std::string name, Pattern p, const Image& im, uint64_t bytes, std::function<void()> run) {
+    Case c;
+    c.name = std::move(name);
+    c.input = label(p, im);
+    c.pixels = (uint64_t)im.w * im.h;
+    c.samples = c.pixels * im.c;
+    c.bytes = bytes;
+    c.run = std::move(run);
+    return c;
+}
+
+void bench_med_predict(Bench& b) {
+    // the scalar kernel on its own, over a fixed buffer of neighbour triples
+    std::mt19937 rng(1);
+    std::vector<int> abc(3 * (1 << 16));
+    for (auto& v : abc) v = (int)(rng() & 255);
+    Case c;
+    c.name = "med_predict";
+    c.input = "random triples";
+    c.samples = c.pixels = abc.size() / 3;
+    c.bytes = c.samples * 3;
+    c.run = [abc] {
+        int acc = 0;
+        for (size_t i = 0; i < abc.size(); i += 3) acc += med_predict(abc[i], abc[i + 1], abc[i + 2]);
+        keep(acc);
+    };
+    b.run(c);
+}
+
+void bench_image(Bench& b, Pattern p, int size, const std::filesystem::path& tmp) {
+    const Image rgb = make_image(p, size, size, 3);
+    const Image16 yuv = rgb_to_yuv(rgb);
+    const PlanarImage prgb = to_planar(rgb);
+    const uint64_t n = (uint64_t)rgb.px.size();
+    const int N = 4, win = 4;
+
+    // colour transforms
+    b.run(make_case("rgb_to_yuv", p, rgb, n, [&] { keep(rgb_to_yuv(rgb)); }));
+    b.run(make_case("yuv_to_rgb", p, rgb, 2 * n, [&] { keep(yuv_to_rgb(yuv)); }));
+    b.run(make_case("rgb_to_yuv_scalar", p, rgb, n, [&] { keep(rgb_to_yuv_scalar(rgb)); }));
+    b.run(make_case("yuv_to_rgb_scalar", p, rgb, 2 * n, [&] { keep(yuv_to_rgb_scalar(yuv)); }));
+
+    // predictors, residuals computed once for the reconstruct side
+    const auto medRes = compute_residuals_MED_u8(rgb);
+    const auto medRes16 = compute_residuals_MED_s16(yuv);
+    const auto medPlanar = compute_residuals_MED_planar(prgb);
+    b.run(make_case("MED_u8 residuals", p, rgb, n, [&] { keep(compute_residuals_MED_u8(rgb)); }));
+    b.run(make_case("MED_u8 reconstruct", p, rgb, 2 * n, [&] { keep(reconstruct_from_residuals_MED(medRes, rgb)); }));
+    b.run(make_case("MED_s16 residuals", p, rgb, 2 * n, [&] { keep(compute_residuals_MED_s16(yuv)); }));
+    b.run(make_case("MED_s16 reconstruct", p, rgb, 2 * n, [&] { keep(reconstruct_from_residuals_MED_s16(medRes16, yuv)); }));
+    b.run(make_case("MED_planar residuals", p, rgb, n, [&] { keep(compute_residuals_MED_planar(prgb)); }));
+    b.run(make_case("MED_planar reconstruct", p, rgb, 2 * n, [&] { keep(reconstruct_from_residuals_MED_planar(medPlanar, prgb)); }));
+
+    const auto lsRes = compute_residuals_LS_u8(rgb, N, win, win);
+    const auto lsRes16 = compute_residuals_LS_s16(yuv, N, win, win);
+    const auto lsPlanar = compute_residuals_LS_planar(prgb, N, win, win);
+    b.run(make_case("LS_u8 residuals", p, rgb, n, [&] { keep(compute_residuals_LS_u8(rgb, N, win, win)); }));
+    b.run(make_case("LS_u8 reconstruct", p, rgb, 2 * n, [&] { keep(reconstruct_from_residuals_LS_u8(lsRes, rgb, N, win, win)); }));
+    b.run(make_case("LS_s16 residuals", p, rgb, 2 * n, [&] { keep(compute_residuals_LS_s16(yuv, N, win, win)); }));
+    b.run(make_case("LS_s16 reconstruct", p, rgb, 2 * n, [&] { keep(reconstruct_from_residuals_LS_s16(lsRes16, yuv, N, win, win)); }));
+    b.run(make_case("LS_planar residuals", p, rgb, n, [&] { keep(compute_residuals_LS_planar(prgb, N, win, win)); }));
+    b.run(make_case("LS_planar reconstruct", p, rgb, 2 * n, [&] { keep(reconstruct_from_residuals_LS_planar(lsPlanar, prgb, N, win, win)); }));
+    // solve skipping (flat gating + 4-sample weight reuse), pays off on the flat image
+    const auto lsSkip = compute_residuals_LS_u8(rgb, N, win, win, 1, 0, 4);
+    b.run(make_case("LS_u8 residuals reuse4", p, rgb, n, [&] { keep(compute_residuals_LS_u8(rgb, N, win, win, 1, 0, 4)); }));
+    b.run(make_case("LS_u8 reconstruct reuse4", p, rgb, 2 * n, [&] { keep(reconstruct_from_residuals_LS_u8(lsSkip, rgb, N, win, win, 1, 0, 4)); }));
+
+    // rANS container: compress = symbolize + build_model + encode, bytes are residual bytes
+    struct Coder { const char* name; uint32_t flags; };
+    for (const Coder& k : {Coder{"x8", ans::FLAG_RANS_X8}, Coder{"scalar", 0u}, Coder{"ctx", ans::FLAG_CONTEXT}}) {
+        ans::Options opt;
+        opt.flags = k.flags;
+        std::vector<uint8_t> blob;
+        ans::compress_to_buffer(lsRes, 0, rgb.w, rgb.h, rgb.c, blob, opt);
+        b.run(make_case(std::string("ans_encode ") + k.name, p, rgb, 2 * n, [&] {
+            std::vector<uint8_t> out;
+            out.reserve(blob.size());
+            keep(ans::compress_to_buffer(lsRes, 0, rgb.w, rgb.h, rgb.c, out, opt));
+        }));
+        b.run(make_case(std::string("ans_decode ") + k.name, p, rgb, 2 * n, [&] {
+            keep(ans::decompress_from_buffer(blob));
+        }));
+    }
+
+    // file round trips: raw residuals and the coded container
+    const std::string r16 = (tmp / "bench.r16").string(), r16ans = (tmp / "bench.r16ans").string();
+    b.run(make_case("save_residuals", p, rgb, 2 * n, [&] { save_residuals(r16, 0, rgb.w, rgb.h, rgb.c, lsRes); }));
+    b.run(make_case("load_residuals", p, rgb, 2 * n, [&] { keep(load_residuals(r16)); }));
+    b.run(make_case("map_residuals", p, rgb, 2 * n, [&] { keep(map_residuals(r16)); }));
+    b.run(make_case("compress_to_file", p, rgb, 2 * n, [&] { keep(ans::compress_to_file(lsRes, 0, rgb.w, rgb.h, rgb.c, r16ans)); }));
+    b.run(make_case("decompress_file", p, rgb, 2 * n, [&] { keep(ans::decompress_file(r16ans)); }));
+    std::filesystem::remove(r16);
+    std::filesystem::remove(r16ans);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+try {
+    const Settings s = parse_args(argc, argv);
+    Bench b(s, std::cout);
+
+    const auto tmp = std::filesystem::temp_directory_path();
+    bench_med_predict(b);
+    for (int size : s.sizes)
+        for (Pattern p : {Pattern::Gradient, Pattern::Noise, Pattern::Flat, Pattern::Text})
+            bench_image(b, p, size, tmp);
+    return 0;
+} catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << "\n";
+    return 1;
+}
+}
@@ -0,0 +1,73 @@
+#include "checksum.h"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC_HAVE_SSE42 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr uint32_t POLY = 0x82F63B78u; // reflected Castagnoli polynomial
+
+struct Tables {
+    uint32_t t[8][256];
+    constexpr Tables() : t{} {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (POLY & (0u - (c & 1u)));
+            t[0][i] = c;
+        }
+        for (int j = 1; j < 8; ++j)
+            for (uint32_t i = 0; i < 256; ++i)
+                t[j][i] = (t[j-1][i] >> 8) ^ t[0][t[j-1][i] & 0xFF];
+    }
+};
+constexpr Tables T{};
+
+uint32_t crc_scalar(const uint8_t* p, size_t n, uint32_t c) {
+    for (; n >= 8; p += 8, n -= 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        lo ^= c;
+        c = T.t[7][lo & 0xFF] ^ T.t[6][(lo >> 8) & 0xFF] ^ T.t[5][(lo >> 16) & 0xFF] ^ T.t[4][lo >> 24] ^
+            T.t[3][hi & 0xFF] ^ T.t[2][(hi >> 8) & 0xFF] ^ T.t[1][(hi >> 16) & 0xFF] ^ T.t[0][hi >> 24];
+    }
+    while (n--) c = (c >> 8) ^ T.t[0][(c ^ *p++) & 0xFF];
+    return c;
+}
+
+#ifdef CRC_HAVE_SSE42
+__attribute__((target("sse4.2")))
+uint32_t crc_sse42(const uint8_t* p, size_t n, uint32_t c) {
+#if defined(__x86_64__)
+    uint64_t c64 = c;
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        c64 = _mm_crc32_u64(c64, v);
+    }
+    c = (uint32_t)c64;
+#endif
+    for (; n >= 4; p += 4, n -= 4) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        c = _mm_crc32_u32(c, v);
+    }
+    while (n--) c = _mm_crc32_u8(c, *p++);
+    return c;
+}
+#endif
+
+} // namespace
+
+uint32_t crc32c(const void* data, size_t n, uint32_t crc) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint32_t c = ~crc;
+#ifdef CRC_HAVE_SSE42
+    static const bool sse42 = __builtin_cpu_supports("sse4.2");
+    if (sse42) return ~crc_sse42(p, n, c);
+#endif
+    return ~crc_scalar(p, n, c);
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32C (Castagnoli) of n bytes, continuing from crc (0 to start).
+// SSE4.2 crc32 instruction when the CPU has it, slicing-by-8 tables otherwise.
+uint32_t crc32c(const void* data, size_t n, uint32_t crc = 0);
@@ -0,0 +1,321 @@
+#include "codec.h"
+#include "predictor.h"
+#include "checksum.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace codec {
+
+namespace {
+
+// Per-layout predictor entry points, so one template drives all four image types
+std::vector<int16_t> med(const Image& s, int)         { return compute_residuals_MED_u8(s); }
+std::vector<int16_t> med(const Image16& s, int)       { return compute_residuals_MED_s16(s); }
+std::vector<int16_t> med(const PlanarImage& s, int t)   { return compute_residuals_MED_planar(s, t); }
+std::vector<int16_t> med(const PlanarImage16& s, int t) { return compute_residuals_MED_planar(s, t); }
+
+Image         med_rec(const std::vector<int16_t>& r, const Image& s, int)         { return reconstruct_from_residuals_MED(r, s); }
+Image16       med_rec(const std::vector<int16_t>& r, const Image16& s, int)       { return reconstruct_from_residuals_MED_s16(r, s); }
+PlanarImage   med_rec(const std::vector<int16_t>& r, const PlanarImage& s, int t)   { return reconstruct_from_residuals_MED_planar(r, s, t); }
+PlanarImage16 med_rec(const std::vector<int16_t>& r, const PlanarImage16& s, int t) { return reconstruct_from_residuals_MED_planar(r, s, t); }
+
+std::vector<int16_t> ls(const Image& s, const Options& o, int t) {
+    return compute_residuals_LS_u8(s, o.N, o.winW, o.winH, t, o.inter, o.lsReuse);
+}
+std::vector<int16_t> ls(const Image16& s, const Options& o, int t) {
+    return compute_residuals_LS_s16(s, o.N, o.winW, o.winH, t, o.inter, o.lsReuse);
+}
+template <class T>
+std::vector<int16_t> ls(const Planar<T>& s, const Options& o, int t) {
+    return compute_residuals_LS_planar(s, o.N, o.winW, o.winH, t, o.inter, o.lsReuse);
+}
+
+Image ls_rec(const std::vector<int16_t>& r, const Image& s, const Options& o, int t) {
+    return reconstruct_from_residuals_LS_u8(r, s, o.N, o.winW, o.winH, t, o.inter, o.lsReuse);
+}
+Image16 ls_rec(const std::vector<int16_t>& r, const Image16& s, const Options& o, int t) {
+    return reconstruct_from_residuals_LS_s16(r, s, o.N, o.winW, o.winH, t, o.inter, o.lsReuse);
+}
+template <class T>
+Planar<T> ls_rec(const std::vector<int16_t>& r, const Planar<T>& s, const Options& o, int t) {
+    return reconstruct_from_residuals_LS_planar(r, s, o.N, o.winW, o.winH, t, o.inter, o.lsReuse);
+}
+
+std::vector<int16_t> bls(const Image& s, const Options& o, std::vector<int16_t>& side) {
+    return compute_residuals_BLS_u8(s, side, o.N, o.winW, o.winH, o.inter);
+}
+std::vector<int16_t> bls(const Image16& s, const Options& o, std::vector<int16_t>& side) {
+    return compute_residuals_BLS_s16(s, side, o.N, o.winW, o.winH, o.inter);
+}
+template <class T>
+std::vector<int16_t> bls(const Planar<T>& s, const Options& o, std::vector<int16_t>& side) {
+    return compute_residuals_BLS_planar(s, side, o.N, o.winW, o.winH, o.inter);
+}
+
+Image bls_rec(const std::vector<int16_t>& r, const std::vector<int16_t>& side, const Image& s, const Options& o) {
+    return reconstruct_from_residuals_BLS_u8(r, side, s, o.N, o.winW, o.winH, o.inter);
+}
+Image16 bls_rec(const std::vector<int16_t>& r, const std::vector<int16_t>& side, const Image16& s, const Options& o) {
+    return reconstruct_from_residuals_BLS_s16(r, side, s, o.N, o.winW, o.winH, o.inter);
+}
+template <class T>
+Planar<T> bls_rec(const std::vector<int16_t>& r, const std::vector<int16_t>& side, const Planar<T>& s, const Options& o) {
+    return reconstruct_from_residuals_BLS_planar(r, side, s, o.N, o.winW, o.winH, o.inter);
+}
+
+// Block weights of the stripe this thread predicted last: predict_stripes_to hands a stripe
+// to its consumer on the worker that predicted it, right after
+thread_local std::vector<int16_t> t_side;
+
+// Stripes run in parallel, the predictor inside a stripe then stays serial
+int inner_threads(const Options& o, int h) {
+    return stripe_count(h, o.stripeRows) > 1 ? 1 : o.threads;
+}
+
+// Fused: each stripe goes to emit (with its side data) as soon as it is predicted
+template <class Img>
+void predict_image_to(const Img& src, const Options& o, const ans::StripeSink& emit) {
+    const int t = inner_threads(o, src.h);
+    predict_stripes_to(src, o.stripeRows, o.threads, [&](const Img& s) {
+        if (o.predictor == Predictor::BLOCK_LS) return bls(s, o, t_side);
+        return o.predictor == Predictor::LS ? ls(s, o, t) : med(s, t);
+    }, [&](int s, std::vector<int16_t>&& r) { emit(s, std::move(r), std::exchange(t_side, {})); });
+}
+
+template <class Img>
+std::vector<int16_t> predict_image(const Img& src, const Options& o, ans::SideData* side) {
+    if (o.predictor == Predictor::BLOCK_LS) {
+        // stripes are assembled here, so each keeps its side data
+        const int S = stripe_count(src.h, o.stripeRows);
+        const size_t stripe = (size_t)(S > 1 ? o.stripeRows : src.h) * src.w * src.c;
+        std::vector<int16_t> res((size_t)src.w * src.h * src.c);
+        ans::SideData sd(S);
+        predict_image_to(src, o, ans::StripeSink{[&](int s, std::vector<int16_t>&& r, std::vector<int16_t>&& sideS) {
+            std::copy(r.begin(), r.end(), res.begin() + (ptrdiff_t)(s * stripe));
+            sd[s] = std::move(sideS);
+        }});
+        if (side) *side = std::move(sd);
+        return res;
+    }
+    if (side) side->clear();
+    const int t = inner_threads(o, src.h);
+    return predict_stripes(src, o.stripeRows, o.threads, [&](const Img& s) {
+        return o.predictor == Predictor::LS ? ls(s, o, t) : med(s, t);
+    });
+}
+
+template <class Img>
+Img reconstruct_image(const std::vector<int16_t>& residuals, const Img& shape, const Options& o,
+                      const ans::SideData& side) {
+    if (o.predictor == Predictor::BLOCK_LS) {
+        if (side.size() != (size_t)stripe_count(shape.h, o.stripeRows))
+            throw std::runtime_error("codec: block LS needs the weights of every stripe");
+        return reconstruct_stripes(residuals, shape, o.stripeRows, o.threads,
+            IndexedStripeRec<Img>([&](int s, const std::vector<int16_t>& r, const Img& sh) {
+                return bls_rec(r, side[s], sh, o);
+            }));
+    }
+    const int t = inner_threads(o, shape.h);
+    return reconstruct_stripes(residuals, shape, o.stripeRows, o.threads,
+        [&](const std::vector<int16_t>& r, const Img& s) {
+            return o.predictor == Predictor::LS ? ls_rec(r, s, o, t) : med_rec(r, s, t);
+        });
+}
+
+// Colour transforms and layout changes count as the COLOR stage
+template <class Fn>
+auto timed_color(Fn&& fn) {
+    metrics::Scope t(metrics::COLOR);
+    return fn();
+}
+
+template <class Img>
+Img timed_reconstruct(const std::vector<int16_t>& residuals, const Img& shape, const Options& o,
+                      const ans::SideData& side) {
+    metrics::Scope t(metrics::RECONSTRUCT);
+    return reconstruct_image(residuals, shape, o, side);
+}
+
+template <class Img>
+Img shape_of(int w, int h, int c) {
+    Img s; s.w = w; s.h = h; s.c = c;
+    return s;
+}
+
+} // namespace
+
+Options options_of(const ans::Header& H) {
+    if (H.info.predictor == ans::PRED_NONE)
+        throw std::runtime_error("container has no predictor info (written before v5)");
+    Options o;
+    o.predictor  = static_cast<Predictor>(H.info.predictor);
+    o.color      = H.mode == 1 ? Color::YUV : Color::RGB;
+    o.N          = H.info.ls_n;
+    o.inter      = H.info.ls_inter;
+    o.winW       = H.info.ls_win_w;
+    o.winH       = H.info.ls_win_h;
+    o.lsReuse    = H.info.ls_reuse;
+    o.stripeRows = H.n_stripes > 1 ? H.stripe_rows : 0;
+    o.ansFlags   = H.flags & ~(ans::FLAG_CHECKSUM | ans::FLAG_SIDE | ans::FLAG_LS_REUSE);
+    o.checksum   = H.info.has_checksum;
+    return o;
+}
+
+ImageFormat format_of(const ans::Header& H) {
+    return H.info.format <= static_cast<uint8_t>(ImageFormat::PGM) ? static_cast<ImageFormat>(H.info.format)
+                                                                   : ImageFormat::Unknown;
+}
+
+bool checksum_matches(const ans::Header& H, const Image& im) {
+    return !H.info.has_checksum || crc32c(im.px.data(), im.px.size()) == H.info.checksum;
+}
+
+// -------- Encoder --------
+Encoder::Encoder(const Options& opt) : opt_(opt) {
+    if (opt_.predictor != Predictor::MED && opt_.predictor != Predictor::LS && opt_.predictor != Predictor::BLOCK_LS)
+        throw std::invalid_argument("codec: unknown predictor");
+    if (opt_.color != Color::RGB && opt_.color != Color::YUV)
+        throw std::invalid_argument("codec: unknown colour space");
+    if (opt_.predictor != Predictor::MED &&
+        (opt_.N < 1 || opt_.N > 8 || opt_.inter < 0 || opt_.inter > 4 ||
+         opt_.winW < 1 || opt_.winW > 0xFFFF || opt_.winH < 1 || opt_.winH > 0xFFFF))
+        throw std::invalid_argument("codec: LS settings out of range (N 1..8, inter 0..4, window 1..65535)");
+    if (opt_.lsReuse < 0 || opt_.lsReuse > 255 || (opt_.lsReuse && opt_.predictor != Predictor::LS))
+        throw std::invalid_argument("codec: lsReuse must be 0..255 and needs the LS predictor");
+    opt_.threads = std::max(1, opt_.threads);
+}
+
+ans::Options Encoder::ans_options(ImageFormat format) const {
+    ans::Options a;
+    a.stripeRows = opt_.stripeRows;
+    a.threads    = opt_.threads;
+    a.flags      = opt_.ansFlags;
+    a.precBits   = opt_.ansPrec;
+    a.info.predictor = static_cast<uint8_t>(opt_.predictor);
+    a.info.format    = static_cast<uint8_t>(format);
+    a.info.has_checksum = opt_.checksum;
+    if (opt_.predictor == Predictor::BLOCK_LS) a.flags |= ans::FLAG_SIDE;
+    if (opt_.predictor != Predictor::MED) {
+        a.info.ls_n     = static_cast<uint8_t>(opt_.N);
+        a.info.ls_inter = static_cast<uint8_t>(opt_.inter);
+        a.info.ls_win_w = static_cast<uint16_t>(opt_.winW);
+        a.info.ls_win_h = static_cast<uint16_t>(opt_.winH);
+        a.info.ls_reuse = static_cast<uint8_t>(opt_.lsReuse);
+    }
+    return a;
+}
+
+std::vector<int16_t> Encoder::predict(const Image& im, ans::SideData* side) const {
+    if (opt_.color == Color::YUV)
+        return opt_.planar ? predict_image(timed_color([&] { return rgb_to_yuv(to_planar(im)); }), opt_, side)
+                           : predict_image(timed_color([&] { return rgb_to_yuv(im); }), opt_, side);
+    return opt_.planar ? predict_image(timed_color([&] { return to_planar(im); }), opt_, side)
+                       : predict_image(im, opt_, side);
+}
+
+// Header fields for this image, checksum included
+ans::Options Encoder::image_options(const Image& im) const {
+    ans::Options a = ans_options(im.format);
+    if (opt_.checksum) {
+        if (im.px.size() != static_cast<size_t>(im.w) * im.h * im.c)
+            throw std::invalid_argument("codec: checksum needs the source pixels");
+        a.info.checksum = crc32c(im.px.data(), im.px.size());
+    }
+    return a;
+}
+
+void Encoder::predict_to(const Image& im, const ans::StripeSink& consume) const {
+    if (opt_.color == Color::YUV)
+        return opt_.planar ? predict_image_to(timed_color([&] { return rgb_to_yuv(to_planar(im)); }), opt_, consume)
+                           : predict_image_to(timed_color([&] { return rgb_to_yuv(im); }), opt_, consume);
+    return opt_.planar ? predict_image_to(timed_color([&] { return to_planar(im); }), opt_, consume)
+                       : predict_image_to(im, opt_, consume);
+}
+
+ans::Encoded Encoder::encode_to_sink(const Image& im, const ans::ByteSink& sink) const {
+    return ans::compress_stripes_to_sink(ans_mode(), im.w, im.h, im.c,
+        [&](const ans::StripeSink& emit) { predict_to(im, emit); }, sink, image_options(im));
+}
+
+ans::Encoded Encoder::compress(const std::vector<int16_t>& residuals, const Image& shape,
+                               const ans::ByteSink& sink, const ans::SideData& side) const {
+    return ans::compress_to_sink(residuals, ans_mode(), shape.w, shape.h, shape.c, sink,
+                                 image_options(shape), side);
+}
+
+ans::Encoded Encoder::compress_to_file(const std::vector<int16_t>& residuals, const Image& shape,
+                                       const std::string& path, const ans::SideData& side) const {
+    return ans::compress_to_file(residuals, ans_mode(), shape.w, shape.h, shape.c, path,
+                                 image_options(shape), side);
+}
+
+ans::Encoded Encoder::encode(const Image& im, std::vector<uint8_t>& out) const {
+    return encode_to_sink(im, [&out](const uint8_t* data, size_t n) { out.insert(out.end(), data, data + n); });
+}
+
+std::vector<uint8_t> Encoder::encode(const Image& im) const {
+    std::vector<uint8_t> out;
+    encode(im, out);
+    return out;
+}
+
+ans::Encoded Encoder::encode_to_file(const Image& im, const std::string& path) const {
+    std::ofstream f(path, std::ios::binary);
+    if (!f) throw std::runtime_error("open write: " + path);
+    ans::Encoded info = encode_to_sink(im, [&f](const uint8_t* data, size_t n) {
+        f.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(n));
+    });
+    f.close();
+    if (!f) throw std::runtime_error("write failed: " + path);
+    return info;
+}
+
+// -------- Decoder --------
+Decoder::Decoder(int threads) : threads_(std::max(1, threads)) {}
+
+Image Decoder::reconstruct(const std::vector<int16_t>& residuals, int w, int h, int c,
+                           const Options& opt, const ans::SideData& side) const {
+    Options o = opt;
+    o.threads = threads_;
+    if (o.color == Color::YUV) {
+        if (o.planar) {
+            auto yuv = timed_reconstruct(residuals, shape_of<PlanarImage16>(w, h, c), o, side);
+            return timed_color([&] { return to_interleaved(yuv_to_rgb(yuv)); });
+        }
+        auto yuv = timed_reconstruct(residuals, shape_of<Image16>(w, h, c), o, side);
+        return timed_color([&] { return yuv_to_rgb(yuv); });
+    }
+    if (o.planar) {
+        auto rgb = timed_reconstruct(residuals, shape_of<PlanarImage>(w, h, c), o, side);
+        return timed_color([&] { return to_interleaved(rgb); });
+    }
+    return timed_reconstruct(residuals, shape_of<Image>(w, h, c), o, side);
+}
+
+Image Decoder::decode(std::span<const uint8_t> blob) const {
+    const ans::Header H = ans::read_header(blob);
+    const ans::SideData side = (H.flags & ans::FLAG_SIDE) ? ans::decompress_side(blob) : ans::SideData{};
+    Image im = reconstruct(ans::decompress_from_buffer(blob, threads_), H.w, H.h, H.c, options_of(H), side);
+    if (!checksum_matches(H, im)) throw std::runtime_error("decode: checksum mismatch");
+    im.format = format_of(H);
+    return im;
+}
+
+Image Decoder::decode_file(const std::string& path) const {
+    ans::FileReader reader(path);
+    const ans::Header& H = reader.header();
+    ans::SideData side;
+    if (H.flags & ans::FLAG_SIDE)
+        for (int s = 0; s < H.n_stripes; ++s) side.push_back(reader.side(s));
+    Image im = reconstruct(reader.decode(threads_), H.w, H.h, H.c, options_of(H), side);
+    if (!checksum_matches(H, im)) throw std::runtime_error("decode: checksum mismatch: " + path);
+    im.format = format_of(H);
+    return im;
+}
+
+} // namespace codec
@@ -0,0 +1,89 @@
+#pragma once
+#include "imageIO.h"
+#include "ansResidual.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// End-to-end image codec: colour transform -> predictor -> rANS container, and back.
+// The container header records the predictor settings, so decoding needs only the bytes.
+namespace codec {
+
+    // BLOCK_LS: forward-adaptive LS, weights per block sent in the file (fast decode)
+    enum class Predictor : uint8_t { MED = ans::PRED_MED, LS = ans::PRED_LS, BLOCK_LS = ans::PRED_BLOCK_LS };
+    enum class Color : uint8_t { RGB, YUV };   // YUV: reversible transform, int16 residuals
+
+    struct Options {
+        Predictor predictor = Predictor::MED;
+        Color color = Color::RGB;
+        int N = 4, winW = 4, winH = 4, inter = 0; // LS model, see predictor.h (BLOCK_LS: win = block)
+        int lsReuse = 0;                          // LS solve skipping K, 0..255 (predictor.h, LS only)
+        int stripeRows = 0;                       // <= 0 -> one stripe
+        int threads = 1;
+        bool planar = false;                      // predict on channel planes, same output
+        bool checksum = false;                    // store crc32c of the source, checked on decode
+        uint32_t ansFlags = ans::FLAG_RANS_X8;
+        int ansPrec = ans::RANS_PREC;
+    };
+
+    // Options a file was written with (predictor, colour, LS model, stripes, coder).
+    // Throws std::runtime_error for files without predictor info (container < v5).
+    Options options_of(const ans::Header& H);
+    // Format of the source image (Unknown for older files and raw residual streams)
+    ImageFormat format_of(const ans::Header& H);
+    // True when im hashes to the checksum stored in H, or H stores none
+    bool checksum_matches(const ans::Header& H, const Image& im);
+
+    class Encoder {
+    public:
+        explicit Encoder(const Options& opt = {}); // throws std::invalid_argument on bad settings
+
+        const Options& options() const { return opt_; }
+        int ans_mode() const { return opt_.color == Color::YUV ? 1 : 0; }
+        ans::Options ans_options(ImageFormat format = ImageFormat::Unknown) const; // incl. header fields
+
+        // Predict and code fused per stripe (ans::compress_stripes_to_sink): no frame-sized
+        // residual array; use predict + compress when the residuals are needed too
+        std::vector<uint8_t> encode(const Image& im) const;
+        ans::Encoded encode(const Image& im, std::vector<uint8_t>& out) const; // appends to out
+        ans::Encoded encode_to_file(const Image& im, const std::string& path) const;
+        ans::Encoded encode_to_sink(const Image& im, const ans::ByteSink& sink) const;
+
+        // The stages on their own. predict returns residuals in the interleaved container
+        // layout and leaves the LS breakdown in g_last_ls_breakdown. BLOCK_LS also needs
+        // the block weights of every stripe (side) to compress and reconstruct.
+        std::vector<int16_t> predict(const Image& im, ans::SideData* side = nullptr) const;
+        // shape: size and source format of the predicted image (pixels are only read
+        // for Options::checksum)
+        ans::Encoded compress(const std::vector<int16_t>& residuals, const Image& shape,
+                              const ans::ByteSink& sink, const ans::SideData& side = {}) const;
+        ans::Encoded compress_to_file(const std::vector<int16_t>& residuals, const Image& shape,
+                                      const std::string& path, const ans::SideData& side = {}) const;
+
+    private:
+        ans::Options image_options(const Image& im) const;
+        void predict_to(const Image& im, const ans::StripeSink& consume) const;
+
+        Options opt_;
+    };
+
+    class Decoder {
+    public:
+        explicit Decoder(int threads = 1);
+
+        // Image as encoded, format set from the header. Throws std::runtime_error when the
+        // file stores a checksum and the restored pixels do not match it.
+        Image decode(std::span<const uint8_t> blob) const;
+        Image decode_file(const std::string& path) const;
+
+        // Inverse of Encoder::predict with the same options (and its side data for BLOCK_LS)
+        Image reconstruct(const std::vector<int16_t>& residuals, int w, int h, int c,
+                          const Options& opt, const ans::SideData& side = {}) const;
+
+    private:
+        int threads_;
+    };
+
+} // namespace codec
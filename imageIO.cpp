@@ -9,6 +9,10 @@
 #include <iostream>
 #include <cctype>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
 #include "stb_image.h"
 #include "stb_image_write.h"
 
@@ -90,6 +94,10 @@ Image load_image(const std::string& path) {
     return im;
 }
 
+bool image_info(const std::string& path, int& w, int& h, int& c) {
+    return stbi_info(path.c_str(), &w, &h, &c) != 0;
+}
+
 //Not needed, created to enforce save method due to file size discrepancy between original and reconstruction
 static void ensure_gray_or_rgb(Image& im) {
     if (im.c == 1 || im.c == 3) return;
@@ -181,7 +189,368 @@ void save_png(const std::string& path, const Image& im_in) {
 
 
 // ----------------- Reversible YUV -----------------
-Image16 rgb_to_yuv(const Image& rgb) {
+// Per-pixel kernels over interleaved buffers; the scalar ones are the reference and
+// handle the tail the SIMD versions leave (those do 16 pixels per step).
+static void yuv_fwd_scalar(const unsigned char* in, int16_t* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        int R = in[3*i+0];
+        int G = in[3*i+1];
+        int B = in[3*i+2];
+
+        uint8_t Y = (uint8_t)((R + 2*G + B) >> 2);
+        int16_t U = (int16_t)(B - G);
+        int16_t V = (int16_t)(R - G);
+
+        out[3*i+0] = (int16_t)Y;
+        out[3*i+1] = U;
+        out[3*i+2] = V;
+    }
+}
+
+static void yuv_inv_scalar(const int16_t* in, unsigned char* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        int Y = (uint8_t)in[3*i+0];
+        int U = (int)in[3*i+1];
+        int V = (int)in[3*i+2];
+
+        int G = Y - floor_div4(U + V);
+        int R = G + V;
+        int B = G + U;
+
+        out[3*i+0] = clamp8i(R);
+        out[3*i+1] = clamp8i(G);
+        out[3*i+2] = clamp8i(B);
+    }
+}
+
+static void rct_fwd_scalar(const unsigned char* in, int16_t* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        int R = in[3*i+0];
+        int G = in[3*i+1];
+        int B = in[3*i+2];
+        out[3*i+0] = (int16_t)G;
+        out[3*i+1] = (int16_t)(R - G); // [-255..255]
+        out[3*i+2] = (int16_t)(B - G);
+    }
+}
+
+static void rct_inv_scalar(const int16_t* in, unsigned char* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        int Y = in[3*i+0];
+        int U = in[3*i+1];
+        int V = in[3*i+2];
+        out[3*i+0] = clamp8i(Y + U);
+        out[3*i+1] = clamp8i(Y);
+        out[3*i+2] = clamp8i(Y + V);
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLOR_HAVE_SSSE3 1
+// SSSE3 kernels: pshufb splits 16 RGB triplets (or 8 int16 triplets) into one vector per
+// channel, the lifting runs in 16-bit lanes and the result is shuffled back.
+// Bit-exact with the scalar kernels for every input:
+//  - floor((U+V)/4) is computed as ((U&V) + ((U^V)>>1)) >> 1, which cannot overflow int16
+//  - G+V, G+U use saturating adds; clamping a saturated sum to 0..255 equals clamping the exact one
+//  - packus does the final clamp to 0..255
+namespace color_simd {
+
+struct Shuffle3 {
+    uint8_t gather[3][3][16];   // [channel][input vector]: channel k of the triplets in that vector
+    uint8_t scatter[3][3][16];  // [channel][output vector]: where channel k lands in that vector
+};
+
+// E = element size in bytes (1 for u8, 2 for int16), 0x80 zeroes the lane
+constexpr Shuffle3 make_shuffle3(int E) {
+    Shuffle3 S{};
+    for (int k = 0; k < 3; ++k)
+        for (int s = 0; s < 3; ++s)
+            for (int q = 0; q < 16; ++q) {
+                const int src = ((q / E)*3 + k)*E + q % E;
+                S.gather[k][s][q] = src / 16 == s ? (uint8_t)(src % 16) : 0x80;
+                const int pos = 16*s + q, e = pos / E;
+                S.scatter[k][s][q] = e % 3 == k ? (uint8_t)((e / 3)*E + pos % E) : 0x80;
+            }
+    return S;
+}
+constexpr Shuffle3 SH8 = make_shuffle3(1), SH16 = make_shuffle3(2);
+
+__attribute__((target("ssse3")))
+inline __m128i mask(const uint8_t* m) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(m)); }
+
+__attribute__((target("ssse3")))
+inline void split3(const Shuffle3& S, const void* p, __m128i out[3]) {
+    const __m128i* v = static_cast<const __m128i*>(p);
+    const __m128i in[3] = {_mm_loadu_si128(v), _mm_loadu_si128(v + 1), _mm_loadu_si128(v + 2)};
+    for (int k = 0; k < 3; ++k)
+        out[k] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in[0], mask(S.gather[k][0])),
+                                           _mm_shuffle_epi8(in[1], mask(S.gather[k][1]))),
+                              _mm_shuffle_epi8(in[2], mask(S.gather[k][2])));
+}
+
+__attribute__((target("ssse3")))
+inline void merge3(const Shuffle3& S, const __m128i in[3], void* p) {
+    __m128i* v = static_cast<__m128i*>(p);
+    for (int s = 0; s < 3; ++s)
+        _mm_storeu_si128(v + s, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in[0], mask(S.scatter[0][s])),
+                                                          _mm_shuffle_epi8(in[1], mask(S.scatter[1][s]))),
+                                             _mm_shuffle_epi8(in[2], mask(S.scatter[2][s]))));
+}
+
+// Forward transforms: u8 RGB -> int16 triplets. Return the pixels done (multiple of 16).
+template <bool Yuv>
+__attribute__((target("ssse3")))
+size_t fwd(const unsigned char* in, int16_t* out, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i rgb[3];
+        split3(SH8, in + 3*i, rgb);
+        for (int h = 0; h < 2; ++h) {
+            const __m128i R = h ? _mm_unpackhi_epi8(rgb[0], zero) : _mm_unpacklo_epi8(rgb[0], zero);
+            const __m128i G = h ? _mm_unpackhi_epi8(rgb[1], zero) : _mm_unpacklo_epi8(rgb[1], zero);
+            const __m128i B = h ? _mm_unpackhi_epi8(rgb[2], zero) : _mm_unpacklo_epi8(rgb[2], zero);
+            __m128i yuv[3];
+            if (Yuv) {
+                yuv[0] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(R, B), _mm_slli_epi16(G, 1)), 2);
+                yuv[1] = _mm_sub_epi16(B, G);
+                yuv[2] = _mm_sub_epi16(R, G);
+            } else {
+                yuv[0] = G;
+                yuv[1] = _mm_sub_epi16(R, G);
+                yuv[2] = _mm_sub_epi16(B, G);
+            }
+            merge3(SH16, yuv, out + 3*i + 24*h);
+        }
+    }
+    return i;
+}
+
+// Inverse transforms: int16 triplets -> clamped u8 RGB
+template <bool Yuv>
+__attribute__((target("ssse3")))
+size_t inv(const int16_t* in, unsigned char* out, size_t n) {
+    const __m128i lowByte = _mm_set1_epi16(0x00FF);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i R[2], G[2], B[2];
+        for (int h = 0; h < 2; ++h) {
+            __m128i yuv[3];
+            split3(SH16, in + 3*i + 24*h, yuv);
+            if (Yuv) {
+                const __m128i Y = _mm_and_si128(yuv[0], lowByte), U = yuv[1], V = yuv[2];
+                const __m128i half = _mm_add_epi16(_mm_and_si128(U, V), _mm_srai_epi16(_mm_xor_si128(U, V), 1));
+                G[h] = _mm_sub_epi16(Y, _mm_srai_epi16(half, 1));
+                R[h] = _mm_adds_epi16(G[h], V);
+                B[h] = _mm_adds_epi16(G[h], U);
+            } else {
+                G[h] = yuv[0];
+                R[h] = _mm_adds_epi16(yuv[0], yuv[1]);
+                B[h] = _mm_adds_epi16(yuv[0], yuv[2]);
+            }
+        }
+        const __m128i rgb[3] = {_mm_packus_epi16(R[0], R[1]), _mm_packus_epi16(G[0], G[1]),
+                                _mm_packus_epi16(B[0], B[1])};
+        merge3(SH8, rgb, out + 3*i);
+    }
+    return i;
+}
+
+// Plain HWC <-> CHW for c == 3, 16 bytes of every plane per step
+template <typename T>
+__attribute__((target("ssse3")))
+size_t split(const T* in, T* const* planes, size_t n) {
+    constexpr size_t step = 16 / sizeof(T);
+    const Shuffle3& S = sizeof(T) == 1 ? SH8 : SH16;
+    size_t i = 0;
+    for (; i + step <= n; i += step) {
+        __m128i v[3];
+        split3(S, in + 3*i, v);
+        for (int k = 0; k < 3; ++k) _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[k] + i), v[k]);
+    }
+    return i;
+}
+
+template <typename T>
+__attribute__((target("ssse3")))
+size_t merge(const T* const* planes, T* out, size_t n) {
+    constexpr size_t step = 16 / sizeof(T);
+    const Shuffle3& S = sizeof(T) == 1 ? SH8 : SH16;
+    size_t i = 0;
+    for (; i + step <= n; i += step) {
+        __m128i v[3];
+        for (int k = 0; k < 3; ++k) v[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[k] + i));
+        merge3(S, v, out + 3*i);
+    }
+    return i;
+}
+
+} // namespace color_simd
+#endif
+
+static bool color_simd_ok(bool allowed) {
+#ifdef COLOR_HAVE_SSSE3
+    static const bool ssse3 = __builtin_cpu_supports("ssse3");
+    return allowed && ssse3;
+#else
+    (void)allowed;
+    return false;
+#endif
+}
+
+// Yuv = true: Y=(R+2G+B)>>2, U=B-G, V=R-G; false: RCT Y=G, U=R-G, V=B-G
+template <bool Yuv>
+static void fwd_pixels(const unsigned char* in, int16_t* out, size_t n, bool simd) {
+    size_t done = 0;
+#ifdef COLOR_HAVE_SSSE3
+    if (color_simd_ok(simd)) done = color_simd::fwd<Yuv>(in, out, n);
+#else
+    (void)simd;
+#endif
+    (Yuv ? yuv_fwd_scalar : rct_fwd_scalar)(in + 3*done, out + 3*done, n - done);
+}
+
+template <bool Yuv>
+static void inv_pixels(const int16_t* in, unsigned char* out, size_t n, bool simd) {
+    size_t done = 0;
+#ifdef COLOR_HAVE_SSSE3
+    if (color_simd_ok(simd)) done = color_simd::inv<Yuv>(in, out, n);
+#else
+    (void)simd;
+#endif
+    (Yuv ? yuv_inv_scalar : rct_inv_scalar)(in + 3*done, out + 3*done, n - done);
+}
+
+// ----------------- Planar layout -----------------
+template <typename T>
+static void split_planes(const T* in, int c, size_t n, T* const* planes) {
+    size_t i = 0;
+#ifdef COLOR_HAVE_SSSE3
+    if (c == 3 && color_simd_ok(true)) i = color_simd::split<T>(in, planes, n);
+#endif
+    for (; i < n; ++i)
+        for (int ch = 0; ch < c; ++ch) planes[ch][i] = in[i*c + ch];
+}
+
+template <typename T>
+static void merge_planes(const T* const* planes, int c, size_t n, T* out) {
+    size_t i = 0;
+#ifdef COLOR_HAVE_SSSE3
+    if (c == 3 && color_simd_ok(true)) i = color_simd::merge<T>(planes, out, n);
+#endif
+    for (; i < n; ++i)
+        for (int ch = 0; ch < c; ++ch) out[i*c + ch] = planes[ch][i];
+}
+
+template <typename T>
+static std::vector<T*> plane_ptrs(T* base, int c, size_t n) {
+    std::vector<T*> p((size_t)c);
+    for (int ch = 0; ch < c; ++ch) p[ch] = base + ch*n;
+    return p;
+}
+
+template <typename P, typename Img>
+static P planar_of(const Img& im) {
+    P p; p.w = im.w; p.h = im.h; p.c = im.c;
+    p.px.resize(im.px.size());
+    split_planes(im.px.data(), im.c, p.plane_size(), plane_ptrs(p.px.data(), p.c, p.plane_size()).data());
+    return p;
+}
+
+template <typename Img, typename P>
+static Img interleaved_of(const P& p) {
+    Img im; im.w = p.w; im.h = p.h; im.c = p.c;
+    im.px.resize(p.px.size());
+    merge_planes(plane_ptrs(p.px.data(), p.c, p.plane_size()).data(), p.c, p.plane_size(), im.px.data());
+    return im;
+}
+
+PlanarImage to_planar(const Image& im) {
+    PlanarImage p = planar_of<PlanarImage>(im);
+    p.format = im.format;
+    return p;
+}
+PlanarImage16 to_planar(const Image16& im) { return planar_of<PlanarImage16>(im); }
+
+Image to_interleaved(const PlanarImage& p) {
+    Image im = interleaved_of<Image>(p);
+    im.format = p.format;
+    return im;
+}
+Image16 to_interleaved(const PlanarImage16& p) { return interleaved_of<Image16>(p); }
+
+std::vector<int16_t> planes_to_interleaved(const std::vector<int16_t>& planes, int w, int h, int c) {
+    const size_t n = (size_t)w*h;
+    if (planes.size() != n*c) throw std::runtime_error("planes_to_interleaved: size mismatch");
+    std::vector<int16_t> out(planes.size());
+    merge_planes(plane_ptrs(planes.data(), c, n).data(), c, n, out.data());
+    return out;
+}
+
+std::vector<int16_t> interleaved_to_planes(const std::vector<int16_t>& hwc, int w, int h, int c) {
+    const size_t n = (size_t)w*h;
+    if (hwc.size() != n*c) throw std::runtime_error("interleaved_to_planes: size mismatch");
+    std::vector<int16_t> out(hwc.size());
+    split_planes(hwc.data(), c, n, plane_ptrs(out.data(), c, n).data());
+    return out;
+}
+
+// Same arithmetic as yuv_fwd_scalar / yuv_inv_scalar; >> on negative ints is floor
+// division (arithmetic shift, guaranteed since C++20), so the loops stay branch-free.
+PlanarImage16 rgb_to_yuv(const PlanarImage& rgb) {
+    if (rgb.c != 1 && rgb.c != 3)
+        throw std::runtime_error("rgb_to_yuv expects Gray(1) or RGB(3)");
+    PlanarImage16 yuv; yuv.w = rgb.w; yuv.h = rgb.h; yuv.c = rgb.c; yuv.format = rgb.format;
+    yuv.px.resize(rgb.px.size());
+    const size_t n = rgb.plane_size();
+
+    if (rgb.c == 1) {
+        std::copy(rgb.px.begin(), rgb.px.end(), yuv.px.begin());
+        return yuv;
+    }
+    const unsigned char* R = rgb.plane(0);
+    const unsigned char* G = rgb.plane(1);
+    const unsigned char* B = rgb.plane(2);
+    int16_t* Y = yuv.plane(0);
+    int16_t* U = yuv.plane(1);
+    int16_t* V = yuv.plane(2);
+    for (size_t i = 0; i < n; ++i) {
+        const int r = R[i], g = G[i], b = B[i];
+        Y[i] = (int16_t)((r + 2*g + b) >> 2);
+        U[i] = (int16_t)(b - g);
+        V[i] = (int16_t)(r - g);
+    }
+    return yuv;
+}
+
+PlanarImage yuv_to_rgb(const PlanarImage16& yuv) {
+    if (yuv.c != 1 && yuv.c != 3)
+        throw std::runtime_error("yuv_to_rgb expects 1 (Gray) or 3 channels");
+    PlanarImage rgb; rgb.w = yuv.w; rgb.h = yuv.h; rgb.c = yuv.c; rgb.format = yuv.format;
+    rgb.px.resize(yuv.px.size());
+    const size_t n = yuv.plane_size();
+
+    if (yuv.c == 1) {
+        for (size_t i = 0; i < n; ++i) rgb.px[i] = (unsigned char)yuv.px[i];
+        return rgb;
+    }
+    const int16_t* Y = yuv.plane(0);
+    const int16_t* U = yuv.plane(1);
+    const int16_t* V = yuv.plane(2);
+    unsigned char* R = rgb.plane(0);
+    unsigned char* G = rgb.plane(1);
+    unsigned char* B = rgb.plane(2);
+    for (size_t i = 0; i < n; ++i) {
+        const int u = U[i], v = V[i];
+        const int g = (int)(uint8_t)Y[i] - ((u + v) >> 2);
+        R[i] = clamp8i(g + v);
+        G[i] = clamp8i(g);
+        B[i] = clamp8i(g + u);
+    }
+    return rgb;
+}
+
+static Image16 rgb_to_yuv_impl(const Image& rgb, bool simd) {
     if (rgb.c != 1 && rgb.c != 3)
         throw std::runtime_error("rgb_to_yuv expects Gray(1) or RGB(3)");
 
@@ -189,7 +558,7 @@ Image16 rgb_to_yuv(const Image& rgb) {
     if (rgb.c == 1) {
         Image16 y_only; y_only.w = rgb.w; y_only.h = rgb.h; y_only.c = 1;
         y_only.px.resize(static_cast<size_t>(rgb.w) * rgb.h);
-        for (int i = 0; i < rgb.w * rgb.h; ++i) {
+        for (size_t i = 0; i < y_only.px.size(); ++i) {
             y_only.px[i] = static_cast<int16_t>(rgb.px[i]); // 0..255 in low 8 bits
         }
         return y_only;
@@ -198,24 +567,11 @@ Image16 rgb_to_yuv(const Image& rgb) {
     // --- RGB path ---
     Image16 yuv; yuv.w = rgb.w; yuv.h = rgb.h; yuv.c = 3;
     yuv.px.resize((size_t)yuv.w * yuv.h * 3);
-
-    for (int i = 0; i < rgb.w * rgb.h; ++i) {
-        int R = rgb.px[3*i+0];
-        int G = rgb.px[3*i+1];
-        int B = rgb.px[3*i+2];
-
-        uint8_t Y = (uint8_t)((R + 2*G + B) >> 2);
-        int16_t U = (int16_t)(B - G);
-        int16_t V = (int16_t)(R - G);
-
-        yuv.px[3*i+0] = (int16_t)Y;
-        yuv.px[3*i+1] = U;
-        yuv.px[3*i+2] = V;
-    }
+    fwd_pixels<true>(rgb.px.data(), yuv.px.data(), (size_t)rgb.w * rgb.h, simd);
     return yuv;
 }
 
-Image yuv_to_rgb(const Image16& yuv) {
+static Image yuv_to_rgb_impl(const Image16& yuv, bool simd) {
     if (yuv.c != 1 && yuv.c != 3)
         throw std::runtime_error("yuv_to_rgb expects 1 (Gray) or 3 channels");
 
@@ -223,7 +579,7 @@ Image yuv_to_rgb(const Image16& yuv) {
     if (yuv.c == 1) {
         Image gray; gray.w = yuv.w; gray.h = yuv.h; gray.c = 1;
         gray.px.resize(static_cast<size_t>(gray.w) * gray.h);
-        for (int i = 0; i < gray.w * gray.h; ++i) {
+        for (size_t i = 0; i < gray.px.size(); ++i) {
             gray.px[i] = clamp8i((int)(uint8_t)yuv.px[i]);
         }
         return gray;
@@ -232,62 +588,37 @@ Image yuv_to_rgb(const Image16& yuv) {
     // --- RGB path  ---
     Image rgb; rgb.w = yuv.w; rgb.h = yuv.h; rgb.c = 3;
     rgb.px.resize((size_t)rgb.w * rgb.h * 3);
-
-    auto floor_div4 = [](int x){ return x >= 0 ? (x >> 2) : -(( -x + 3 ) >> 2); };
-
-    for (int i = 0; i < yuv.w * yuv.h; ++i) {
-        int Y = (uint8_t)yuv.px[3*i+0];
-        int U = (int)yuv.px[3*i+1];
-        int V = (int)yuv.px[3*i+2];
-
-        int G = Y - floor_div4(U + V);
-        int R = G + V;
-        int B = G + U;
-
-        rgb.px[3*i+0] = clamp8i(R);
-        rgb.px[3*i+1] = clamp8i(G);
-        rgb.px[3*i+2] = clamp8i(B);
-    }
+    inv_pixels<true>(yuv.px.data(), rgb.px.data(), (size_t)yuv.w * yuv.h, simd);
     return rgb;
 }
 
 // -------- reversible --------
-Image16 rct_from_rgb(const Image& rgb) {
+static Image16 rct_from_rgb_impl(const Image& rgb, bool simd) {
     if (rgb.c != 3) throw std::runtime_error("rct_from_rgb expects RGB");
     Image16 rct; rct.w=rgb.w; rct.h=rgb.h; rct.c=3;
     rct.px.resize(static_cast<size_t>(rct.w)*rct.h*3);
-    for (int i=0;i<rgb.w*rgb.h;++i) {
-        int R = rgb.px[3*i+0];
-        int G = rgb.px[3*i+1];
-        int B = rgb.px[3*i+2];
-        int16_t Y = (int16_t)G;
-        int16_t U = (int16_t)(R - G); // [-255..255]
-        int16_t V = (int16_t)(B - G);
-        rct.px[3*i+0]=Y;
-        rct.px[3*i+1]=U;
-        rct.px[3*i+2]=V;
-    }
+    fwd_pixels<false>(rgb.px.data(), rct.px.data(), (size_t)rgb.w * rgb.h, simd);
     return rct;
 }
 
-Image rct_to_rgb(const Image16& rct) {
+static Image rct_to_rgb_impl(const Image16& rct, bool simd) {
     if (rct.c != 3) throw std::runtime_error("rct_to_rgb expects 3 channels");
     Image rgb; rgb.w=rct.w; rgb.h=rct.h; rgb.c=3;
     rgb.px.resize(static_cast<size_t>(rgb.w)*rgb.h*3);
-    for (int i=0;i<rct.w*rct.h;++i) {
-        int Y = rct.px[3*i+0];
-        int U = rct.px[3*i+1];
-        int V = rct.px[3*i+2];
-        int R = Y + U;
-        int G = Y;
-        int B = Y + V;
-        rgb.px[3*i+0]=clamp8i(R);
-        rgb.px[3*i+1]=clamp8i(G);
-        rgb.px[3*i+2]=clamp8i(B);
-    }
+    inv_pixels<false>(rct.px.data(), rgb.px.data(), (size_t)rct.w * rct.h, simd);
     return rgb;
 }
 
+Image16 rgb_to_yuv(const Image& rgb)      { return rgb_to_yuv_impl(rgb, true); }
+Image   yuv_to_rgb(const Image16& yuv)    { return yuv_to_rgb_impl(yuv, true); }
+Image16 rct_from_rgb(const Image& rgb)    { return rct_from_rgb_impl(rgb, true); }
+Image   rct_to_rgb(const Image16& rct)    { return rct_to_rgb_impl(rct, true); }
+
+Image16 rgb_to_yuv_scalar(const Image& rgb)   { return rgb_to_yuv_impl(rgb, false); }
+Image   yuv_to_rgb_scalar(const Image16& yuv) { return yuv_to_rgb_impl(yuv, false); }
+Image16 rct_from_rgb_scalar(const Image& rgb) { return rct_from_rgb_impl(rgb, false); }
+Image   rct_to_rgb_scalar(const Image16& rct) { return rct_to_rgb_impl(rct, false); }
+
 bool images_equal(const Image& a, const Image& b) {
     return a.w==b.w && a.h==b.h && a.c==b.c && a.px==b.px;
 }
@@ -19,8 +19,24 @@ struct Image16 {
     std::vector<int16_t> px;
 };
 
+// Planar (CHW): the c channel planes one after another, sample (x,y,ch) at px[(ch*h + y)*w + x].
+// Predictors run each plane on its own, contiguous rows and one thread per plane.
+template <typename T>
+struct Planar {
+    int w = 0, h = 0, c = 0;
+    std::vector<T> px;
+    ImageFormat format = ImageFormat::Unknown;
+
+    size_t plane_size() const { return (size_t)w*h; }
+    T*       plane(int ch)       { return px.data() + ch*plane_size(); }
+    const T* plane(int ch) const { return px.data() + ch*plane_size(); }
+};
+using PlanarImage   = Planar<unsigned char>;
+using PlanarImage16 = Planar<int16_t>;
+
 // -------- I/O  --------
 Image load_image(const std::string& path);          // throws on error
+bool  image_info(const std::string& path, int& w, int& h, int& c); // header only, no decode
 void   save_png  (const std::string& path, const Image& im); // throws on error
 void   save_image(const std::string& path, const Image& im);
 
@@ -31,5 +47,25 @@ Image yuv_to_rgb(const Image16& yuv);
 Image16 rct_from_rgb(const Image& rgb);
 Image   rct_to_rgb  (const Image16& rct);
 
+// The transforms above use SSSE3 kernels when the CPU has them; these are the
+// per-pixel scalar versions they must match bit for bit
+Image16 rgb_to_yuv_scalar  (const Image& rgb);
+Image   yuv_to_rgb_scalar  (const Image16& yuv);
+Image16 rct_from_rgb_scalar(const Image& rgb);
+Image   rct_to_rgb_scalar  (const Image16& rct);
+
+// -------- layout --------
+// Done once after load / before save; c == 3 uses SSSE3 shuffles when available
+PlanarImage   to_planar(const Image& im);
+PlanarImage16 to_planar(const Image16& im);
+Image   to_interleaved(const PlanarImage& p);
+Image16 to_interleaved(const PlanarImage16& p);
+// Residual buffers: planar predictors produce CHW, the .r16ans layout is HWC
+std::vector<int16_t> planes_to_interleaved(const std::vector<int16_t>& planes, int w, int h, int c);
+std::vector<int16_t> interleaved_to_planes(const std::vector<int16_t>& hwc, int w, int h, int c);
+
+// Same transforms on planes (no shuffles, plain vectorizable loops)
+PlanarImage16 rgb_to_yuv(const PlanarImage& rgb);
+PlanarImage   yuv_to_rgb(const PlanarImage16& yuv);
 
 bool images_equal(const Image& a, const Image& b);
@@ -1,7 +1,12 @@
+#include "codec.h"
 #include "imageIO.h"
 #include "predictor.h"
 #include "residualIO.h"
 #include "ansResidual.h"
+#include "threadPool.h"
+#include "streamEncoder.h"
+#include "metrics.h"
+#include "trace.h"
 
 #include <iostream>
 #include <chrono>
@@ -13,6 +18,9 @@
 #include <numeric>
 #include <iomanip>
 #include <fstream>
+#include <mutex>
+#include <sstream>
+#include <cstdio>
 
 namespace fs = std::filesystem;
 
@@ -96,6 +104,15 @@ static void print_ans_report(const char* tag,
               << "  ratio_vs_rawRGB=" << ratio_vs_rgb << "\n";
 }
 
+static const char* format_name(ImageFormat f) {
+    return f == ImageFormat::PNG ? "PNG" :
+           f == ImageFormat::JPG ? "JPG" :
+           f == ImageFormat::BMP ? "BMP" :
+           f == ImageFormat::TGA ? "TGA" :
+           f == ImageFormat::PPM ? "PPM" :
+           f == ImageFormat::PGM ? "PGM" : "UNK";
+}
+
 // Get input files (single or directory)
 // in: Path / Out: Sorted list of input image paths
 static std::vector<fs::path> collect_inputs(const fs::path& inPath, bool recursive) {
@@ -133,6 +150,29 @@ static std::vector<fs::path> collect_inputs(const fs::path& inPath, bool recursi
     return files;
 }
 
+// .r16ans file, or all of them in a directory (sorted)
+static std::vector<fs::path> collect_containers(const fs::path& inPath) {
+    std::vector<fs::path> files;
+    std::error_code ec;
+    if (fs::is_regular_file(inPath, ec)) return {inPath};
+    if (!fs::is_directory(inPath, ec))
+        throw std::runtime_error("Decode path is neither a file nor a directory: " + inPath.string());
+    for (auto& de : fs::directory_iterator(inPath))
+        if (de.is_regular_file() && has_ext_ci(de.path(), {".r16ans"})) files.push_back(de.path());
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// <stem>_decoded in the source format; lossy (JPG) or unknown sources are written as PNG
+static fs::path restored_path(const fs::path& container, const fs::path& outDir, Image& im) {
+    const char* ext = im.format == ImageFormat::BMP ? ".bmp" :
+                      im.format == ImageFormat::TGA ? ".tga" :
+                      im.format == ImageFormat::PPM ? ".ppm" :
+                      im.format == ImageFormat::PGM ? ".pgm" : ".png";
+    if (std::string(ext) == ".png") im.format = ImageFormat::PNG;
+    return with_suffix_ext(container, outDir, "_decoded", ext);
+}
+
 struct Stats {
     std::string file;         // input file name (no path)
     std::string mode;         // rgb | yuv | ls(rgb) | ls(yuv)
@@ -144,10 +184,17 @@ struct Stats {
     double   bpp=0.0;
     double   ratio_vs_resid=0.0;
     double   ratio_vs_rawrgb=0.0;
-    int64_t  t_io_ms=0, t_pred_ms=0, t_rec_ms=0;
+    uint64_t t_io_ns=0, t_pred_ns=0, t_rec_ns=0;
     double   thr_pred_mpps=0.0; // megapixels/s during predict
     double   thr_rec_mpps=0.0;  // megapixels/s during reconstruct
+
+    // per-stage metrics (batch_metrics.jsonl / .csv)
+    metrics::Record stages;   // ns per stage, summed over the threads that ran it
+    uint64_t wall_ns=0;       // whole image, load to last write
+    uint64_t bytes_read=0, bytes_written=0;
+    uint64_t peak_rss=0;      // process high-water mark after the image (per image with IMG_JOBS=1)
     bool     equal=false;
+    bool     verified=true;   // false: encode-only run, equal is unknown
 
     //  LS statistics
     long long ls_count = -1;
@@ -203,12 +250,12 @@ static void write_batch_summary(const std::filesystem::path& outDir,
             << setw(9)  << fixed << setprecision(3) << s.bpp
             << setw(11) << fixed << setprecision(6) << s.ratio_vs_resid
             << setw(11) << fixed << setprecision(6) << s.ratio_vs_rawrgb
-            << setw(9)  << s.t_io_ms
-            << setw(9)  << s.t_pred_ms
-            << setw(9)  << s.t_rec_ms
+            << setw(9)  << fixed << setprecision(2) << s.t_io_ns / 1e6
+            << setw(9)  << fixed << setprecision(2) << s.t_pred_ns / 1e6
+            << setw(9)  << fixed << setprecision(2) << s.t_rec_ns / 1e6
             << setw(10) << fixed << setprecision(2) << s.thr_pred_mpps
             << setw(10) << fixed << setprecision(2) << s.thr_rec_mpps
-            << setw(7)  << (s.equal ? "YES" : "NO");
+            << setw(7)  << (!s.verified ? "n/a" : s.equal ? "YES" : "NO");
 
         if (s.ls_count >= 0 && s.med_count >= 0) {
             ofs << setw(12) << s.ls_count
@@ -225,24 +272,26 @@ static void write_batch_summary(const std::filesystem::path& outDir,
     // ---- statistics ----
     if (!all.empty()) {
         uint64_t sum_pixels = 0, sum_ans = 0, sum_orig = 0;
-        uint64_t pass_equal = 0;
-        long long sum_io=0, sum_pred=0, sum_rec=0;
+        uint64_t pass_equal = 0, n_verified = 0;
+        uint64_t sum_io=0, sum_pred=0, sum_rec=0; // ns
 
         for (const auto& s : all) {
             sum_pixels += s.pixels;
             sum_ans    += s.ans_bytes;
             sum_orig   += s.orig_bytes;
-            sum_io     += s.t_io_ms;
-            sum_pred   += s.t_pred_ms;
-            sum_rec    += s.t_rec_ms;
-            pass_equal += s.equal ? 1 : 0;
+            sum_io     += s.t_io_ns;
+            sum_pred   += s.t_pred_ns;
+            sum_rec    += s.t_rec_ns;
+            pass_equal += s.verified && s.equal ? 1 : 0;
+            n_verified += s.verified ? 1 : 0;
         }
         // weighted bpp (by pixels)
         double bpp_weighted = sum_pixels ? (8.0 * (double)sum_ans) / (double)sum_pixels : 0.0;
         // overall throughput (MPix/s) using sums
         double mpix_total = sum_pixels / 1e6;
-        double thr_pred = (sum_pred>0) ? (1000.0 * mpix_total / (double)sum_pred) : 0.0;
-        double thr_rec  = (sum_rec>0)  ? (1000.0 * mpix_total / (double)sum_rec)  : 0.0;
+        double thr_pred = (sum_pred>0) ? (1e9 * mpix_total / (double)sum_pred) : 0.0;
+        double thr_rec  = (sum_rec>0)  ? (1e9 * mpix_total / (double)sum_rec)  : 0.0;
+        const double n_img = (double)all.size();
 
         ofs << "\n--- Totals ---\n";
         ofs << "images: " << all.size() << "\n";
@@ -250,18 +299,465 @@ static void write_batch_summary(const std::filesystem::path& outDir,
         ofs << "orig bytes total: " << sum_orig << "\n";
         ofs << "ANS bytes total: " << sum_ans << "\n";
         ofs << "weighted bpp: " << fixed << setprecision(3) << bpp_weighted << "\n";
-        ofs << "avg IO ms/img: "   << (sum_io   / (long long)all.size()) << "\n";
-        ofs << "avg Pred ms/img: " << (sum_pred / (long long)all.size()) << "\n";
-        ofs << "avg Rec ms/img: "  << (sum_rec  / (long long)all.size()) << "\n";
+        ofs << "avg IO ms/img: "   << fixed << setprecision(3) << (sum_io   / 1e6 / n_img) << "\n";
+        ofs << "avg Pred ms/img: " << fixed << setprecision(3) << (sum_pred / 1e6 / n_img) << "\n";
+        ofs << "avg Rec ms/img: "  << fixed << setprecision(3) << (sum_rec  / 1e6 / n_img) << "\n";
         ofs << "overall Pred throughput (MPix/s): " << fixed << setprecision(2) << thr_pred << "\n";
         ofs << "overall Rec throughput (MPix/s): "  << fixed << setprecision(2) << thr_rec  << "\n";
-        ofs << "equality pass: " << pass_equal << " / " << all.size() << "\n";
+        ofs << "equality pass: " << pass_equal << " / " << n_verified;
+        if (n_verified != all.size()) ofs << " (" << all.size() - n_verified << " not verified)";
+        ofs << "\n";
     }
 
     ofs.close();
     std::cout << "Wrote summary: " << out.string() << "\n";
 }
 
+static std::string json_str(const std::string& v) {
+    std::string out = "\"";
+    for (unsigned char ch : v) {
+        if (ch == '"' || ch == '\\') { out += '\\'; out += (char)ch; }
+        else if (ch < 0x20) { char buf[8]; std::snprintf(buf, sizeof buf, "\\u%04x", ch); out += buf; }
+        else out += (char)ch;
+    }
+    return out + "\"";
+}
+
+// Per-image metrics plus batch p50/p95/p99 of the wall time and of every stage, next to
+// batch_summary.txt: batch_metrics.jsonl (one object per image, then one "batch" object) or
+// batch_metrics.csv (one row per image, then rows named p50/p95/p99)
+static void write_batch_metrics(const std::filesystem::path& outDir,
+                                const std::vector<Stats>& all, bool csv)
+{
+    using namespace std;
+    namespace fs = std::filesystem;
+
+    fs::path out = outDir / (csv ? "batch_metrics.csv" : "batch_metrics.jsonl");
+    ofstream ofs(out);
+    if (!ofs) throw runtime_error("Failed to open metrics file: " + out.string());
+
+    auto column = [&](int stage) { // stage -1 = wall time
+        vector<uint64_t> v;
+        for (const auto& s : all) v.push_back(stage < 0 ? s.wall_ns : s.stages.ns[stage]);
+        return v;
+    };
+    static const double pcts[] = {50, 95, 99};
+
+    if (csv) {
+        ofs << "file,mode,w,h,c,pixels,equal,wall_ns";
+        for (int k = 0; k < metrics::N_STAGES; ++k) ofs << "," << metrics::stage_name(k) << "_ns";
+        ofs << ",bytes_read,bytes_written,peak_rss\n";
+        for (const auto& s : all) {
+            ofs << s.file << "," << s.mode << "," << s.w << "," << s.h << "," << s.c << "," << s.pixels << ","
+                << (!s.verified ? "" : s.equal ? "1" : "0") << "," << s.wall_ns;
+            for (int k = 0; k < metrics::N_STAGES; ++k) ofs << "," << s.stages.ns[k];
+            ofs << "," << s.bytes_read << "," << s.bytes_written << "," << s.peak_rss << "\n";
+        }
+        for (double p : pcts) {
+            ofs << "p" << p << ",,,,,,," << metrics::percentile(column(-1), p);
+            for (int k = 0; k < metrics::N_STAGES; ++k) ofs << "," << metrics::percentile(column(k), p);
+            ofs << ",,,\n";
+        }
+    } else {
+        for (const auto& s : all) {
+            ofs << "{\"file\":" << json_str(s.file) << ",\"mode\":" << json_str(s.mode)
+                << ",\"w\":" << s.w << ",\"h\":" << s.h << ",\"c\":" << s.c << ",\"pixels\":" << s.pixels
+                << ",\"equal\":" << (!s.verified ? "null" : s.equal ? "true" : "false")
+                << ",\"wall_ns\":" << s.wall_ns << ",\"stages_ns\":{";
+            for (int k = 0; k < metrics::N_STAGES; ++k)
+                ofs << (k ? "," : "") << "\"" << metrics::stage_name(k) << "\":" << s.stages.ns[k];
+            ofs << "},\"bytes_read\":" << s.bytes_read << ",\"bytes_written\":" << s.bytes_written
+                << ",\"peak_rss\":" << s.peak_rss << "}\n";
+        }
+        auto pct_obj = [&](int stage) {
+            ostringstream o;
+            const auto v = column(stage);
+            o << "{\"p50\":" << metrics::percentile(v, 50) << ",\"p95\":" << metrics::percentile(v, 95)
+              << ",\"p99\":" << metrics::percentile(v, 99) << "}";
+            return o.str();
+        };
+        ofs << "{\"batch\":{\"images\":" << all.size() << ",\"wall_ns\":" << pct_obj(-1) << ",\"stages_ns\":{";
+        for (int k = 0; k < metrics::N_STAGES; ++k)
+            ofs << (k ? "," : "") << "\"" << metrics::stage_name(k) << "\":" << pct_obj(k);
+        ofs << "}}}\n";
+    }
+
+    ofs.close();
+    std::cout << "Wrote metrics: " << out.string() << "\n";
+}
+
+// Per-run settings, shared read-only by all workers of a batch
+struct RunConfig {
+    bool compareYuv = false, compareSaveVis = false;
+    std::string compareSuffix;
+    fs::path outDir;
+    std::string mode, lsOn;
+    int N = 4, winW = 4, winH = 4;
+    int lsInter = 0;          // cross-channel LS terms
+    int lsBlock = 32;         // block LS: one weight set per lsBlock x lsBlock block
+    int lsReuse = 0;          // LS solve skipping, 0 = solve every sample
+    int threads = 1;          // per image
+    int stripeRows = 0;
+    ans::Options ansOpt;
+    bool saveVis = false, streamMode = false;
+    bool planar = false;      // predict on channel planes (normal modes)
+    bool encodeOnly = false;  // no reconstruction unless the image is sampled for verification
+    int verifyEvery = 0;      // encode-only: verify images 0, N, 2N, ... (0 = none)
+    bool resetPeakRss = false; // one image at a time: peak RSS is reset per image
+    bool checksum = false;    // store crc32c of the source in the container
+};
+
+// Stats of a batch, filled from several workers, handed out in input (sorted) order
+class StatsCollector {
+public:
+    explicit StatsCollector(size_t n) : slots(n) {}
+
+    void add(size_t index, std::vector<Stats> s) {
+        std::lock_guard<std::mutex> lk(m);
+        slots[index] = std::move(s);
+    }
+    std::vector<Stats> sorted() {
+        std::lock_guard<std::mutex> lk(m);
+        std::vector<Stats> all;
+        for (auto& s : slots) all.insert(all.end(), s.begin(), s.end());
+        return all;
+    }
+
+private:
+    std::mutex m;
+    std::vector<std::vector<Stats>> slots;
+};
+
+// Rough peak bytes of one image for the batch memory budget: source, transform, residuals,
+// symbols, coded stream and reconstruction each hold a frame (~10 B/sample measured for LS/YUV).
+// Streaming holds one stripe. Unreadable headers count as 0, the image then fails on its own.
+static uint64_t estimate_image_bytes(const fs::path& path, const RunConfig& cfg) {
+    int w = 0, h = 0, c = 0;
+    if (!image_info(path.string(), w, h, c)) return 0;
+    const uint64_t perSample = cfg.compareYuv ? 14 : 10;
+    uint64_t rows = (uint64_t)h;
+    if (cfg.streamMode && !cfg.compareYuv)
+        rows = std::min<uint64_t>(rows, cfg.stripeRows > 0 ? cfg.stripeRows : STREAM_STRIPE_ROWS);
+    return (uint64_t)w * rows * (uint64_t)std::max(c, 3) * perSample;
+}
+
+// IMG_MODE / IMG_LS_ON -> codec pipeline, false for unknown values
+static bool codec_options(const RunConfig& cfg, const std::string& mode, codec::Options& o) {
+    if (mode == "rgb" || mode == "yuv") {
+        o.predictor = codec::Predictor::MED;
+        o.color = mode == "yuv" ? codec::Color::YUV : codec::Color::RGB;
+    } else if ((mode == "ls" || mode == "bls") && (cfg.lsOn == "rgb" || cfg.lsOn == "yuv")) {
+        o.predictor = mode == "bls" ? codec::Predictor::BLOCK_LS : codec::Predictor::LS;
+        o.color = cfg.lsOn == "yuv" ? codec::Color::YUV : codec::Color::RGB;
+    } else {
+        return false;
+    }
+    o.N = cfg.N; o.winW = cfg.winW; o.winH = cfg.winH; o.inter = cfg.lsInter;
+    if (o.predictor == codec::Predictor::BLOCK_LS) o.winW = o.winH = cfg.lsBlock;
+    if (o.predictor == codec::Predictor::LS) o.lsReuse = cfg.lsReuse;
+    o.stripeRows = cfg.stripeRows;
+    o.threads    = cfg.threads;
+    o.planar     = cfg.planar;
+    o.ansFlags   = cfg.ansOpt.flags;
+    o.ansPrec    = cfg.ansOpt.precBits;
+    o.checksum   = cfg.checksum;
+    return true;
+}
+
+// Output name suffix of a pipeline: _rgb, _yuv, _ls_rgb, _ls_yuv, _bls_rgb, _bls_yuv
+static std::string pipeline_tag(const codec::Options& o) {
+    return std::string(o.predictor == codec::Predictor::LS ? "_ls" : o.predictor == codec::Predictor::BLOCK_LS ? "_bls" : "") +
+           (o.color == codec::Color::YUV ? "_yuv" : "_rgb");
+}
+
+// Size ratios and throughput of st from the coded size and the stage times
+static void finish_stats(Stats& st, uint64_t ansBytes, uint64_t predNs, uint64_t recNs) {
+    st.ans_bytes = ansBytes;
+    st.bpp = st.pixels ? (8.0 * (double)st.ans_bytes) / (double)st.pixels : 0.0;
+    st.ratio_vs_resid = st.pixels ? ((double)st.ans_bytes / (double)(st.pixels * 2ull)) : 0.0;
+    st.ratio_vs_rawrgb = (double)st.ans_bytes / (double)((uint64_t)st.w * st.h * 3ull);
+
+    st.t_pred_ns = predNs;
+    st.t_rec_ns  = recNs;
+    double mpix = ((double)st.pixels) / 1e6;
+    st.thr_pred_mpps = st.t_pred_ns > 0 ? (1e9 * mpix / (double)st.t_pred_ns) : 0.0;
+    st.thr_rec_mpps  = st.t_rec_ns  > 0 ? (1e9 * mpix / (double)st.t_rec_ns)  : 0.0;
+}
+
+static void take_ls_breakdown(Stats& st) {
+    st.ls_count  = (long long)g_last_ls_breakdown.used_ls;
+    st.med_count = (long long)g_last_ls_breakdown.used_med;
+    auto tot = st.ls_count + st.med_count + (long long)g_last_ls_breakdown.flat;
+    st.ls_pct = tot ? (100.0 * (double)st.ls_count / (double)tot) : 0.0;
+}
+
+// One line per image, from the breakdown merged over all stripes
+static void log_ls_breakdown(std::ostream& log, uint64_t total) {
+    const LsBreakdown& b = g_last_ls_breakdown;
+    log << "Prediction stats: LS=" << b.used_ls
+        << " MED=" << b.used_med;
+    if (b.ls_reused || b.flat) log << " reused=" << b.ls_reused << " flat=" << b.flat;
+    log << " Total=" << total
+        << " (" << (100.0 * (double)b.used_ls / (double)total) << "% LS)\n";
+}
+
+static uint64_t ns_between(std::chrono::high_resolution_clock::time_point a,
+                           std::chrono::high_resolution_clock::time_point b) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count();
+}
+
+// Writes through save, timed as the SAVE stage, and counts the file in bytes_written
+template <class SaveFn>
+static void timed_save(Stats& st, const fs::path& out, SaveFn&& save) {
+    metrics::Scope t(metrics::SAVE);
+    save(out.string());
+    st.bytes_written += file_size_bytes(out.string());
+}
+
+// Stage record and totals of the image that started at t0 (metrics::local() was reset then)
+static void finish_metrics(Stats& st, uint64_t t0) {
+    st.stages  = metrics::local();
+    st.wall_ns = metrics::now_ns() - t0;
+    st.peak_rss = metrics::peak_rss_bytes();
+}
+
+static const char* equal_text(const Stats& st) {
+    return !st.verified ? "n/a (encode only)" : st.equal ? "YES" : "NO";
+}
+
+// One input image: predict, entropy code, reconstruct and compare. Appends its Stats
+// (nothing when the image is skipped); progress lines go to log. In encode-only runs
+// the image is only decoded again when verify is set.
+static void process_image(const fs::path& path, const RunConfig& cfg, bool verify,
+                          std::vector<Stats>& stats, std::ostream& log)
+{
+    using clock = std::chrono::high_resolution_clock;
+    const fs::path& outDir = cfg.outDir;
+    const std::string& mode = cfg.mode;
+    const std::string& lsOn = cfg.lsOn;
+
+    metrics::local() = metrics::Record{};
+    if (cfg.resetPeakRss) metrics::reset_peak_rss();
+    const uint64_t t0 = metrics::now_ns();
+    trace::Scope traced("image", path.filename().string());
+
+    if (cfg.streamMode && !cfg.compareYuv) {
+        // One stripe in memory at a time; stripes run in order, so LS gets all threads
+        codec::Options o;
+        if (!codec_options(cfg, mode, o)) {
+            std::cerr << "Unknown IMG_MODE/IMG_LS_ON: " << mode << "/" << lsOn << "\n";
+            return;
+        }
+        if (o.predictor == codec::Predictor::BLOCK_LS) {
+            std::cerr << "IMG_STREAM does not support IMG_MODE=bls (block weights are not streamed)\n";
+            return;
+        }
+        o.stripeRows = 0;   // the stream cuts the stripes
+        o.planar = false;   // rows arrive interleaved
+        const codec::Encoder enc(o);
+        const codec::Decoder dec(cfg.threads);
+        const bool isLs = o.predictor == codec::Predictor::LS;
+
+        StripePredict predict = [&](const Image& s) { return enc.predict(s); };
+        StripeReconstruct rec = [&](const std::vector<int16_t>& r, const Image& s) {
+            return dec.reconstruct(r, s.w, s.h, s.c, enc.options());
+        };
+        auto tLoad0 = clock::now();
+        RowSource src = [&] { metrics::Scope t(metrics::LOAD); return open_rows(path.string()); }();
+        auto tLoad1 = clock::now();
+        ans::Options ansOpt = enc.ans_options(src.format);
+        ansOpt.stripeRows = cfg.stripeRows;
+
+        Stats st;
+        st.file   = path.filename().string();
+        st.mode   = isLs ? std::string("ls(") + lsOn + ")" : mode;
+        st.w = src.w; st.h = src.h; st.c = src.c;
+        st.pixels = (uint64_t)src.w * src.h * src.c;
+        st.orig_bytes = file_size_bytes(path.string());
+        st.fmt = format_name(src.format);
+        st.t_io_ns = ns_between(tLoad0, tLoad1);   // header (PNM) or whole decode (stb); rows are read later
+        st.bytes_read = st.orig_bytes;
+
+        auto ansPath = with_suffix_ext(path, outDir, pipeline_tag(o), ".r16ans");
+        auto tPred0 = clock::now();
+        encode_stream(src, enc.ans_mode(), predict, ansPath.string(), ansOpt);
+        auto tPred1 = clock::now();
+
+        if (isLs) take_ls_breakdown(st);
+
+        // verification re-reads the source, again one stripe at a time
+        st.verified = verify;
+        if (verify) {
+            RowSource again = [&] { metrics::Scope t(metrics::LOAD); return open_rows(path.string()); }();
+            st.equal = verify_stream(again, ansPath.string(), rec);
+            st.bytes_read += st.orig_bytes + file_size_bytes(ansPath.string());
+        }
+        auto tRec1 = clock::now();
+
+        finish_stats(st, file_size_bytes(ansPath.string()), ns_between(tPred0, tPred1), ns_between(tPred1, tRec1));
+        st.bytes_written = st.ans_bytes;
+        finish_metrics(st, t0);
+        stats.push_back(st);
+
+        if (isLs) log_ls_breakdown(log, st.pixels);
+        log << "[STREAM " << st.mode << "] " << st.file
+                  << "  Equal: " << equal_text(st) << "\n";
+        return;
+    }
+
+    auto tLoad0 = clock::now();
+    Image rgb = [&] { metrics::Scope t(metrics::LOAD); return load_image(path.string()); }();
+    auto tLoad1 = clock::now();
+
+    // start stats
+    Stats st;
+    st.file   = path.filename().string();
+    st.mode   = (mode == "ls" || mode == "bls") ? mode + "(" + lsOn + ")" : mode;
+    st.w = rgb.w; st.h = rgb.h; st.c = rgb.c;
+    st.pixels = (uint64_t)rgb.w * rgb.h * rgb.c;
+    st.orig_bytes = file_size_bytes(path.string());
+    st.fmt = format_name(rgb.format);
+    st.t_io_ns = ns_between(tLoad0, tLoad1);
+    st.bytes_read = st.orig_bytes;
+
+    if (cfg.compareYuv) {
+        if (rgb.c != 3) {
+            log << "[COMPARE] Skipping non-RGB image: "
+                      << path.filename().string() << " (c=" << rgb.c << ")\n";
+            return;
+        }
+
+        // LS on RGB, then LS on YUV, with the same model
+        struct Branch { uint64_t ansB; double bpp; double predMs, recMs; bool equal; };
+        auto run_branch = [&](codec::Color color) {
+            codec::Options o;
+            codec_options(cfg, "ls", o);
+            o.color = color;
+            o.planar = false;
+            const codec::Encoder enc(o);
+            const std::string name = color == codec::Color::YUV ? "_yuv" : "_rgb";
+
+            auto tPred0 = clock::now();
+            auto residuals = enc.predict(rgb);
+            auto tPred1 = clock::now();
+            log_ls_breakdown(log, st.pixels);
+
+            if (cfg.compareSaveVis) {
+                auto vis = residuals_visual_rgb8(residuals, rgb);
+                save_png(with_suffix_png(path, outDir, cfg.compareSuffix + name + "_residuals_vis").string(), vis);
+            }
+
+            auto ansPath = with_suffix_ext(path, outDir, cfg.compareSuffix + name, ".r16ans");
+            enc.compress_to_file(residuals, rgb, ansPath.string());
+
+            Image rec = codec::Decoder(cfg.threads).reconstruct(residuals, rgb.w, rgb.h, rgb.c, o);
+            auto tRec1 = clock::now();
+
+            rec.format = rgb.format; // ensure save_image picks the right writer
+            save_image(with_suffix_and_same_ext(path, outDir, cfg.compareSuffix + name + "_reconstructed").string(), rec);
+
+            Branch b;
+            b.ansB   = file_size_bytes(ansPath.string());
+            b.bpp    = st.pixels ? (8.0 * (double)b.ansB) / (double)st.pixels : 0.0;
+            b.predMs = ns_between(tPred0, tPred1) / 1e6;
+            b.recMs  = ns_between(tPred1, tRec1) / 1e6;
+            b.equal  = images_equal(rgb, rec);
+            return b;
+        };
+        const Branch r = run_branch(codec::Color::RGB);
+        const Branch y = run_branch(codec::Color::YUV);
+
+        log << std::fixed << std::setprecision(6);
+
+        log << "[COMPARE][RGB]  "  << path.filename().string()
+                  << "  ansB=" << r.ansB
+                  << "  bpp="  << r.bpp
+                  << "  Equal=" << (r.equal ? "YES" : "NO")
+                  << "  Pred=" << r.predMs << "ms"
+                  << "  Rec="  << r.recMs  << "ms\n";
+
+        log << "[COMPARE][yuv] "  << path.filename().string()
+                  << "  ansB=" << y.ansB
+                  << "  bpp="  << y.bpp
+                  << "  Equal=" << (y.equal ? "YES" : "NO")
+                  << "  Pred=" << y.predMs << "ms"
+                  << "  Rec="  << y.recMs  << "ms\n";
+
+        const double delta_bpp = y.bpp - r.bpp; // negative = YUV better
+        const double pred_ratio = (double)r.predMs / std::max(1.0, (double)y.predMs);
+        const double rec_ratio  = (double)r.recMs  / std::max(1.0, (double)y.recMs);
+
+        log << "[COMPARE][DELTA] " << path.filename().string()
+                  << "  Delta_bpp(yuv-RGB)=" << delta_bpp
+                  << "  Pred_RGB/yuv=" << pred_ratio
+                  << "  Rec_RGB/yuv="  << rec_ratio  << "\n";
+
+        return; // do not go to normal single processing
+    }
+
+    codec::Options o;
+    if (!codec_options(cfg, mode, o)) {
+        if (mode == "ls") std::cerr << "Unknown IMG_LS_ON value: " << lsOn << " (use rgb|yuv)\n";
+        else std::cerr << "Unknown IMG_MODE value: " << mode << " (use rgb|yuv|ls|bls)\n";
+        return;
+    }
+    const codec::Encoder enc(o);
+    const bool isLs = o.predictor != codec::Predictor::MED;
+    const std::string tag = pipeline_tag(o);
+
+    auto ansPath = with_suffix_ext(path, outDir, tag, ".r16ans");
+    // Pred time covers the entropy coder too when the two are fused
+    const bool fused = cfg.encodeOnly && !cfg.saveVis;
+    std::vector<int16_t> residuals;
+    ans::SideData side;     // block LS weights
+    auto tPred0 = clock::now();
+    if (fused) enc.encode_to_file(rgb, ansPath.string());
+    else residuals = enc.predict(rgb, &side);
+    auto tPred1 = clock::now();
+
+    if (isLs) take_ls_breakdown(st);
+
+    if (cfg.saveVis) {
+        auto vis = residuals_visual_rgb8(residuals, rgb);
+        timed_save(st, with_suffix_png(path, outDir, "_residuals_vis" + tag), [&](const std::string& f) { save_png(f, vis); });
+    }
+
+    if (!fused) enc.compress_to_file(residuals, rgb, ansPath.string(), side);
+
+    if (cfg.encodeOnly) {
+        // sampled check of the file itself: full decode (checksum included) against the source
+        st.verified = verify;
+        if (verify) {
+            try {
+                trace::Scope t("verify");
+                st.bytes_read += file_size_bytes(ansPath.string());
+                st.equal = images_equal(rgb, codec::Decoder(cfg.threads).decode_file(ansPath.string()));
+            } catch (const std::runtime_error& e) {
+                log << "Verify failed: " << e.what() << "\n";
+                st.equal = false;
+            }
+        }
+    } else {
+        Image rec = codec::Decoder(cfg.threads).reconstruct(residuals, rgb.w, rgb.h, rgb.c, o, side);
+        rec.format = rgb.format;
+        timed_save(st, with_suffix_and_same_ext(path, outDir, "_reconstructed"), [&](const std::string& f) { save_image(f, rec); });
+        st.equal = images_equal(rgb, rec);
+    }
+    auto tRec1 = clock::now();
+
+    finish_stats(st, file_size_bytes(ansPath.string()), ns_between(tPred0, tPred1), ns_between(tPred1, tRec1));
+    st.bytes_written += st.ans_bytes;
+    finish_metrics(st, t0);
+    stats.push_back(st);
+
+    if (isLs) log_ls_breakdown(log, st.pixels);
+    static const char* const names[3][2] = {{"[MODE=RGB] ", "[MODE=yuv] "},
+                                            {"[MODE=LS on RGB] ", "[MODE=LS on yuv] "},
+                                            {"[MODE=BLS on RGB] ", "[MODE=BLS on yuv] "}};
+    log << names[static_cast<int>(o.predictor) - 1][o.color == codec::Color::YUV] << st.file
+              << "  Equal: " << equal_text(st) << "\n";
+}
+
 int main(int argc, char** argv) {
 try {
     using namespace std::chrono;
@@ -300,37 +796,86 @@ try {
 
     // LS parameters
     int N           = env_int("IMG_LS_N", 4);
+    int lsInter     = env_int("IMG_LS_INTER", 0);                      // 0..4 cross-channel terms
     int winW        = env_int("IMG_LS_WIN_W", 4);
+    int lsBlock     = env_int("IMG_LS_BLOCK", 32);                     // IMG_MODE=bls block size
     int winH        = env_int("IMG_LS_WIN_H", 4);
+    int lsReuse     = env_int("IMG_LS_REUSE", 0);                      // 0..255, 0 = solve every sample
+    int threads     = resolve_thread_count(env_int("IMG_THREADS", 0)); // 0 = all cores
+    int stripeRows  = env_int("IMG_STRIPE_ROWS", 0);                   // 0 = whole image, one stripe
+
+    ans::Options ansOpt;
+    ansOpt.stripeRows = stripeRows;
+    ansOpt.threads    = threads;
+    std::string ansCoder = lower(env_str("IMG_ANS_CODER", "x8"));       // x8 | scalar | ctx
+    if (ansCoder == "scalar") ansOpt.flags = 0;
+    else if (ansCoder == "ctx") ansOpt.flags = ans::FLAG_CONTEXT;
+    ansOpt.precBits = env_int("IMG_ANS_PREC", ans::RANS_PREC);          // log2(L): 12..16
 
     bool saveVis    = env_bool("IMG_SAVE_RES_VIS", false);
     std::string saveResPath = env_str("IMG_SAVE_RES", "");
     std::string loadResPath = env_str("IMG_LOAD_RES", "");
+    std::string decodePath  = env_str("IMG_DECODE", "");                // .r16ans file or directory -> images
+    bool streamMode = env_bool("IMG_STREAM", false);                  // stripe-at-a-time encode, bounded memory
+    int jobsEnv     = env_int("IMG_JOBS", 1);                          // images in flight, 0 = one per thread
+    uint64_t memBudgetMB = (uint64_t)std::max(0, env_int("IMG_MEM_BUDGET_MB", 0)); // 0 = no limit
+    bool planar     = env_bool("IMG_PLANAR", false);                   // channel planes (CHW) in normal runs
+    bool encodeOnly = env_bool("IMG_ENCODE_ONLY", false);              // skip reconstruction, .r16ans only
+    int verifyEvery = std::max(0, env_int("IMG_VERIFY_EVERY", 0));     // encode-only: decode every Nth image
+    bool checksum   = env_bool("IMG_CHECKSUM", false);                 // crc32c of the pixels in the header
+    std::string metricsOut = lower(env_str("IMG_METRICS", "jsonl"));    // jsonl | csv | off
+
+    // Chrome trace of the whole run, written when main returns
+    trace::Session traceSession(env_str("IMG_TRACE", ""));
+    trace::name_thread("main");
+
+    // --------  decode: .r16ans -> image, everything from the container header --------
+    if (!decodePath.empty()) {
+        ensure_dir(outDir);
+        const codec::Decoder dec(threads);
+        int failed = 0;
+        for (const fs::path& f : collect_containers(decodePath)) {
+            try {
+                trace::Scope traced("decode", f.filename().string());
+                auto t0 = high_resolution_clock::now();
+                Image im = dec.decode_file(f.string());
+                auto t1 = high_resolution_clock::now();
+                fs::path out = restored_path(f, outDir, im);
+                save_image(out.string(), im);
+                std::cout << "[DECODE] " << f.filename().string() << "  " << im.w << "x" << im.h << "x" << im.c
+                          << " -> " << out.string()
+                          << " | Decode: " << duration_cast<milliseconds>(t1 - t0).count() << " ms\n";
+            } catch (const std::exception& e) {
+                std::cerr << "Error on file \"" << f.string() << "\": " << e.what() << "\n";
+                ++failed;
+            }
+        }
+        return failed ? 1 : 0;
+    }
 
     // --------  single file residual load --------
+    // Raw .r16 files only store the colour mode, the predictor comes from IMG_MODE / IMG_LS_*
     if (!loadResPath.empty()) {
+        if (mode == "bls") {
+            std::cerr << "IMG_LOAD_RES: .r16 files carry no block LS weights, decode the .r16ans (IMG_DECODE)\n";
+            return 2;
+        }
         ensure_dir(outDir);
         auto rf = load_residuals(loadResPath);
-        if (rf.mode == 0) {
-            Image shape; shape.w = rf.w; shape.h = rf.h; shape.c = rf.c;
-            auto t0 = high_resolution_clock::now();
-            Image rec = reconstruct_from_residuals_MED(rf.residuals, shape);
-            auto t1 = high_resolution_clock::now();
-            fs::path out = outDir / "out_reconstructed_from_file.png";
-            save_png(out.string(), rec);
-            std::cout << "[FROM FILE] mode=RGB  " << rf.w << "x" << rf.h << "x" << rf.c
-                      << " | Reconstruct: " << duration_cast<milliseconds>(t1 - t0).count() << " ms\n";
-        } else {
-            Image16 shape; shape.w = rf.w; shape.h = rf.h; shape.c = rf.c;
-            auto t0 = high_resolution_clock::now();
-            Image16 yuv_rec = reconstruct_from_residuals_MED_s16(rf.residuals, shape);
-            Image rec = yuv_to_rgb(yuv_rec);
-            auto t1 = high_resolution_clock::now();
-            fs::path out = outDir / "out_reconstructed_from_file.png";
-            save_png(out.string(), rec);
-            std::cout << "[FROM FILE] mode=yuv  " << rf.w << "x" << rf.h << "x" << rf.c
-                      << " | Reconstruct: " << duration_cast<milliseconds>(t1 - t0).count() << " ms\n";
-        }
+        codec::Options o;
+        o.predictor  = mode == "ls" ? codec::Predictor::LS : codec::Predictor::MED;
+        o.color      = rf.mode == 1 ? codec::Color::YUV : codec::Color::RGB;
+        o.N = N; o.winW = winW; o.winH = winH; o.inter = lsInter;
+        if (mode == "ls") o.lsReuse = lsReuse;
+        o.stripeRows = stripeRows;
+        auto t0 = high_resolution_clock::now();
+        Image rec = codec::Decoder(threads).reconstruct(rf.residuals, rf.w, rf.h, rf.c, o);
+        auto t1 = high_resolution_clock::now();
+        fs::path out = outDir / "out_reconstructed_from_file.png";
+        save_png(out.string(), rec);
+        std::cout << "[FROM FILE] mode=" << (rf.mode == 1 ? "yuv" : "RGB") << (mode == "ls" ? " LS" : " MED")
+                  << "  " << rf.w << "x" << rf.h << "x" << rf.c
+                  << " | Reconstruct: " << duration_cast<milliseconds>(t1 - t0).count() << " ms\n";
         return 0;
     }
 
@@ -341,303 +886,59 @@ try {
     }
     ensure_dir(outDir);
 
-    std::vector<Stats> allStats;
-
-    for (const auto& path : inputs) {
-    try {
-        auto tLoad0 = std::chrono::high_resolution_clock::now();
-        Image rgb = load_image(path.string());
-        auto tLoad1 = std::chrono::high_resolution_clock::now();
-
-        // start stats
-        Stats st;
-        st.file   = path.filename().string();
-        st.mode   = (mode == "ls") ? std::string("ls(") + lsOn + ")" : mode;
-        st.w = rgb.w; st.h = rgb.h; st.c = rgb.c;
-        st.pixels = (uint64_t)rgb.w * rgb.h * rgb.c;
-        st.orig_bytes = file_size_bytes(path.string());
-        st.fmt = rgb.format == ImageFormat::PNG ? "PNG" :
-                 rgb.format == ImageFormat::JPG ? "JPG" :
-                 rgb.format == ImageFormat::BMP ? "BMP" :
-                 rgb.format == ImageFormat::TGA ? "TGA" :
-                 rgb.format == ImageFormat::PPM ? "PPM" :
-                 rgb.format == ImageFormat::PGM ? "PGM" : "UNK";
-        st.t_io_ms = std::chrono::duration_cast<std::chrono::milliseconds>(tLoad1 - tLoad0).count();
-
-        if (IMG_COMPARE_YUV) {
-            if (rgb.c != 3) {
-                std::cout << "[COMPARE] Skipping non-RGB image: "
-                          << path.filename().string() << " (c=" << rgb.c << ")\n";
-                continue;
-            }
-
-            const uint64_t pixels = (uint64_t)rgb.w * rgb.h * rgb.c;
-
-            // ===== RGB → LS =====
-            auto tPred0 = std::chrono::high_resolution_clock::now();
-            auto resid_rgb = compute_residuals_LS_u8(rgb, N, winW, winH);
-            auto tPred1 = std::chrono::high_resolution_clock::now();
-
-            if (IMG_COMPARE_SAVE_VIS) {
-                auto vis = residuals_visual_rgb8(resid_rgb, rgb);
-                save_png(with_suffix_png(path, outDir, IMG_COMPARE_SUFFIX + "_rgb_residuals_vis").string(), vis);
-            }
-
-            auto ans_rgb = with_suffix_ext(path, outDir, IMG_COMPARE_SUFFIX + "_rgb", ".r16ans");
-            ans::compress_to_file(resid_rgb, /*mode=*/0, rgb.w, rgb.h, rgb.c, ans_rgb.string());
-
-            auto rec_rgb = reconstruct_from_residuals_LS_u8(resid_rgb, rgb, N, winW, winH);
-            auto tRec1 = std::chrono::high_resolution_clock::now();
-
-            rec_rgb.format = rgb.format; // ensure save_image picks the right writer
-            save_image(with_suffix_and_same_ext(path, outDir, IMG_COMPARE_SUFFIX + "_rgb_reconstructed").string(), rec_rgb);
-
-            const uint64_t ansB_rgb = file_size_bytes(ans_rgb.string());
-            const double   bpp_rgb  = pixels ? (8.0 * (double)ansB_rgb) / (double)pixels : 0.0;
-            const long long pred_ms_rgb = std::chrono::duration_cast<std::chrono::milliseconds>(tPred1 - tPred0).count();
-            const long long rec_ms_rgb  = std::chrono::duration_cast<std::chrono::milliseconds>(tRec1  - tPred1).count();
-            const bool equal_rgb = images_equal(rgb, rec_rgb);
-
-            // ===== yuv → LS =====
-            Image16 yuv = rgb_to_yuv(rgb);
-
-            auto tPred0y = std::chrono::high_resolution_clock::now();
-            auto resid_yuv = compute_residuals_LS_s16(yuv, N, winW, winH);
-            auto tPred1y = std::chrono::high_resolution_clock::now();
-
-            if (IMG_COMPARE_SAVE_VIS) {
-                auto vis = residuals_visual_s16(resid_yuv, yuv);
-                save_png(with_suffix_png(path, outDir, IMG_COMPARE_SUFFIX + "_yuv_residuals_vis").string(), vis);
+    RunConfig cfg;
+    cfg.compareYuv     = IMG_COMPARE_YUV;
+    cfg.compareSaveVis = IMG_COMPARE_SAVE_VIS;
+    cfg.compareSuffix  = IMG_COMPARE_SUFFIX;
+    cfg.outDir         = outDir;
+    cfg.mode           = mode;
+    cfg.lsOn           = lsOn;
+    cfg.N = N; cfg.winW = winW; cfg.winH = winH;
+    cfg.lsBlock        = lsBlock;
+    cfg.lsReuse        = lsReuse;
+    cfg.lsInter        = lsInter;
+    cfg.stripeRows     = stripeRows;
+    cfg.saveVis        = saveVis;
+    cfg.streamMode     = streamMode;
+    cfg.planar         = planar;
+    cfg.encodeOnly     = encodeOnly;
+    cfg.verifyEvery    = verifyEvery;
+    cfg.checksum       = checksum;
+
+    // Images run concurrently on `jobs` workers and split the threads between them
+    const int jobs = std::max(1, std::min<int>(jobsEnv > 0 ? jobsEnv : threads, (int)inputs.size()));
+    cfg.threads        = std::max(1, threads / jobs);
+    cfg.resetPeakRss   = jobs == 1;
+    cfg.ansOpt         = ansOpt;
+    cfg.ansOpt.threads = cfg.threads;
+
+    StatsCollector collected(inputs.size());
+    std::mutex logMutex;
+
+    run_batch((int)inputs.size(), jobs, memBudgetMB * (1ull << 20),
+        [&](int i) { return estimate_image_bytes(inputs[i], cfg); },
+        [&](int i) {
+            const fs::path& path = inputs[i];
+            std::ostringstream buf;
+            std::ostream& log = jobs > 1 ? static_cast<std::ostream&>(buf) : std::cout;
+            std::vector<Stats> stats;
+            try {
+                const bool verify = !cfg.encodeOnly || (cfg.verifyEvery > 0 && i % cfg.verifyEvery == 0);
+                process_image(path, cfg, verify, stats, log);
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lk(logMutex);
+                std::cerr << "Error on file \"" << path.string() << "\": " << e.what() << "\n";
             }
-
-            auto ans_yuv = with_suffix_ext(path, outDir, IMG_COMPARE_SUFFIX + "_yuv", ".r16ans");
-            ans::compress_to_file(resid_yuv, /*mode=*/1, yuv.w, yuv.h, yuv.c, ans_yuv.string());
-
-            auto yuv_rec16 = reconstruct_from_residuals_LS_s16(resid_yuv, yuv, N, winW, winH);
-            Image rec_yuv = yuv_to_rgb(yuv_rec16);
-            auto tRec1y = std::chrono::high_resolution_clock::now();
-
-            rec_yuv.format = rgb.format;
-            save_image(with_suffix_and_same_ext(path, outDir, IMG_COMPARE_SUFFIX + "_yuv_reconstructed").string(), rec_yuv);
-
-            const uint64_t ansB_yuv = file_size_bytes(ans_yuv.string());
-            const double   bpp_yuv  = pixels ? (8.0 * (double)ansB_yuv) / (double)pixels : 0.0;
-            const long long pred_ms_yuv = std::chrono::duration_cast<std::chrono::milliseconds>(tPred1y - tPred0y).count();
-            const long long rec_ms_yuv  = std::chrono::duration_cast<std::chrono::milliseconds>(tRec1y  - tPred1y).count();
-            const bool equal_yuv = images_equal(rgb, rec_yuv);
-
-            std::cout << std::fixed << std::setprecision(6);
-
-            std::cout << "[COMPARE][RGB]  "  << path.filename().string()
-                      << "  ansB=" << ansB_rgb
-                      << "  bpp="  << bpp_rgb
-                      << "  Equal=" << (equal_rgb ? "YES" : "NO")
-                      << "  Pred=" << pred_ms_rgb << "ms"
-                      << "  Rec="  << rec_ms_rgb  << "ms\n";
-
-            std::cout << "[COMPARE][yuv] "  << path.filename().string()
-                      << "  ansB=" << ansB_yuv
-                      << "  bpp="  << bpp_yuv
-                      << "  Equal=" << (equal_yuv ? "YES" : "NO")
-                      << "  Pred=" << pred_ms_yuv << "ms"
-                      << "  Rec="  << rec_ms_yuv  << "ms\n";
-
-            const double delta_bpp = bpp_yuv - bpp_rgb; // negative = YUV better
-            const double pred_ratio = (double)pred_ms_rgb / std::max(1.0, (double)pred_ms_yuv);
-            const double rec_ratio  = (double)rec_ms_rgb  / std::max(1.0, (double)rec_ms_yuv);
-
-            std::cout << "[COMPARE][DELTA] " << path.filename().string()
-                      << "  Delta_bpp(yuv-RGB)=" << delta_bpp
-                      << "  Pred_RGB/yuv=" << pred_ratio
-                      << "  Rec_RGB/yuv="  << rec_ratio  << "\n";
-
-            continue; // do not go to normal single processing
-        }
-
-        if (mode == "rgb") {
-            auto tPred0 = std::chrono::high_resolution_clock::now();
-            auto residuals  = compute_residuals_MED_u8(rgb);
-            auto tPred1 = std::chrono::high_resolution_clock::now();
-
-            if (saveVis) {
-                auto vis = residuals_visual_rgb8(residuals, rgb);
-                save_png(with_suffix_png(path, outDir, "_residuals_vis_rgb").string(), vis);
-            }
-
-            auto ansPath = with_suffix_ext(path, outDir, "_rgb", ".r16ans");
-            ans::compress_to_file(residuals, /*mode=*/0, rgb.w, rgb.h, rgb.c, ansPath.string());
-
-            auto rec = reconstruct_from_residuals_MED(residuals, rgb);
-            auto tRec1 = std::chrono::high_resolution_clock::now();
-            save_image(with_suffix_and_same_ext(path, outDir, "_reconstructed").string(), rec);
-
-            st.ans_bytes = file_size_bytes(ansPath.string());
-            st.bpp = st.pixels ? (8.0 * (double)st.ans_bytes) / (double)st.pixels : 0.0;
-            st.ratio_vs_resid = st.pixels ? ((double)st.ans_bytes / (double)(st.pixels * 2ull)) : 0.0;
-            st.ratio_vs_rawrgb = (double)st.ans_bytes /
-                                 (double)((uint64_t)rgb.w * rgb.h * 3ull);
-
-            st.t_pred_ms = std::chrono::duration_cast<std::chrono::milliseconds>(tPred1 - tPred0).count();
-            st.t_rec_ms  = std::chrono::duration_cast<std::chrono::milliseconds>(tRec1  - tPred1).count();
-
-            double mpix = ((double)st.pixels) / 1e6;
-            st.thr_pred_mpps = st.t_pred_ms > 0 ? (1000.0 * mpix / (double)st.t_pred_ms) : 0.0;
-            st.thr_rec_mpps  = st.t_rec_ms  > 0 ? (1000.0 * mpix / (double)st.t_rec_ms)  : 0.0;
-
-            st.equal = images_equal(rgb, rec);
-            allStats.push_back(st);
-
-            std::cout << "[MODE=RGB] " << st.file << "  Equal: " << (st.equal ? "YES" : "NO") << "\n";
-
-        } else if (mode == "yuv") {
-            Image16 yuv = rgb_to_yuv(rgb);
-
-            auto tPred0 = std::chrono::high_resolution_clock::now();
-            auto residuals16 = compute_residuals_MED_s16(yuv);
-            auto tPred1 = std::chrono::high_resolution_clock::now();
-
-            if (saveVis) {
-                auto vis = residuals_visual_s16(residuals16, yuv);
-                save_png(with_suffix_png(path, outDir, "_residuals_vis_yuv").string(), vis);
+            collected.add((size_t)i, std::move(stats));
+            if (jobs > 1) {
+                std::lock_guard<std::mutex> lk(logMutex);
+                std::cout << buf.str() << std::flush;
             }
+        });
 
-            auto ansPath = with_suffix_ext(path, outDir, "_yuv", ".r16ans");
-            ans::compress_to_file(residuals16, /*mode=*/1, yuv.w, yuv.h, yuv.c, ansPath.string());
-
-            auto yuv_rec = reconstruct_from_residuals_MED_s16(residuals16, yuv);
-            Image rec = yuv_to_rgb(yuv_rec);
-            auto tRec1 = std::chrono::high_resolution_clock::now();
-            save_image(with_suffix_and_same_ext(path, outDir, "_reconstructed").string(), rec);
-
-            st.ans_bytes = file_size_bytes(ansPath.string());
-            st.bpp = st.pixels ? (8.0 * (double)st.ans_bytes) / (double)st.pixels : 0.0;
-            st.ratio_vs_resid = st.pixels ? ((double)st.ans_bytes / (double)(st.pixels * 2ull)) : 0.0;
-            st.ratio_vs_rawrgb = (double)st.ans_bytes /
-                                 (double)((uint64_t)rgb.w * rgb.h * 3ull);
-
-            st.t_pred_ms = std::chrono::duration_cast<std::chrono::milliseconds>(tPred1 - tPred0).count();
-            st.t_rec_ms  = std::chrono::duration_cast<std::chrono::milliseconds>(tRec1  - tPred1).count();
-
-            double mpix = ((double)st.pixels) / 1e6;
-            st.thr_pred_mpps = st.t_pred_ms > 0 ? (1000.0 * mpix / (double)st.t_pred_ms) : 0.0;
-            st.thr_rec_mpps  = st.t_rec_ms  > 0 ? (1000.0 * mpix / (double)st.t_rec_ms)  : 0.0;
-
-            st.equal = images_equal(rgb, rec);
-            allStats.push_back(st);
-
-            std::cout << "[MODE=yuv] " << st.file << "  Equal: " << (st.equal ? "YES" : "NO") << "\n";
-
-        } else if (mode == "ls") {
-            if (lsOn == "rgb") {
-                auto tPred0 = std::chrono::high_resolution_clock::now();
-                auto residuals = compute_residuals_LS_u8(rgb, N, winW, winH);
-                auto tPred1 = std::chrono::high_resolution_clock::now();
-
-                st.ls_count  = (long long)g_last_ls_breakdown.used_ls;
-                st.med_count = (long long)g_last_ls_breakdown.used_med;
-                if (st.ls_count >= 0 && st.med_count >= 0) {
-                    auto tot = st.ls_count + st.med_count;
-                    st.ls_pct = tot ? (100.0 * (double)st.ls_count / (double)tot) : 0.0;
-                }
-
-                if (saveVis) {
-                    auto vis = residuals_visual_rgb8(residuals, rgb);
-                    save_png(with_suffix_png(path, outDir, "_residuals_vis_ls_rgb").string(), vis);
-                }
-
-                auto ansPath = with_suffix_ext(path, outDir, "_ls_rgb", ".r16ans");
-                ans::compress_to_file(residuals, /*mode=*/0, rgb.w, rgb.h, rgb.c, ansPath.string());
-
-                auto rec = reconstruct_from_residuals_LS_u8(residuals, rgb, N, winW, winH);
-                auto tRec1 = std::chrono::high_resolution_clock::now();
-                save_image(with_suffix_and_same_ext(path, outDir, "_reconstructed").string(), rec);
-
-                st.ans_bytes = file_size_bytes(ansPath.string());
-                st.bpp = st.pixels ? (8.0 * (double)st.ans_bytes) / (double)st.pixels : 0.0;
-                st.ratio_vs_resid = st.pixels ? ((double)st.ans_bytes / (double)(st.pixels * 2ull)) : 0.0;
-                st.ratio_vs_rawrgb = (double)st.ans_bytes /
-                                     (double)((uint64_t)rgb.w * rgb.h * 3ull);
-
-                st.t_pred_ms = std::chrono::duration_cast<std::chrono::milliseconds>(tPred1 - tPred0).count();
-                st.t_rec_ms  = std::chrono::duration_cast<std::chrono::milliseconds>(tRec1  - tPred1).count();
-
-                double mpix = ((double)st.pixels) / 1e6;
-                st.thr_pred_mpps = st.t_pred_ms > 0 ? (1000.0 * mpix / (double)st.t_pred_ms) : 0.0;
-                st.thr_rec_mpps  = st.t_rec_ms  > 0 ? (1000.0 * mpix / (double)st.t_rec_ms)  : 0.0;
-
-                st.equal = images_equal(rgb, rec);
-                allStats.push_back(st);
-
-                std::cout << "Prediction stats: LS=" << g_last_ls_breakdown.used_ls
-                          << " MED=" << g_last_ls_breakdown.used_med
-                          << " Total=" << (size_t)rgb.w*rgb.h*rgb.c
-                          << " (" << (100.0 * (double)g_last_ls_breakdown.used_ls /
-                                      (double)((size_t)rgb.w*rgb.h*rgb.c)) << "% LS)\n";
-                std::cout << "[MODE=LS on RGB] " << st.file
-                          << "  Equal: " << (st.equal ? "YES" : "NO") << "\n";
-
-            } else if (lsOn == "yuv") {
-                Image16 yuv = rgb_to_yuv(rgb);
-
-                auto tPred0 = std::chrono::high_resolution_clock::now();
-                auto residuals16 = compute_residuals_LS_s16(yuv, N, winW, winH);
-                auto tPred1 = std::chrono::high_resolution_clock::now();
-
-                st.ls_count  = (long long)g_last_ls_breakdown.used_ls;
-                st.med_count = (long long)g_last_ls_breakdown.used_med;
-                if (st.ls_count >= 0 && st.med_count >= 0) {
-                    auto tot = st.ls_count + st.med_count;
-                    st.ls_pct = tot ? (100.0 * (double)st.ls_count / (double)tot) : 0.0;
-                }
-
-                if (saveVis) {
-                    auto vis = residuals_visual_s16(residuals16, yuv);
-                    save_png(with_suffix_png(path, outDir, "_residuals_vis_ls_yuv").string(), vis);
-                }
-
-                auto ansPath = with_suffix_ext(path, outDir, "_ls_yuv", ".r16ans");
-                ans::compress_to_file(residuals16, /*mode=*/1, yuv.w, yuv.h, yuv.c, ansPath.string());
-
-                auto yuv_rec = reconstruct_from_residuals_LS_s16(residuals16, yuv, N, winW, winH);
-                Image rec = yuv_to_rgb(yuv_rec);
-                auto tRec1 = std::chrono::high_resolution_clock::now();
-                save_image(with_suffix_and_same_ext(path, outDir, "_reconstructed").string(), rec);
-
-                st.ans_bytes = file_size_bytes(ansPath.string());
-                st.bpp = st.pixels ? (8.0 * (double)st.ans_bytes) / (double)st.pixels : 0.0;
-                st.ratio_vs_resid = st.pixels ? ((double)st.ans_bytes / (double)(st.pixels * 2ull)) : 0.0;
-                st.ratio_vs_rawrgb = (double)st.ans_bytes /
-                                     (double)((uint64_t)rgb.w * rgb.h * 3ull);
-
-                st.t_pred_ms = std::chrono::duration_cast<std::chrono::milliseconds>(tPred1 - tPred0).count();
-                st.t_rec_ms  = std::chrono::duration_cast<std::chrono::milliseconds>(tRec1  - tPred1).count();
-
-                double mpix = ((double)st.pixels) / 1e6;
-                st.thr_pred_mpps = st.t_pred_ms > 0 ? (1000.0 * mpix / (double)st.t_pred_ms) : 0.0;
-                st.thr_rec_mpps  = st.t_rec_ms  > 0 ? (1000.0 * mpix / (double)st.t_rec_ms)  : 0.0;
-
-                st.equal = images_equal(rgb, rec);
-                allStats.push_back(st);
-
-                std::cout << "Prediction stats: LS=" << g_last_ls_breakdown.used_ls
-                          << " MED=" << g_last_ls_breakdown.used_med
-                          << " Total=" << (size_t)rgb.w*rgb.h*rgb.c
-                          << " (" << (100.0 * (double)g_last_ls_breakdown.used_ls /
-                                      (double)((size_t)rgb.w*rgb.h*rgb.c)) << "% LS)\n";
-                std::cout << "[MODE=LS on yuv] " << st.file
-                          << "  Equal: " << (st.equal ? "YES" : "NO") << "\n";
-            } else {
-                std::cerr << "Unknown IMG_LS_ON value: " << lsOn << " (use rgb|yuv)\n";
-            }
-        } else {
-            std::cerr << "Unknown IMG_MODE value: " << mode << " (use rgb|yuv|ls)\n";
-        }
-
-    } catch (const std::exception& e) {
-        std::cerr << "Error on file \"" << path.string() << "\": " << e.what() << "\n";
-    }
-}
-    write_batch_summary(outDir, allStats);
+    const std::vector<Stats> all = collected.sorted();
+    write_batch_summary(outDir, all);
+    if (metricsOut == "jsonl" || metricsOut == "csv") write_batch_metrics(outDir, all, metricsOut == "csv");
     return 0;
 
 } catch (const std::exception& e) {
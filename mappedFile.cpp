@@ -0,0 +1,48 @@
+#include "mappedFile.h"
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPED_FILE_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef MAPPED_FILE_POSIX
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("open read: " + path);
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("stat failed: " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) { // mmap of length 0 fails, an empty view is enough
+        void* p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("mmap failed: " + path);
+        }
+        data_ = static_cast<const uint8_t*>(p);
+        mapped_ = true;
+    }
+    ::close(fd); // the mapping keeps the file referenced
+#else
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) throw std::runtime_error("open read: " + path);
+    owned_.resize(static_cast<size_t>(f.tellg()));
+    f.seekg(0);
+    f.read(reinterpret_cast<char*>(owned_.data()), static_cast<std::streamsize>(owned_.size()));
+    if (!f) throw std::runtime_error("read failed: " + path);
+    data_ = owned_.data();
+    size_ = owned_.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef MAPPED_FILE_POSIX
+    if (mapped_) ::munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+}
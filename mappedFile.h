@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. On POSIX the file is mmap'ed, so readers decode straight
+// from the page cache and processes restoring the same file share its pages; elsewhere it
+// is read into memory once.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    [[nodiscard]] std::span<const uint8_t> bytes() const { return {data_, size_}; }
+    [[nodiscard]] size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<uint8_t> owned_; // fallback copy when mmap is not available
+};
+
+// Little-endian reads over a byte range. Every read is checked against the end of the range,
+// so a corrupted size field throws std::runtime_error instead of reading or allocating past it.
+struct ByteReader {
+    std::span<const uint8_t> b;
+    size_t pos = 0;
+
+    [[nodiscard]] size_t remaining() const { return b.size() - pos; }
+
+    std::span<const uint8_t> take(uint64_t n) {
+        if (n > remaining()) throw std::runtime_error("truncated file: section past end of data");
+        std::span<const uint8_t> s = b.subspan(pos, static_cast<size_t>(n));
+        pos += static_cast<size_t>(n);
+        return s;
+    }
+
+    template <class T>
+    T get() {
+        T v;
+        std::memcpy(&v, take(sizeof(T)).data(), sizeof(T));
+        return v;
+    }
+};
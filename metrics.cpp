@@ -0,0 +1,43 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <string>
+
+namespace metrics {
+
+const char* stage_name(int stage) {
+    static const char* const names[N_STAGES] = {
+        "load", "color", "predict", "symbolize", "model", "encode", "write", "reconstruct", "save"
+    };
+    return stage >= 0 && stage < N_STAGES ? names[stage] : "?";
+}
+
+Record& local() {
+    thread_local Record r;
+    return r;
+}
+
+uint64_t peak_rss_bytes() {
+    std::ifstream f("/proc/self/status");
+    for (std::string line; std::getline(f, line);)
+        if (line.rfind("VmHWM:", 0) == 0) return std::stoull(line.substr(6)) * 1024; // kB
+    return 0;
+}
+
+bool reset_peak_rss() {
+    std::ofstream f("/proc/self/clear_refs");
+    f << "5";
+    return static_cast<bool>(f.flush());
+}
+
+uint64_t percentile(std::vector<uint64_t> values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    const double rank = std::ceil(std::clamp(p, 0.0, 100.0) / 100.0 * (double)values.size());
+    const size_t i = rank < 1 ? 0 : static_cast<size_t>(rank) - 1;
+    return values[std::min(i, values.size() - 1)];
+}
+
+} // namespace metrics
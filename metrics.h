@@ -0,0 +1,68 @@
+#pragma once
+#include "trace.h"
+
+#include <cstdint>
+#include <vector>
+
+// Nanosecond stage timings. Library code adds to the record of the thread it runs on;
+// functions that fan out to workers (predict_stripes*, compress_*) merge the workers'
+// records back into the caller's, so after a call the caller holds everything it caused.
+// Stages that ran on several threads at once are summed, so they can exceed the wall time.
+namespace metrics {
+
+    enum Stage : int {
+        LOAD, COLOR, PREDICT, SYMBOLIZE, MODEL, ENCODE, WRITE, RECONSTRUCT, SAVE,
+        N_STAGES
+    };
+    const char* stage_name(int stage); // "load", "color", ...
+
+    struct Record {
+        uint64_t ns[N_STAGES] = {};
+        void add(const Record& o) { for (int s = 0; s < N_STAGES; ++s) ns[s] += o.ns[s]; }
+    };
+
+    // This thread's record
+    Record& local();
+
+    // Same clock as the trace timeline (steady_clock, ns)
+    using trace::now_ns;
+
+    // Adds the lifetime of the scope to stage (and shows it on the trace timeline)
+    class Scope {
+    public:
+        explicit Scope(Stage s) : s_(s), t0_(now_ns()), trace_(stage_name(s)) {}
+        ~Scope() { local().ns[s_] += now_ns() - t0_; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        Stage s_;
+        uint64_t t0_;
+        trace::Scope trace_;
+    };
+
+    // Runs fn with an empty record and returns what it recorded; the thread's own record is
+    // left as it was (also when the worker is the calling thread)
+    template <class Fn>
+    Record capture(Fn&& fn) {
+        const Record saved = local();
+        local() = Record{};
+        try {
+            fn();
+        } catch (...) {
+            local() = saved;
+            throw;
+        }
+        const Record out = local();
+        local() = saved;
+        return out;
+    }
+
+    // Process peak resident set (VmHWM) in bytes, 0 where unknown. reset_peak_rss() starts
+    // a new high-water mark (Linux clear_refs), false if the kernel does not allow it.
+    uint64_t peak_rss_bytes();
+    bool reset_peak_rss();
+
+    // Nearest-rank percentile, p in [0, 100]; 0 for an empty set
+    uint64_t percentile(std::vector<uint64_t> values, double p);
+
+} // namespace metrics
@@ -1,112 +1,159 @@
 #include "predictor.h"
+#include "threadPool.h"
+#include "metrics.h"
+#include "trace.h"
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
-#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
 
 //Hook for printing stats in main.cpp
-LsBreakdown g_last_ls_breakdown;
+thread_local LsBreakdown g_last_ls_breakdown;
 
 // ---------- MED predictor(fallback predictor) ----------
+// clamp(A+B-C) into [min(A,B), max(A,B)] is the same median edge detector without branches
 int med_predict(int A, int B, int C) {
-    if (C >= std::max(A, B)) return std::min(A, B);
-    if (C <= std::min(A, B)) return std::max(A, B);
-    return A + B - C;
+    return std::min(std::max(A + B - C, std::min(A, B)), std::max(A, B));
 }
 
-// ---------- uint8 path ----------
-static inline int get_px_u8(const Image& im, int x, int y, int ch) {
-    if (x < 0 || y < 0 || x >= im.w || y >= im.h) return 0; // zero border
-    return im.px[(y*im.w + x)*im.c + ch];
+// ---------- MED engine ----------
+// Rows are copied into int16 buffers with c zero samples in front, and row -1 is all zeros,
+// so for interleaved sample j: A = cur[j-c], B = prev[j], C = prev[j-c], no border checks.
+// Forward residuals of a row have no dependency between samples -> AVX2 16 lanes at a time.
+namespace med {
+
+struct RowPair {
+    int c = 0;
+    size_t n = 0;                       // samples per row (w*c)
+    std::vector<int16_t> a, b;
+    int16_t* cur;
+    int16_t* prev;
+
+    RowPair(int w, int ch) : c(ch), n((size_t)w*ch), a(n + ch, 0), b(n + ch, 0),
+                             cur(a.data() + ch), prev(b.data() + ch) {}
+    void advance() { std::swap(cur, prev); } // cur[-c..-1] stays zero
+};
+
+// residual = (int16)(x - pred), pred computed exactly as med_predict
+static void residual_row_scalar(const int16_t* cur, const int16_t* prev, size_t n, int c, int16_t* out) {
+    for (size_t j = 0; j < n; ++j) {
+        int A = cur[j - c], B = prev[j], C = prev[j - c];
+        out[j] = (int16_t)(cur[j] - med_predict(A, B, C));
+    }
 }
 
-// ---------- int16 (RCT) path ----------
-static inline int get_px_s16(const Image16& im, int x, int y, int ch) {
-    if (x < 0 || y < 0 || x >= im.w || y >= im.h) return 0;
-    return im.px[(y*im.w + x)*im.c + ch];
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MED_HAVE_AVX2 1
+// Full int16 range without widening: when C lies strictly between min and max,
+// A+B-C = mn+mx-C does not overflow; otherwise pred is mn or mx, picked by compare.
+__attribute__((target("avx2")))
+static void residual_row_avx2(const int16_t* cur, const int16_t* prev, size_t n, int c, int16_t* out) {
+    size_t j = 0;
+    for (; j + 16 <= n; j += 16) {
+        __m256i A = _mm256_loadu_si256((const __m256i*)(cur + j - c));
+        __m256i B = _mm256_loadu_si256((const __m256i*)(prev + j));
+        __m256i C = _mm256_loadu_si256((const __m256i*)(prev + j - c));
+        __m256i X = _mm256_loadu_si256((const __m256i*)(cur + j));
+
+        __m256i mn = _mm256_min_epi16(A, B);
+        __m256i mx = _mm256_max_epi16(A, B);
+        __m256i mid = _mm256_sub_epi16(_mm256_add_epi16(mn, mx), C);
+        __m256i geMx = _mm256_cmpeq_epi16(_mm256_max_epi16(C, mx), C); // C >= mx
+        __m256i leMn = _mm256_cmpeq_epi16(_mm256_min_epi16(C, mn), C); // C <= mn
+        __m256i pred = _mm256_blendv_epi8(mid, mx, leMn);
+        pred = _mm256_blendv_epi8(pred, mn, geMx);
+        _mm256_storeu_si256((__m256i*)(out + j), _mm256_sub_epi16(X, pred));
+    }
+    residual_row_scalar(cur + j, prev + j, n - j, c, out + j);
+}
+#endif
+
+static void residual_row(const int16_t* cur, const int16_t* prev, size_t n, int c, int16_t* out) {
+#ifdef MED_HAVE_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) { residual_row_avx2(cur, prev, n, c, out); return; }
+#endif
+    residual_row_scalar(cur, prev, n, c, out);
 }
 
-std::vector<int16_t> compute_residuals_MED_u8(const Image& src) {
-    std::vector<int16_t> res(static_cast<size_t>(src.w)*src.h*src.c);
-    for (int y=0; y<src.h; ++y)
+// Reconstruction is serial along each channel; the c channels give independent chains.
+template <typename Clamp>
+static void reconstruct_row(int16_t* cur, const int16_t* prev, size_t n, int c,
+                            const int16_t* res, Clamp clamp) {
+    for (size_t j = 0; j < n; ++j)
+        cur[j] = (int16_t)clamp(med_predict(cur[j - c], prev[j], prev[j - c]) + (int)res[j]);
+}
 
-        for (int x=0; x<src.w; ++x)
+// c = 1 on a plane: the rows are contiguous single-channel runs
+template <typename Px>
+static void residuals_into(const Px* px, int w, int h, int c, int16_t* res) {
+    RowPair rows(w, c);
+    for (int y = 0; y < h; ++y) {
+        const Px* src = px + (size_t)y*rows.n;
+        std::copy(src, src + rows.n, rows.cur);
+        residual_row(rows.cur, rows.prev, rows.n, c, res + (size_t)y*rows.n);
+        rows.advance();
+    }
+}
 
-            for (int ch=0; ch<src.c; ++ch) {
+template <typename Px>
+static std::vector<int16_t> residuals(const Px* px, int w, int h, int c) {
+    std::vector<int16_t> res((size_t)w*h*c);
+    residuals_into(px, w, h, c, res.data());
+    return res;
+}
 
-                int A = get_px_u8(src, x-1, y,   ch);
-                int B = get_px_u8(src, x,   y-1, ch);
-                int C = get_px_u8(src, x-1, y-1, ch);
-                int pred = med_predict(A,B,C);
-                int actual = get_px_u8(src, x, y, ch);
-                res[(size_t)(y*src.w + x)*src.c + ch] =
-                    (int16_t)(actual - pred);
+template <typename Px, typename Clamp>
+__attribute__((noinline)) // out of line it compiles to a tighter loop (~1.8x on the interleaved path)
+static void reconstruct_into(const int16_t* res, int w, int h, int c, Px* px, Clamp clamp) {
+    RowPair rows(w, c);
+    for (int y = 0; y < h; ++y) {
+        reconstruct_row(rows.cur, rows.prev, rows.n, c, res + (size_t)y*rows.n, clamp);
+        std::copy(rows.cur, rows.cur + rows.n, px + (size_t)y*rows.n);
+        rows.advance();
+    }
+}
 
-            }
-    return res;
+template <typename Px, typename Clamp>
+static void reconstruct(const std::vector<int16_t>& res, int w, int h, int c, Px* px, Clamp clamp) {
+    if (res.size() != (size_t)w*h*c) throw std::runtime_error("MED reconstruct: residual count mismatch");
+    reconstruct_into(res.data(), w, h, c, px, clamp);
+}
+
+} // namespace med
+
+std::vector<int16_t> compute_residuals_MED_u8(const Image& src) {
+    return med::residuals(src.px.data(), src.w, src.h, src.c);
 }
 
 Image reconstruct_from_residuals_MED(const std::vector<int16_t>& residuals,
                                      const Image& shape) {
     Image rec; rec.w=shape.w; rec.h=shape.h; rec.c=shape.c;
     rec.px.resize(static_cast<size_t>(rec.w)*rec.h*rec.c, 0);
-    for (int y=0; y<rec.h; ++y)
-
-        for (int x=0; x<rec.w; ++x)
-
-            for (int ch=0; ch<rec.c; ++ch) {
-
-                int A = get_px_u8(rec, x-1, y,   ch);
-                int B = get_px_u8(rec, x,   y-1, ch);
-                int C = get_px_u8(rec, x-1, y-1, ch);
-                int pred = med_predict(A,B,C);
-                int16_t r = residuals[(size_t)(y*rec.w + x)*rec.c + ch];
-                int val = pred + (int)r;
-                rec.px[(size_t)(y*rec.w + x)*rec.c + ch] =
-                    (unsigned char)std::clamp(val, 0, 255);
-
-            }
+    med::reconstruct(residuals, rec.w, rec.h, rec.c, rec.px.data(),
+                     [](int v) { return std::clamp(v, 0, 255); });
     return rec;
 }
 
 std::vector<int16_t> compute_residuals_MED_s16(const Image16& src) {
-    std::vector<int16_t> res(static_cast<size_t>(src.w)*src.h*src.c);
-
-    for (int y=0; y<src.h; ++y)
-
-        for (int x=0; x<src.w; ++x)
-
-            for (int ch=0; ch<src.c; ++ch) {
-
-                int A = get_px_s16(src, x-1, y,   ch);
-                int B = get_px_s16(src, x,   y-1, ch);
-                int C = get_px_s16(src, x-1, y-1, ch);
-                int pred = med_predict(A,B,C);
-                int actual = get_px_s16(src, x, y, ch);
-                res[(size_t)(y*src.w + x)*src.c + ch] =
-                    (int16_t)(actual - pred);
-            }
-    return res;
+    return med::residuals(src.px.data(), src.w, src.h, src.c);
 }
 
 Image16 reconstruct_from_residuals_MED_s16(const std::vector<int16_t>& residuals,
                                            const Image16& shape) {
     Image16 rec; rec.w=shape.w; rec.h=shape.h; rec.c=shape.c;
     rec.px.resize(static_cast<size_t>(rec.w)*rec.h*rec.c, 0);
-
-    for (int y=0; y<rec.h; ++y)
-
-        for (int x=0; x<rec.w; ++x)
-
-            for (int ch=0; ch<rec.c; ++ch) {
-
-                int A = get_px_s16(rec, x-1, y,   ch);
-                int B = get_px_s16(rec, x,   y-1, ch);
-                int C = get_px_s16(rec, x-1, y-1, ch);
-                int pred = med_predict(A,B,C);
-                int16_t r = residuals[(size_t)(y*rec.w + x)*rec.c + ch];
-                rec.px[(size_t)(y*rec.w + x)*rec.c + ch] =
-                    (int16_t)(pred + (int)r);
-            }
+    med::reconstruct(residuals, rec.w, rec.h, rec.c, rec.px.data(),
+                     [](int v) { return (int16_t)v; });
     return rec;
 }
 
@@ -118,111 +165,293 @@ static unsigned char clamp8_vis(int v) {
 static unsigned char clamp8_vis(int v); // already present below for u8
 
 
-// ================= LS / Gaussian Jordan predictor ===================
+// ================= LS predictor ===================
 
-// return:  false : failed / true  : success
-static bool gauss_solve(std::vector<double>& A, std::vector<double>& b, int n, double lambda ) {
-    if (n <= 0) return false;
-    if (lambda != 0.0) {
-        for (int d = 0; d < n; ++d) A[d*n + d] += lambda;
-    }
-    const double eps = 1e-12; // singularity guard
-
-    for (int k = 0; k < n; ++k) {
-        // ---- pivot: pick row with largest |A[i,k]| ----
-        int piv = k;
-        double best = std::fabs(A[k*n + k]);
-        for (int i = k + 1; i < n; ++i) {
-            double v = std::fabs(A[i*n + k]);
-            if (v > best) { best = v; piv = i; }
-        }
-        if (best < eps) return false;
+static constexpr int LS_MAX_INTRA = 8;
+static constexpr int LS_MAX_INTER = 4;
 
-        // swap row k and piv
-        if (piv != k) {
-            for (int j = 0; j < n; ++j) std::swap(A[k*n + j], A[piv*n + j]);
-            std::swap(b[k], b[piv]);
-        }
+// Model terms: (dx, dy) from the current sample in channel ch + dch
+struct LsTap { int dx, dy, dch; };
 
-        // ---- normalize pivot row (pivot = 1) ----
-        double Akk = A[k*n + k];
-        if (std::fabs(Akk) < eps) return false;
-        double inv = 1.0 / Akk;
-
-        A[k*n + k] = 1.0;
-        for (int j = 0; j < n; ++j) if (j != k) A[k*n + j] *= inv;
-        b[k] *= inv;
-
-        // ---- eliminate this column from all other rows ----
-        for (int i = 0; i < n; ++i) if (i != k) {
-            double f = A[i*n + k];
-            if (f == 0.0) continue;
-            A[i*n + k] = 0.0;
-            // subtract f * (pivot row) from row i
-            for (int j = 0; j < n; ++j) if (j != k) A[i*n + j] -= f * A[k*n + j];
-            b[i] -= f * b[k];
-        }
-    }
-    return true;
-}
-
-// Choose a neighbor vector of length N
-// If N<4 we take the first N ; if border invalid, we report false.
-template <typename PixelGetter>
-static bool build_neighbor_vec(int x, int y, int ch, int N,
-                               const PixelGetter& get,
-                               std::vector<double>& nvec) {
-    nvec.assign(N, 0.0);
-    int xs[4] = { x-1, x,   x-1, x+1 };
-    int ys[4] = { y,   y-1, y-1, y-1 };
-    for (int i=0; i<N; ++i) {
+// Same-channel causal neighbors in model order: W, N, NW, NE, WW, NN, NWW, NNE
+// (nothing right of NE on row y-1: the wavefront only guarantees x+1 there)
+static constexpr LsTap LS_INTRA[LS_MAX_INTRA] = {
+    {-1, 0, 0}, {0, -1, 0}, {-1, -1, 0}, {+1, -1, 0},
+    {-2, 0, 0}, {0, -2, 0}, {-2, -1, 0}, {+1, -2, 0},
+};
+// Cross-channel terms: co-located sample of the previous channel (already coded for this
+// pixel), of the channel before it, then W and N of the previous channel. A channel that
+// does not exist (ch + dch < 0) contributes 0, which leaves the other weights unchanged.
+static constexpr LsTap LS_INTER[LS_MAX_INTER] = {
+    {0, 0, -1}, {0, 0, -2}, {-1, 0, -1}, {0, -1, -1},
+};
+static constexpr int LS_MAX_N = LS_MAX_INTRA + LS_MAX_INTER;
+static constexpr int LS_MAX_REUSE = 255;
+
+struct LsTaps {
+    int n = 0;
+    bool inter = false;
+    int reuse = 0;     // solve skipping, see LsReuse (0 = solve for every sample)
+    std::array<LsTap, LS_MAX_N> t{};
+};
 
-        int xi = xs[i], yi = ys[i];
-        if (xi < 0 || yi < 0 || get.width()<=xi || get.height()<=yi) return false; //false will eventually trigger MED fallback
-        nvec[i] = (double)get(xi, yi, ch);
+static LsTaps make_ls_taps(int nIntra, int nInter, int reuse = 0) {
+    if (nIntra < 1 || nIntra > LS_MAX_INTRA)
+        throw std::invalid_argument("LS order N must be in 1.." + std::to_string(LS_MAX_INTRA));
+    if (nInter < 0 || nInter > LS_MAX_INTER)
+        throw std::invalid_argument("LS inter-channel terms must be in 0.." + std::to_string(LS_MAX_INTER));
+    if (reuse < 0 || reuse > LS_MAX_REUSE)
+        throw std::invalid_argument("LS weight reuse must be in 0.." + std::to_string(LS_MAX_REUSE));
+    LsTaps taps;
+    taps.reuse = reuse;
+    for (int i = 0; i < nIntra; ++i) taps.t[taps.n++] = LS_INTRA[i];
+    for (int i = 0; i < nInter; ++i) taps.t[taps.n++] = LS_INTER[i];
+    taps.inter = nInter > 0;
+    return taps;
+}
 
+// Fixed-size LS model of order N: no heap traffic, loops unroll on N
+template <int N>
+struct LsKernel {
+    // Window sums: packed upper triangle of ATA, then ATy, then sample count
+    static constexpr int K = N*(N+1)/2 + N + 1;
+    using Sums = std::array<int64_t, K>;
+
+    // Neighbor vector of (x,y); false on border -> MED fallback
+    template <typename PixelGetter>
+    static bool neighbors(int x, int y, int ch, const LsTaps& taps, const PixelGetter& get, std::array<int, N>& v) {
+        for (int i=0; i<N; ++i) {
+            const LsTap& t = taps.t[i];
+            int xi = x + t.dx, yi = y + t.dy;
+            if (xi < 0 || yi < 0 || get.width()<=xi || get.height()<=yi) return false;
+            v[i] = (ch + t.dch >= 0) ? get(xi, yi, ch + t.dch) : 0;
+        }
+        return true;
     }
-    return true;
-}
 
+    // dst += sign * sample (x,y) if its neighbors are valid
+    template <typename PixelGetter>
+    static void add_sample(int64_t* dst, int x, int y, int ch, const LsTaps& taps, const PixelGetter& get, int sign) {
+        std::array<int, N> v;
+        if (!neighbors(x, y, ch, taps, get, v)) return;
+        int64_t tgt = get(x, y, ch);
+        int k = 0;
+        for (int i = 0; i < N; ++i)
+            for (int j = i; j < N; ++j) dst[k++] += sign * (int64_t)v[i] * v[j];
+        for (int i = 0; i < N; ++i) dst[k++] += sign * (int64_t)v[i] * tgt;
+        dst[k] += sign;
+    }
 
-template <typename PixelGetter>
-static int accumulate_window_normal_eq(int x, int y, int ch, int N,
-                                       int winW, int winH,
-                                       const PixelGetter& get,
-                                       std::vector<double>& ATA,
-                                       std::vector<double>& ATy) {
-    ATA.assign(N*N, 0.0);
-    ATy.assign(N,   0.0);
-    std::vector<double> v(N);
-    int count = 0;
+    static int count(const Sums& s) { return (int)s[K-1]; }
+
+    // Solve (ATA + lambda*I) w = ATy with LDL^T (system is symmetric positive definite)
+    // return:  false : not positive definite / true  : success
+    static bool solve(const Sums& s, double lambda, std::array<double, N>& w) {
+        const double eps = 1e-12; // singularity guard
+        std::array<double, N*N> L{};
+        std::array<double, N> d{};
+
+        int k = 0;
+        for (int i = 0; i < N; ++i)
+            for (int j = i; j < N; ++j, ++k) L[j*N + i] = (double)s[k]; // lower triangle
+        for (int i = 0; i < N; ++i) L[i*N + i] += lambda;
+
+        for (int j = 0; j < N; ++j) {
+            double dj = L[j*N + j];
+            for (int t = 0; t < j; ++t) dj -= L[j*N + t] * L[j*N + t] * d[t];
+            if (dj < eps) return false;
+            d[j] = dj;
+            double inv = 1.0 / dj;
+            for (int i = j + 1; i < N; ++i) {
+                double a = L[i*N + j];
+                for (int t = 0; t < j; ++t) a -= L[i*N + t] * L[j*N + t] * d[t];
+                L[i*N + j] = a * inv;
+            }
+        }
 
-    // window rows: [y - winH, y]
-    int yStart = std::max(0, y - winH);
-    for (int yy = yStart; yy <= y; ++yy) {
+        // L z = b, z /= D, L^T w = z
+        for (int i = 0; i < N; ++i) {
+            double z = (double)s[k + i];
+            for (int t = 0; t < i; ++t) z -= L[i*N + t] * w[t];
+            w[i] = z;
+        }
+        for (int i = 0; i < N; ++i) w[i] /= d[i];
+        for (int i = N - 1; i >= 0; --i)
+            for (int t = i + 1; t < N; ++t) w[i] -= L[t*N + i] * w[t];
+        return true;
+    }
+};
 
+// How a sample was predicted
+enum class LsMode { MED, LS, REUSED, FLAT };
 
-        int xStart = std::max(0, x - winW);
-        int xEnd   = std::min(get.width()-1, x-1);
+static void count_mode(LsBreakdown& b, LsMode m) {
+    switch (m) {
+        case LsMode::MED:    ++b.used_med; break;
+        case LsMode::LS:     ++b.used_ls; break;
+        case LsMode::REUSED: ++b.used_ls; ++b.ls_reused; break;
+        case LsMode::FLAT:   ++b.flat; break;
+    }
+}
 
-        for (int xx = xStart; xx <= xEnd; ++xx) {
+// Weights of the last solve on this row and channel (taps.reuse > 0)
+static constexpr int LS_REUSE_ACT = 0;   // max activity change that keeps them (more costs ~2% per step)
+template <int N>
+struct LsReuse {
+    std::array<double, N> w{};
+    int uses = 0;    // samples predicted with w, the solved one included; 0 = none
+    int act = 0;     // activity at the solved sample
+};
 
-            if (!build_neighbor_vec(xx, yy, ch, N, get, v)) continue;
+// Runtime model size (taps.n) -> compile-time order
+template <int N = 1, typename Fn>
+static auto with_ls_order(int n, Fn&& fn) -> decltype(fn(std::integral_constant<int, 1>{})) {
+    if constexpr (N > LS_MAX_N) {
+        throw std::invalid_argument("LS model size must be in 1.." + std::to_string(LS_MAX_N));
+    } else {
+        if (n == N) return fn(std::integral_constant<int, N>{});
+        return with_ls_order<N + 1>(n, std::forward<Fn>(fn));
+    }
+}
 
-            auto tgt = (double)get(xx, yy, ch);
+// Wavefront LS driver.
+// Window for (x,y) is rows [y - winH, y] x cols [x - winW, x - 1].
+// Every row keeps its own column sums over the window rows,
+//   col_y[x] = col_{y-1}[x] + sample(x,y) - sample(x, y-1-winH),
+// so moving one pixel right adds the entering column and drops the leaving one.
+// Sums are int64: every term is an integer product, so the result matches a full rescan exactly.
+// Rows run in parallel: row y may decode x once row y-1 has finished x+1
+// (NE neighbor and col_{y-1}[x-1] are final by then). Output is identical for any thread count.
+// pixel(x, y, ch, sums, reuse) predicts + writes one sample and returns how (LsMode).
+template <int N, typename PixelGetter, typename PixelFn>
+static LsBreakdown ls_wavefront(const PixelGetter& get, int channels, const LsTaps& taps,
+                                int winW, int winH, int threads, PixelFn&& pixel) {
+    using Kern = LsKernel<N>;
+    using Sums = typename Kern::Sums;
+    constexpr int K = Kern::K;
+
+    const int w = get.width(), h = get.height(), C = channels;
+    LsBreakdown total;
+    if (w <= 0 || h <= 0) return total;
+
+    // Each row trails the one above by 2 columns, so at most ~w/2 rows make progress at once.
+    // The ring costs (T+1)*w*C*K int64 (N=12, 3 channels: ~2.2 KB per pixel of width and row),
+    // so threads beyond that would only buy memory
+    const int T = std::max(1, std::min({threads, h, w / 2}));
+    const int R = T + 1;          // ring of column-sum rows; rows in flight never exceed T
+    const int DONE = w + 1;       // progress value once the row's last column sum is final
+
+    std::vector<int64_t> cols((size_t)R*w*C*K, 0);
+    std::vector<std::atomic<int>> progress(h);
+    std::atomic<int> next_row{0};
+    std::mutex total_m;
+
+    auto col_row = [&](int y) { return &cols[(size_t)(y % R)*w*C*K]; };
+
+    auto worker = [&](int) {
+        std::vector<Sums> win(C);
+        std::vector<LsReuse<N>> reuse(C);
+        LsBreakdown local;
+
+        for (int y; (y = next_row.fetch_add(1)) < h;) {
+            trace::Scope row("ls row", y);   // one branch when tracing is off
+            // ring slot of row y is free once the row that read it (y-R+1) is done
+            if (y - R + 1 >= 0)
+                while (progress[y-R+1].load(std::memory_order_acquire) < DONE) std::this_thread::yield();
+
+            int64_t* cur = col_row(y);
+            const int64_t* prev = (y > 0) ? col_row(y-1) : nullptr;
+            int known = (y > 0) ? 0 : DONE; // last seen progress of row y-1
+
+            auto wait_prev = [&](int need) {
+                while (known < need) {
+                    known = progress[y-1].load(std::memory_order_acquire);
+                    if (known < need) std::this_thread::yield();
+                }
+            };
+            auto finish_col = [&](int xx) {
+                for (int ch = 0; ch < C; ++ch) {
+                    int64_t* c = &cur[((size_t)xx*C + ch)*K];
+                    if (prev) std::copy_n(&prev[((size_t)xx*C + ch)*K], K, c);
+                    else std::fill_n(c, K, 0);
+                    Kern::add_sample(c, xx, y, ch, taps, get, +1);
+                    if (y-1-winH >= 0) Kern::add_sample(c, xx, y-1-winH, ch, taps, get, -1);
+                }
+            };
+
+            for (int x = 0; x < w; ++x) {
+                wait_prev(std::min(x + 2, w));
+                if (x > 0) finish_col(x-1);
+
+                for (int ch = 0; ch < C; ++ch) {
+                    Sums& S = win[ch];
+                    if (x == 0) {
+                        S.fill(0);
+                        reuse[ch] = {};   // per row, so the thread count cannot change it
+                    } else {
+                        const int64_t* in = &cur[((size_t)(x-1)*C + ch)*K];
+                        for (int k = 0; k < K; ++k) S[k] += in[k];
+                        if (x-1-winW >= 0) {
+                            const int64_t* out = &cur[((size_t)(x-1-winW)*C + ch)*K];
+                            for (int k = 0; k < K; ++k) S[k] -= out[k];
+                        }
+                    }
+                    count_mode(local, pixel(x, y, ch, S, reuse[ch]));
+                }
+                progress[y].store(x + 1, std::memory_order_release);
+            }
 
+            // Last column never enters a window on this row, finish it for the rows below
+            wait_prev(DONE);
+            finish_col(w-1);
+            progress[y].store(DONE, std::memory_order_release);
+        }
 
-            for (int i=0; i<N; ++i) {
+        std::lock_guard<std::mutex> lk(total_m);
+        total += local;
+    };
 
-                ATy[i] += v[i] * tgt;
-                double vi = v[i];
-                for (int j=0; j<N; ++j) ATA[i*N + j] += vi * v[j];
+    if (T == 1) {
+        worker(0);
+    } else {
+        ThreadPool pool(T);
+        pool.parallel_for(T, worker);
+    }
+    return total;
+}
 
+// LS prediction for (x,y,ch) into p; LsMode::MED -> caller falls back to MED.
+// With taps.reuse = K > 0 flat neighbourhoods (W = N = NW = NE) predict W without solving,
+// and a row keeps the last solved weights of each channel for K samples in all while the
+// local activity |W-NW| + |N-NW| + |NE-N| stays within LS_REUSE_ACT of the solved
+// sample's (K = 1: flat skipping only). Both only read decoded samples, so encoder and
+// decoder skip the same solves.
+template <int N, typename PixelGetter>
+static LsMode ls_predict(int x, int y, int ch, const typename LsKernel<N>::Sums& S,
+                         const LsTaps& taps, const PixelGetter& get, LsReuse<N>& rs, double& p) {
+    using Kern = LsKernel<N>;
+    int act = 0;
+    if (taps.reuse && x > 0 && y > 0 && x + 1 < get.width()) {
+        const int W = get(x-1, y, ch), Nn = get(x, y-1, ch), NW = get(x-1, y-1, ch), NE = get(x+1, y-1, ch);
+        act = std::abs(W - NW) + std::abs(Nn - NW) + std::abs(NE - Nn);
+        if (act == 0) { p = W; return LsMode::FLAT; }
+        if (rs.uses > 0 && rs.uses < taps.reuse && std::abs(act - rs.act) <= LS_REUSE_ACT) {
+            std::array<int, N> nvec;
+            if (Kern::neighbors(x, y, ch, taps, get, nvec)) {
+                ++rs.uses;
+                p = 0.0; for (int i=0;i<N;++i) p += rs.w[i]*nvec[i];
+                return LsMode::REUSED;
             }
-            ++count;
         }
     }
-    return count;
+    rs.uses = 0;
+    if (Kern::count(S) < N + 2) return LsMode::MED; // samples >= N+2 -> solve
+    std::array<int, N> nvec;
+    if (!Kern::neighbors(x, y, ch, taps, get, nvec) || !Kern::solve(S, 1e-3, rs.w)) return LsMode::MED;
+    rs.uses = 1;
+    rs.act = act;
+    p = 0.0; for (int i=0;i<N;++i) p += rs.w[i]*nvec[i];
+    return LsMode::LS;
 }
 
 // -------------------- u8 path (RGB/Gray) --------------------
@@ -234,8 +463,9 @@ struct GetterU8 {
         return im.px[(y*im.w + x)*im.c + ch];
     }
 };
-// samples >= N+2 -> gauss solve
-std::vector<int16_t> compute_residuals_LS_u8(const Image& src, int N, int winW, int winH) {
+
+template <int N>
+static std::vector<int16_t> ls_residuals_u8(const Image& src, const LsTaps& taps, int winW, int winH, int threads) {
     std::vector<int16_t> res((size_t)src.w*src.h*src.c);
 
 
@@ -243,115 +473,81 @@ std::vector<int16_t> compute_residuals_LS_u8(const Image& src, int N, int winW,
     ctx.px.assign((size_t)ctx.w*ctx.h*ctx.c, 0);
 
     GetterU8 getCtx{ctx};
-    std::vector<double> ATA, ATy, nvec;
-
-    size_t ls_count = 0, med_count = 0;
-
-    for (int y=0; y<src.h; ++y) {
-        for (int x=0; x<src.w; ++x) {
-            for (int ch=0; ch<src.c; ++ch) {
-
-
-                bool ls_ok = false;
-                int pred = 0;
-
-                int samples = accumulate_window_normal_eq(x, y, ch, N, winW, winH, getCtx, ATA, ATy);
-                if (samples >= N + 2) {
-
-                    std::vector<double> w = ATy;
 
-
-                    if (gauss_solve(ATA, w, N, 1e-3) && build_neighbor_vec(x, y, ch, N, getCtx, nvec)) {
-
-                        double p = 0.0; for (int i=0;i<N;++i) p += w[i]*nvec[i];
-                        pred = std::clamp((int)std::llround(p), 0, 255);
-                        ls_ok = true; ++ls_count;
-
-                    }
-                }
-
-                if (!ls_ok) {
-
-                    int A = (x-1>=0) ? getCtx(x-1,y,ch) : 0;
-                    int B = (y-1>=0) ? getCtx(x,y-1,ch) : 0;
-                    int C = (x-1>=0 && y-1>=0) ? getCtx(x-1,y-1,ch) : 0;
-                    pred = med_predict(A,B,C);
-
-                    ++med_count;
-
-                }
-
-                int actual = (int)src.px[(size_t)(y*src.w + x)*src.c + ch];
-                auto r = (int16_t)(actual - pred);
-                res[(size_t)(y*src.w + x)*src.c + ch] = r;
-
-                // Update context exactly like the decoder will
-                int recon = std::clamp(pred + (int)r, 0, 255);
-                ctx.px[(size_t)(y*ctx.w + x)*ctx.c + ch] = (unsigned char)recon;
+    auto b = ls_wavefront<N>(getCtx, ctx.c, taps, winW, winH, threads,
+        [&](int x, int y, int ch, const typename LsKernel<N>::Sums& S, LsReuse<N>& rs) {
+            int pred = 0;
+            double p = 0.0;
+            const LsMode mode = ls_predict<N>(x, y, ch, S, taps, getCtx, rs, p);
+
+            if (mode != LsMode::MED) {
+                pred = std::clamp((int)std::llround(p), 0, 255);
+            } else {
+                int A = (x-1>=0) ? getCtx(x-1,y,ch) : 0;
+                int B = (y-1>=0) ? getCtx(x,y-1,ch) : 0;
+                int C = (x-1>=0 && y-1>=0) ? getCtx(x-1,y-1,ch) : 0;
+                pred = med_predict(A,B,C);
             }
-        }
-    }
 
-    std::cout << "Prediction stats: LS=" << ls_count
-              << " MED=" << med_count
-              << " Total=" << (size_t)src.w*src.h*src.c
-              << " (" << (100.0*ls_count/((size_t)src.w*src.h*src.c)) << "% LS)\n";
+            int actual = (int)src.px[(size_t)(y*src.w + x)*src.c + ch];
+            auto r = (int16_t)(actual - pred);
+            res[(size_t)(y*src.w + x)*src.c + ch] = r;
+
+            // Update context exactly like the decoder will
+            int recon = std::clamp(pred + (int)r, 0, 255);
+            ctx.px[(size_t)(y*ctx.w + x)*ctx.c + ch] = (unsigned char)recon;
+            return mode;
+        });
 
     //Hook for printing stats in main.cpp
-    g_last_ls_breakdown.used_ls  = ls_count;
-    g_last_ls_breakdown.used_med = med_count;
+    g_last_ls_breakdown = b;
     return res;
 }
 
+std::vector<int16_t> compute_residuals_LS_u8(const Image& src, int N, int winW, int winH, int threads, int inter, int reuse) {
+    const LsTaps taps = make_ls_taps(N, inter, reuse);
+    return with_ls_order(taps.n, [&](auto n) { return ls_residuals_u8<n.value>(src, taps, winW, winH, threads); });
+}
 
 
-Image reconstruct_from_residuals_LS_u8(const std::vector<int16_t>& residuals,
-                                       const Image& shape, int N, int winW, int winH) {
+template <int N>
+static Image ls_reconstruct_u8(const std::vector<int16_t>& residuals,
+                               const Image& shape, const LsTaps& taps, int winW, int winH, int threads) {
     Image rec = shape;
     rec.px.assign((size_t)rec.w * rec.h * rec.c, 0);
 
     GetterU8 get{rec};
-    std::vector<double> ATA, ATy, nvec;
-
-    for (int y = 0; y < rec.h; ++y) {
-
-        for (int x = 0; x < rec.w; ++x) {
-
-            for (int ch = 0; ch < rec.c; ++ch) {
-
-                bool ls_ok = false;
-                int pred = 0;
-
-                int samples = accumulate_window_normal_eq(x, y, ch, N, winW, winH, get, ATA, ATy);
-                if (samples >= N + 2) {
-
-                    std::vector<double> w = ATy; // solve A w = b
 
-                    if (gauss_solve(ATA, w, N, 1e-3) && build_neighbor_vec(x, y, ch, N, get, nvec)) {
-
-                        double p = 0.0; for (int i = 0; i < N; ++i) p += w[i] * nvec[i];
-                        pred = std::clamp((int)std::llround(p), 0, 255);
-                        ls_ok = true;
-                    }
-                }
-
-                if (!ls_ok) {
-                    pred = med_predict(
-                        (x-1>=0 ? get(x-1,y,ch) : 0),
-                        (y-1>=0 ? get(x,y-1,ch) : 0),
-                        (x-1>=0 && y-1>=0 ? get(x-1,y-1,ch) : 0)
-                    );
-                }
-
-                int16_t r = residuals[(size_t)(y*rec.w + x)*rec.c + ch];
-                int val = pred + (int)r;
-                rec.px[(size_t)(y*rec.w + x)*rec.c + ch] = (unsigned char)std::clamp(val, 0, 255);
+    ls_wavefront<N>(get, rec.c, taps, winW, winH, threads,
+        [&](int x, int y, int ch, const typename LsKernel<N>::Sums& S, LsReuse<N>& rs) {
+            int pred = 0;
+            double p = 0.0;
+            const LsMode mode = ls_predict<N>(x, y, ch, S, taps, get, rs, p);
+
+            if (mode != LsMode::MED) {
+                pred = std::clamp((int)std::llround(p), 0, 255);
+            } else {
+                pred = med_predict(
+                    (x-1>=0 ? get(x-1,y,ch) : 0),
+                    (y-1>=0 ? get(x,y-1,ch) : 0),
+                    (x-1>=0 && y-1>=0 ? get(x-1,y-1,ch) : 0)
+                );
             }
-        }
-    }
+
+            int16_t r = residuals[(size_t)(y*rec.w + x)*rec.c + ch];
+            int val = pred + (int)r;
+            rec.px[(size_t)(y*rec.w + x)*rec.c + ch] = (unsigned char)std::clamp(val, 0, 255);
+            return mode;
+        });
     return rec;
 }
 
+Image reconstruct_from_residuals_LS_u8(const std::vector<int16_t>& residuals,
+                                       const Image& shape, int N, int winW, int winH, int threads, int inter, int reuse) {
+    const LsTaps taps = make_ls_taps(N, inter, reuse);
+    return with_ls_order(taps.n, [&](auto n) { return ls_reconstruct_u8<n.value>(residuals, shape, taps, winW, winH, threads); });
+}
+
 
 
 // -------------------- s16 path (RCT) --------------------
@@ -368,111 +564,482 @@ struct GetterS16 {
 };
 
 //Same logic as u8 but no clamping
-std::vector<int16_t> compute_residuals_LS_s16(const Image16& src, int N, int winW, int winH) {
+template <int N>
+static std::vector<int16_t> ls_residuals_s16(const Image16& src, const LsTaps& taps, int winW, int winH, int threads) {
     std::vector<int16_t> res((size_t)src.w*src.h*src.c);
 
     Image16 ctx = src;
     ctx.px.assign((size_t)ctx.w*ctx.h*ctx.c, 0);
 
     GetterS16 getCtx{ctx};
-    std::vector<double> ATA, ATy, nvec;
 
-    size_t ls_count = 0, med_count = 0;
+    auto b = ls_wavefront<N>(getCtx, ctx.c, taps, winW, winH, threads,
+        [&](int x, int y, int ch, const typename LsKernel<N>::Sums& S, LsReuse<N>& rs) {
+            int pred = 0;
+            double p = 0.0;
+            const LsMode mode = ls_predict<N>(x, y, ch, S, taps, getCtx, rs, p);
+
+            if (mode != LsMode::MED) {
+                pred = (int)std::llround(p);   // s16 path: no clamp
+            } else {
+                int A = (x-1>=0) ? getCtx(x-1,y,ch) : 0;
+                int B = (y-1>=0) ? getCtx(x,y-1,ch) : 0;
+                int C = (x-1>=0 && y-1>=0) ? getCtx(x-1,y-1,ch) : 0;
+                pred = med_predict(A,B,C);
+            }
 
-    for (int y=0; y<src.h; ++y) {
+            int actual = (int)src.px[(size_t)(y*src.w + x)*src.c + ch];
+            int16_t r = (int16_t)(actual - pred);
+            res[(size_t)(y*src.w + x)*src.c + ch] = r;
 
-        for (int x=0; x<src.w; ++x) {
+            int recon = pred + (int)r;       // s16: keep signed
+            ctx.px[(size_t)(y*ctx.w + x)*ctx.c + ch] = (int16_t)recon;
+            return mode;
+        });
 
-            for (int ch=0; ch<src.c; ++ch) {
+    //Hook for printing stats in main.cpp
+    g_last_ls_breakdown = b;
+    return res;
+}
 
-                bool ls_ok = false;
-                int pred = 0;
+std::vector<int16_t> compute_residuals_LS_s16(const Image16& src, int N, int winW, int winH, int threads, int inter, int reuse) {
+    const LsTaps taps = make_ls_taps(N, inter, reuse);
+    return with_ls_order(taps.n, [&](auto n) { return ls_residuals_s16<n.value>(src, taps, winW, winH, threads); });
+}
 
-                int samples = accumulate_window_normal_eq(x, y, ch, N, winW, winH, getCtx, ATA, ATy);
-                if (samples >= N + 2) {
 
-                    std::vector<double> w = ATy;
+//Same logic as u8
+template <int N>
+static Image16 ls_reconstruct_s16(const std::vector<int16_t>& residuals,
+                                  const Image16& shape, const LsTaps& taps, int winW, int winH, int threads) {
+    Image16 rec = shape;
+    rec.px.assign((size_t)rec.w * rec.h * rec.c, 0);
 
-                    if (gauss_solve(ATA, w, N, 1e-3) && build_neighbor_vec(x, y, ch, N, getCtx, nvec)) {
+    GetterS16 get{rec};
 
-                        double p = 0.0; for (int i=0;i<N;++i) p += w[i]*nvec[i];
-                        pred = (int)std::llround(p);   // s16 path: no clamp
-                        ls_ok = true; ++ls_count;
-                    }
-                }
+    ls_wavefront<N>(get, rec.c, taps, winW, winH, threads,
+        [&](int x, int y, int ch, const typename LsKernel<N>::Sums& S, LsReuse<N>& rs) {
+            int pred = 0;
+            double p = 0.0;
+            const LsMode mode = ls_predict<N>(x, y, ch, S, taps, get, rs, p);
+
+            if (mode != LsMode::MED) {
+                pred = (int)std::llround(p); // int16 domain, no clamp here
+            } else {
+                pred = med_predict(
+                    (x-1>=0 ? get(x-1,y,ch) : 0),
+                    (y-1>=0 ? get(x,y-1,ch) : 0),
+                    (x-1>=0 && y-1>=0 ? get(x-1,y-1,ch) : 0)
+                );
+            }
 
-                if (!ls_ok) {
+            int16_t r = residuals[(size_t)(y*rec.w + x)*rec.c + ch];
+            rec.px[(size_t)(y*rec.w + x)*rec.c + ch] = (int16_t)(pred + (int)r);
+            return mode;
+        });
+    return rec;
+}
 
-                    int A = (x-1>=0) ? getCtx(x-1,y,ch) : 0;
-                    int B = (y-1>=0) ? getCtx(x,y-1,ch) : 0;
-                    int C = (x-1>=0 && y-1>=0) ? getCtx(x-1,y-1,ch) : 0;
-                    pred = med_predict(A,B,C);
-                    ++med_count;
+Image16 reconstruct_from_residuals_LS_s16(const std::vector<int16_t>& residuals,
+                                          const Image16& shape, int N, int winW, int winH, int threads, int inter, int reuse) {
+    const LsTaps taps = make_ls_taps(N, inter, reuse);
+    return with_ls_order(taps.n, [&](auto n) { return ls_reconstruct_s16<n.value>(residuals, shape, taps, winW, winH, threads); });
+}
 
-                }
 
-                int actual = (int)src.px[(size_t)(y*src.w + x)*src.c + ch];
-                int16_t r = (int16_t)(actual - pred);
-                res[(size_t)(y*src.w + x)*src.c + ch] = r;
+// -------------------- planar (CHW) --------------------
+// Each plane is predicted as a one-channel image, so the residual of (x,y,ch) equals the
+// interleaved path's. Planes run concurrently; the threads left over go to the LS rows.
+template <typename Fn>
+static void for_each_plane(int c, int threads, Fn&& fn) {
+    const int T = std::max(1, std::min(threads, c));
+    const int inner = std::max(1, threads / T);
+    if (T == 1) {
+        for (int ch = 0; ch < c; ++ch) fn(ch, inner);
+        return;
+    }
+    ThreadPool pool(T);
+    pool.parallel_for(c, [&](int ch) { fn(ch, inner); });
+}
 
-                int recon = pred + (int)r;       // s16: keep signed
-                ctx.px[(size_t)(y*ctx.w + x)*ctx.c + ch] = (int16_t)recon;
-            }
-        }
+template <typename P>
+static std::vector<int16_t> med_planar_residuals(const P& src, int threads) {
+    const size_t n = src.plane_size();
+    std::vector<int16_t> res(src.px.size());
+    for_each_plane(src.c, threads, [&](int ch, int) {
+        med::residuals_into(src.plane(ch), src.w, src.h, 1, res.data() + ch*n);
+    });
+    return res;
+}
+
+template <typename P, typename Clamp>
+static P med_planar_reconstruct(const std::vector<int16_t>& res, const P& shape, int threads, Clamp clamp) {
+    P rec; rec.w = shape.w; rec.h = shape.h; rec.c = shape.c; rec.format = shape.format;
+    rec.px.resize(rec.plane_size()*rec.c);
+    if (res.size() != rec.px.size()) throw std::runtime_error("MED reconstruct: residual count mismatch");
+    const size_t n = rec.plane_size();
+    for_each_plane(rec.c, threads, [&](int ch, int) {
+        med::reconstruct_into(res.data() + ch*n, rec.w, rec.h, 1, rec.plane(ch), clamp);
+    });
+    return rec;
+}
+
+std::vector<int16_t> compute_residuals_MED_planar(const PlanarImage& src, int threads) {
+    return med_planar_residuals(src, threads);
+}
+std::vector<int16_t> compute_residuals_MED_planar(const PlanarImage16& src, int threads) {
+    return med_planar_residuals(src, threads);
+}
+PlanarImage reconstruct_from_residuals_MED_planar(const std::vector<int16_t>& residuals,
+                                                  const PlanarImage& shape, int threads) {
+    return med_planar_reconstruct(residuals, shape, threads, [](int v) { return std::clamp(v, 0, 255); });
+}
+PlanarImage16 reconstruct_from_residuals_MED_planar(const std::vector<int16_t>& residuals,
+                                                    const PlanarImage16& shape, int threads) {
+    return med_planar_reconstruct(residuals, shape, threads, [](int v) { return (int16_t)v; });
+}
+
+// c consecutive planes of w x h
+template <typename T>
+struct GetterPlanes {
+    const T* p;
+    int w, h;
+    int width() const { return w; }
+    int height() const { return h; }
+    int operator()(int x, int y, int ch) const { return p[((size_t)ch*h + y)*w + x]; }
+};
+
+// Clamp maps the LS prediction and the reconstructed value into the sample domain:
+// 0..255 for u8, none (int16 wrap) for s16, as in the interleaved paths
+template <int N, typename T, typename Clamp>
+static int plane_prediction(int x, int y, int ch, const typename LsKernel<N>::Sums& S, const LsTaps& taps,
+                            const GetterPlanes<T>& get, Clamp clamp, LsReuse<N>& rs, LsMode& mode) {
+    double p = 0.0;
+    mode = ls_predict<N>(x, y, ch, S, taps, get, rs, p);
+    if (mode != LsMode::MED) return clamp((int)std::llround(p));
+    return med_predict(x > 0 ? get(x-1, y, ch) : 0,
+                       y > 0 ? get(x, y-1, ch) : 0,
+                       (x > 0 && y > 0) ? get(x-1, y-1, ch) : 0);
+}
+
+// c planes predicted together (c = 1 for a plane on its own)
+template <int N, typename T, typename Clamp>
+static LsBreakdown ls_planes_residuals(const T* src, int w, int h, int c, const LsTaps& taps,
+                                       int winW, int winH, int threads, int16_t* res, Clamp clamp) {
+    std::vector<T> ctx((size_t)w*h*c, 0);
+    GetterPlanes<T> get{ctx.data(), w, h};
+    return ls_wavefront<N>(get, c, taps, winW, winH, threads,
+        [&](int x, int y, int ch, const typename LsKernel<N>::Sums& S, LsReuse<N>& rs) {
+            LsMode mode;
+            const int pred = plane_prediction<N>(x, y, ch, S, taps, get, clamp, rs, mode);
+            const size_t i = ((size_t)ch*h + y)*w + x;
+            res[i] = (int16_t)((int)src[i] - pred);
+            ctx[i] = (T)clamp(pred + (int)res[i]); // context as the decoder sees it
+            return mode;
+        });
+}
+
+template <int N, typename T, typename Clamp>
+static void ls_planes_reconstruct(const int16_t* res, int w, int h, int c, const LsTaps& taps,
+                                  int winW, int winH, int threads, T* rec, Clamp clamp) {
+    GetterPlanes<T> get{rec, w, h};
+    ls_wavefront<N>(get, c, taps, winW, winH, threads,
+        [&](int x, int y, int ch, const typename LsKernel<N>::Sums& S, LsReuse<N>& rs) {
+            LsMode mode;
+            const int pred = plane_prediction<N>(x, y, ch, S, taps, get, clamp, rs, mode);
+            const size_t i = ((size_t)ch*h + y)*w + x;
+            rec[i] = (T)clamp(pred + (int)res[i]);
+            return mode;
+        });
+}
+
+// Cross-channel terms tie the planes together, they then run in lockstep on one wavefront
+template <int N, typename P, typename Clamp>
+static std::vector<int16_t> ls_planar_residuals(const P& src, const LsTaps& taps, int winW, int winH,
+                                                int threads, Clamp clamp) {
+    const size_t n = src.plane_size();
+    std::vector<int16_t> res(src.px.size());
+    LsBreakdown b;
+    if (taps.inter) {
+        b = ls_planes_residuals<N>(src.px.data(), src.w, src.h, src.c, taps, winW, winH, threads, res.data(), clamp);
+    } else {
+        std::vector<LsBreakdown> bd(src.c);
+        for_each_plane(src.c, threads, [&](int ch, int inner) {
+            bd[ch] = ls_planes_residuals<N>(src.plane(ch), src.w, src.h, 1, taps, winW, winH, inner, res.data() + ch*n, clamp);
+        });
+        for (auto& p : bd) b += p;
     }
 
-    std::cout << "Prediction stats: LS=" << ls_count
-              << " MED=" << med_count
-              << " Total=" << (size_t)src.w*src.h*src.c
-              << " (" << (100.0*ls_count/((size_t)src.w*src.h*src.c)) << "% LS)\n";
     //Hook for printing stats in main.cpp
-    g_last_ls_breakdown.used_ls  = ls_count;
-    g_last_ls_breakdown.used_med = med_count;
+    g_last_ls_breakdown = b;
     return res;
 }
 
+template <int N, typename P, typename Clamp>
+static P ls_planar_reconstruct(const std::vector<int16_t>& res, const P& shape, const LsTaps& taps,
+                               int winW, int winH, int threads, Clamp clamp) {
+    P rec; rec.w = shape.w; rec.h = shape.h; rec.c = shape.c; rec.format = shape.format;
+    rec.px.assign(rec.plane_size()*rec.c, 0);
+    if (res.size() != rec.px.size()) throw std::runtime_error("LS reconstruct: residual count mismatch");
+    const size_t n = rec.plane_size();
+    if (taps.inter) {
+        ls_planes_reconstruct<N>(res.data(), rec.w, rec.h, rec.c, taps, winW, winH, threads, rec.px.data(), clamp);
+        return rec;
+    }
+    for_each_plane(rec.c, threads, [&](int ch, int inner) {
+        ls_planes_reconstruct<N>(res.data() + ch*n, rec.w, rec.h, 1, taps, winW, winH, inner, rec.plane(ch), clamp);
+    });
+    return rec;
+}
 
-//Same logic as u8
-Image16 reconstruct_from_residuals_LS_s16(const std::vector<int16_t>& residuals,
-                                          const Image16& shape, int N, int winW, int winH) {
-    Image16 rec = shape;
-    rec.px.assign((size_t)rec.w * rec.h * rec.c, 0);
+static int clamp_u8(int v) { return std::clamp(v, 0, 255); }
+static int wrap_s16(int v) { return (int16_t)v; }
+
+std::vector<int16_t> compute_residuals_LS_planar(const PlanarImage& src, int N, int winW, int winH, int threads, int inter, int reuse) {
+    const LsTaps taps = make_ls_taps(N, inter, reuse);
+    return with_ls_order(taps.n, [&](auto n) { return ls_planar_residuals<n.value>(src, taps, winW, winH, threads, clamp_u8); });
+}
+std::vector<int16_t> compute_residuals_LS_planar(const PlanarImage16& src, int N, int winW, int winH, int threads, int inter, int reuse) {
+    const LsTaps taps = make_ls_taps(N, inter, reuse);
+    return with_ls_order(taps.n, [&](auto n) { return ls_planar_residuals<n.value>(src, taps, winW, winH, threads, wrap_s16); });
+}
+PlanarImage reconstruct_from_residuals_LS_planar(const std::vector<int16_t>& residuals, const PlanarImage& shape,
+                                                 int N, int winW, int winH, int threads, int inter, int reuse) {
+    const LsTaps taps = make_ls_taps(N, inter, reuse);
+    return with_ls_order(taps.n, [&](auto n) { return ls_planar_reconstruct<n.value>(residuals, shape, taps, winW, winH, threads, clamp_u8); });
+}
+PlanarImage16 reconstruct_from_residuals_LS_planar(const std::vector<int16_t>& residuals, const PlanarImage16& shape,
+                                                   int N, int winW, int winH, int threads, int inter, int reuse) {
+    const LsTaps taps = make_ls_taps(N, inter, reuse);
+    return with_ls_order(taps.n, [&](auto n) { return ls_planar_reconstruct<n.value>(residuals, shape, taps, winW, winH, threads, wrap_s16); });
+}
 
-    GetterS16 get{rec};
-    std::vector<double> ATA, ATy, nvec;
-
-    for (int y = 0; y < rec.h; ++y) {
-        for (int x = 0; x < rec.w; ++x) {
-            for (int ch = 0; ch < rec.c; ++ch) {
-                bool ls_ok = false;
-                int pred = 0;
-
-                int samples = accumulate_window_normal_eq(x, y, ch, N, winW, winH, get, ATA, ATy);
-                if (samples >= N + 2) {
-                    std::vector<double> w = ATy;
-                    if (gauss_solve(ATA, w, N, 1e-3) && build_neighbor_vec(x, y, ch, N, get, nvec)) {
-                        double p = 0.0; for (int i = 0; i < N; ++i) p += w[i] * nvec[i];
-                        pred = (int)std::llround(p); // int16 domain, no clamp here
-                        ls_ok = true;
-                    }
-                }
 
-                if (!ls_ok) {
-                    pred = med_predict(
-                        (x-1>=0 ? get(x-1,y,ch) : 0),
-                        (y-1>=0 ? get(x,y-1,ch) : 0),
-                        (x-1>=0 && y-1>=0 ? get(x-1,y-1,ch) : 0)
-                    );
+// ================= block LS (forward adaptive) ===================
+// Weights are fitted once per block and channel on the source and sent as side data
+// (BLS_SHIFT fractional bits, |w| <= BLS_MAX_W so the deltas fit int16). Prediction is
+// the same integer dot product on both sides; blocks choose MED unless LS saves more than
+// its weights cost.
+static constexpr int BLS_SHIFT = 10;
+static constexpr int BLS_WEIGHT_COST = 16;   // SAD a sent weight has to save (test_images: ~-3% vs none)
+static constexpr int BLS_MAX_W = (1 << 14) - 1;
+enum : int16_t { BLS_LS = 0, BLS_MED = 1 };
+
+template <int N, typename PixelGetter, typename Clamp>
+static int bls_prediction(int x, int y, int ch, const int32_t* w, const LsTaps& taps,
+                          const PixelGetter& get, Clamp clamp, bool& ls_ok) {
+    std::array<int, N> v;
+    ls_ok = w && LsKernel<N>::neighbors(x, y, ch, taps, get, v);
+    if (ls_ok) {
+        int64_t acc = 1 << (BLS_SHIFT - 1);
+        for (int i = 0; i < N; ++i) acc += (int64_t)w[i] * v[i];
+        return clamp((int)(acc >> BLS_SHIFT));
+    }
+    return med_predict(x > 0 ? get(x-1, y, ch) : 0,
+                       y > 0 ? get(x, y-1, ch) : 0,
+                       (x > 0 && y > 0) ? get(x-1, y-1, ch) : 0);
+}
+
+// src: the image (decoder context = source, the coding is lossless); idx(x, y, ch) places
+// a residual in the caller's layout
+template <int N, typename PixelGetter, typename Index, typename Clamp>
+static LsBreakdown bls_residuals(const PixelGetter& src, int c, const LsTaps& taps, int bw, int bh,
+                                 Index idx, Clamp clamp, int16_t* res, std::vector<int16_t>& side) {
+    using Kern = LsKernel<N>;
+    const int w = src.width(), h = src.height();
+    LsBreakdown b;
+    side.clear();
+    std::vector<std::array<int32_t, N>> last(c); // per channel, weights of its last LS block
+    for (auto& l : last) l.fill(0);
+
+    for (int by = 0; by < h; by += bh)
+        for (int bx = 0; bx < w; bx += bw) {
+            const int x1 = std::min(bx + bw, w), y1 = std::min(by + bh, h);
+            for (int ch = 0; ch < c; ++ch) {
+                typename Kern::Sums S{};
+                for (int y = by; y < y1; ++y)
+                    for (int x = bx; x < x1; ++x) Kern::add_sample(S.data(), x, y, ch, taps, src, +1);
+
+                std::array<int32_t, N> wq{};
+                std::array<double, N> wd;
+                bool fit = Kern::count(S) >= N + 2 && Kern::solve(S, 1e-3, wd);
+                if (fit) {
+                    for (int i = 0; i < N; ++i)
+                        wq[i] = (int32_t)std::clamp<long long>(std::llround(wd[i] * (1 << BLS_SHIFT)), -BLS_MAX_W, BLS_MAX_W);
+                    uint64_t costLs = 0, costMed = 0;
+                    bool ok;
+                    for (int y = by; y < y1; ++y)
+                        for (int x = bx; x < x1; ++x) {
+                            const int v = src(x, y, ch);
+                            costLs  += std::abs(v - bls_prediction<N>(x, y, ch, wq.data(), taps, src, clamp, ok));
+                            costMed += std::abs(v - bls_prediction<N>(x, y, ch, nullptr, taps, src, clamp, ok));
+                        }
+                    fit = costLs + (uint64_t)(BLS_WEIGHT_COST*N) < costMed;
                 }
 
-                int16_t r = residuals[(size_t)(y*rec.w + x)*rec.c + ch];
-                rec.px[(size_t)(y*rec.w + x)*rec.c + ch] = (int16_t)(pred + (int)r);
+                if (fit) {
+                    side.push_back(BLS_LS);
+                    for (int i = 0; i < N; ++i) side.push_back((int16_t)(wq[i] - last[ch][i]));
+                    last[ch] = wq;
+                } else {
+                    side.push_back(BLS_MED);
+                }
+                for (int y = by; y < y1; ++y)
+                    for (int x = bx; x < x1; ++x) {
+                        bool ls_ok;
+                        const int pred = bls_prediction<N>(x, y, ch, fit ? wq.data() : nullptr, taps, src, clamp, ls_ok);
+                        res[idx(x, y, ch)] = (int16_t)(src(x, y, ch) - pred);
+                        if (ls_ok) ++b.used_ls; else ++b.used_med;
+                    }
             }
         }
+    return b;
+}
+
+// Weights of every block and channel from the side data (nullptr = MED block)
+template <int N>
+static std::vector<std::array<int32_t, N>> bls_weights(const std::vector<int16_t>& side, size_t blocks, int c,
+                                                        std::vector<char>& isLs) {
+    std::vector<std::array<int32_t, N>> wts(blocks*c);
+    isLs.assign(blocks*c, 0);
+    std::vector<std::array<int32_t, N>> last(c);
+    for (auto& l : last) l.fill(0);
+    size_t pos = 0;
+    for (size_t k = 0; k < blocks*c; ++k) {
+        if (pos >= side.size()) throw std::runtime_error("block LS: side data too short");
+        const int16_t mode = side[pos++];
+        if (mode == BLS_MED) continue;
+        if (mode != BLS_LS || side.size() - pos < (size_t)N) throw std::runtime_error("block LS: bad side data");
+        auto& l = last[k % c];
+        for (int i = 0; i < N; ++i) {
+            l[i] += side[pos++];
+            if (std::abs(l[i]) > BLS_MAX_W) throw std::runtime_error("block LS: weight out of range");
+        }
+        wts[k] = l;
+        isLs[k] = 1;
     }
+    if (pos != side.size()) throw std::runtime_error("block LS: side data too long");
+    return wts;
+}
+
+// Raster order, so every tap (NE included) is decoded before it is read
+template <int N, typename PixelGetter, typename Index, typename T, typename Clamp>
+static void bls_reconstruct(const PixelGetter& rec, T* out, int c, const LsTaps& taps, int bw, int bh,
+                            Index idx, Clamp clamp, const int16_t* res, const std::vector<int16_t>& side) {
+    const int w = rec.width(), h = rec.height();
+    const int nbx = (w + bw - 1) / bw;
+    std::vector<char> isLs;
+    const auto wts = bls_weights<N>(side, (size_t)nbx * ((h + bh - 1) / bh), c, isLs);
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x) {
+            const size_t k = ((size_t)(y / bh) * nbx + x / bw) * c;
+            for (int ch = 0; ch < c; ++ch) {
+                bool ls_ok;
+                const int pred = bls_prediction<N>(x, y, ch, isLs[k + ch] ? wts[k + ch].data() : nullptr,
+                                                   taps, rec, clamp, ls_ok);
+                const size_t i = idx(x, y, ch);
+                out[i] = (T)clamp(pred + (int)res[i]);
+            }
+        }
+}
+
+static void check_blocks(int blockW, int blockH) {
+    if (blockW < 1 || blockH < 1) throw std::invalid_argument("block LS: block size must be >= 1");
+}
+
+template <typename Img, typename Getter, typename Clamp>
+static std::vector<int16_t> bls_interleaved(const Img& src, std::vector<int16_t>& side, int N, int blockW, int blockH,
+                                            int inter, Clamp clamp) {
+    check_blocks(blockW, blockH);
+    const LsTaps taps = make_ls_taps(N, inter);
+    std::vector<int16_t> res(src.px.size());
+    const Getter get{src};
+    auto idx = [&](int x, int y, int ch) { return ((size_t)y*src.w + x)*src.c + ch; };
+    g_last_ls_breakdown = with_ls_order(taps.n, [&](auto n) {
+        return bls_residuals<n.value>(get, src.c, taps, blockW, blockH, idx, clamp, res.data(), side);
+    });
+    return res;
+}
+
+template <typename Img, typename Getter, typename Clamp>
+static Img bls_interleaved_rec(const std::vector<int16_t>& residuals, const std::vector<int16_t>& side, const Img& shape,
+                               int N, int blockW, int blockH, int inter, Clamp clamp) {
+    check_blocks(blockW, blockH);
+    const LsTaps taps = make_ls_taps(N, inter);
+    Img rec = shape;
+    rec.px.assign((size_t)rec.w*rec.h*rec.c, 0);
+    if (residuals.size() != rec.px.size()) throw std::runtime_error("block LS reconstruct: residual count mismatch");
+    const Getter get{rec};
+    auto idx = [&](int x, int y, int ch) { return ((size_t)y*rec.w + x)*rec.c + ch; };
+    with_ls_order(taps.n, [&](auto n) {
+        bls_reconstruct<n.value>(get, rec.px.data(), rec.c, taps, blockW, blockH, idx, clamp, residuals.data(), side);
+    });
     return rec;
 }
 
+template <typename T, typename Clamp>
+static std::vector<int16_t> bls_planar(const Planar<T>& src, std::vector<int16_t>& side, int N, int blockW, int blockH,
+                                       int inter, Clamp clamp) {
+    check_blocks(blockW, blockH);
+    const LsTaps taps = make_ls_taps(N, inter);
+    std::vector<int16_t> res(src.px.size());
+    const GetterPlanes<T> get{src.px.data(), src.w, src.h};
+    auto idx = [&](int x, int y, int ch) { return ((size_t)ch*src.h + y)*src.w + x; };
+    g_last_ls_breakdown = with_ls_order(taps.n, [&](auto n) {
+        return bls_residuals<n.value>(get, src.c, taps, blockW, blockH, idx, clamp, res.data(), side);
+    });
+    return res;
+}
+
+template <typename T, typename Clamp>
+static Planar<T> bls_planar_rec(const std::vector<int16_t>& residuals, const std::vector<int16_t>& side, const Planar<T>& shape,
+                        int N, int blockW, int blockH, int inter, Clamp clamp) {
+    check_blocks(blockW, blockH);
+    const LsTaps taps = make_ls_taps(N, inter);
+    Planar<T> rec; rec.w = shape.w; rec.h = shape.h; rec.c = shape.c; rec.format = shape.format;
+    rec.px.assign(rec.plane_size()*rec.c, 0);
+    if (residuals.size() != rec.px.size()) throw std::runtime_error("block LS reconstruct: residual count mismatch");
+    const GetterPlanes<T> get{rec.px.data(), rec.w, rec.h};
+    auto idx = [&](int x, int y, int ch) { return ((size_t)ch*rec.h + y)*rec.w + x; };
+    with_ls_order(taps.n, [&](auto n) {
+        bls_reconstruct<n.value>(get, rec.px.data(), rec.c, taps, blockW, blockH, idx, clamp, residuals.data(), side);
+    });
+    return rec;
+}
+
+std::vector<int16_t> compute_residuals_BLS_u8(const Image& src, std::vector<int16_t>& side,
+                                              int N, int blockW, int blockH, int inter) {
+    return bls_interleaved<Image, GetterU8>(src, side, N, blockW, blockH, inter, clamp_u8);
+}
+Image reconstruct_from_residuals_BLS_u8(const std::vector<int16_t>& residuals, const std::vector<int16_t>& side,
+                                        const Image& shape, int N, int blockW, int blockH, int inter) {
+    return bls_interleaved_rec<Image, GetterU8>(residuals, side, shape, N, blockW, blockH, inter, clamp_u8);
+}
+std::vector<int16_t> compute_residuals_BLS_s16(const Image16& src, std::vector<int16_t>& side,
+                                               int N, int blockW, int blockH, int inter) {
+    return bls_interleaved<Image16, GetterS16>(src, side, N, blockW, blockH, inter, wrap_s16);
+}
+Image16 reconstruct_from_residuals_BLS_s16(const std::vector<int16_t>& residuals, const std::vector<int16_t>& side,
+                                           const Image16& shape, int N, int blockW, int blockH, int inter) {
+    return bls_interleaved_rec<Image16, GetterS16>(residuals, side, shape, N, blockW, blockH, inter, wrap_s16);
+}
+std::vector<int16_t> compute_residuals_BLS_planar(const PlanarImage& src, std::vector<int16_t>& side,
+                                                  int N, int blockW, int blockH, int inter) {
+    return bls_planar(src, side, N, blockW, blockH, inter, clamp_u8);
+}
+std::vector<int16_t> compute_residuals_BLS_planar(const PlanarImage16& src, std::vector<int16_t>& side,
+                                                  int N, int blockW, int blockH, int inter) {
+    return bls_planar(src, side, N, blockW, blockH, inter, wrap_s16);
+}
+PlanarImage reconstruct_from_residuals_BLS_planar(const std::vector<int16_t>& residuals, const std::vector<int16_t>& side,
+                                                  const PlanarImage& shape, int N, int blockW, int blockH, int inter) {
+    return bls_planar_rec(residuals, side, shape, N, blockW, blockH, inter, clamp_u8);
+}
+PlanarImage16 reconstruct_from_residuals_BLS_planar(const std::vector<int16_t>& residuals, const std::vector<int16_t>& side,
+                                                    const PlanarImage16& shape, int N, int blockW, int blockH, int inter) {
+    return bls_planar_rec(residuals, side, shape, N, blockW, blockH, inter, wrap_s16);
+}
+
 
 // -------- visualisation  --------
 //Only used for testing
@@ -493,4 +1060,201 @@ Image residuals_visual_s16(const std::vector<int16_t>& residuals, const Image16&
         vis.px[i] = clamp8_vis(v);
     }
     return vis;
-}
\ No newline at end of file
+}
+
+// -------- stripes --------
+int stripe_count(int h, int stripeRows) {
+    if (h <= 0) return 0;
+    if (stripeRows <= 0 || stripeRows >= h) return 1;
+    return (h + stripeRows - 1) / stripeRows;
+}
+
+// Same w/c/format as im, `rows` high, no pixels
+template <typename Img>
+static Img stripe_shape(const Img& im, int rows) {
+    Img s; s.w = im.w; s.h = rows; s.c = im.c;
+    if constexpr (requires { s.format; }) s.format = im.format;
+    return s;
+}
+
+template <typename Img> constexpr bool is_planar = false;
+template <typename T> constexpr bool is_planar<Planar<T>> = true;
+
+// Rows [y0, y0+n) of im as an image of their own
+template <typename Img>
+static Img copy_rows(const Img& im, int y0, int n) {
+    Img part = stripe_shape(im, n);
+    if constexpr (is_planar<Img>) {
+        part.px.resize(part.plane_size()*im.c);
+        for (int ch = 0; ch < im.c; ++ch)
+            std::copy_n(im.plane(ch) + (size_t)y0*im.w, part.plane_size(), part.plane(ch));
+    } else {
+        const size_t rowLen = (size_t)im.w*im.c;
+        part.px.assign(im.px.begin() + (ptrdiff_t)(y0*rowLen), im.px.begin() + (ptrdiff_t)((y0 + n)*rowLen));
+    }
+    return part;
+}
+
+template <typename Img>
+static void put_rows(Img& out, int y0, const Img& part) {
+    if constexpr (is_planar<Img>) {
+        for (int ch = 0; ch < out.c; ++ch)
+            std::copy_n(part.plane(ch), part.plane_size(), out.plane(ch) + (size_t)y0*out.w);
+    } else {
+        std::copy(part.px.begin(), part.px.end(), out.px.begin() + (ptrdiff_t)((size_t)y0*out.w*out.c));
+    }
+}
+
+// Planar predictors produce CHW residuals per stripe; the stripe helpers always hand out
+// (and take) the interleaved .r16ans layout
+template <typename Img, typename PredictFn>
+static void predict_stripes_to_impl(const Img& src, int stripeRows, int threads,
+                                    const PredictFn& predict, const StripeConsumer& consume) {
+    const int S = stripe_count(src.h, stripeRows);
+    const int rows = (S <= 1) ? src.h : stripeRows;
+    const size_t rowLen = (size_t)src.w*src.c;
+
+    std::vector<LsBreakdown> bd(S);
+    std::vector<metrics::Record> times(S);
+
+    ThreadPool pool(std::max(1, std::min(threads, S)));
+    pool.parallel_for(S, [&](int s) {
+        int y0 = s*rows, n = std::min(rows, src.h - y0);
+
+        trace::Scope t("predict stripe", s);
+        times[s] = metrics::capture([&] {
+            std::vector<int16_t> r;
+            {
+                metrics::Scope t(metrics::PREDICT);
+                g_last_ls_breakdown = LsBreakdown{};
+                r = S == 1 ? predict(src) : predict(copy_rows(src, y0, n));
+                if (r.size() != n*rowLen) throw std::runtime_error("predict_stripes: bad residual size");
+                if constexpr (is_planar<Img>) r = planes_to_interleaved(r, src.w, n, src.c);
+                bd[s] = g_last_ls_breakdown;
+            }
+            consume(s, std::move(r));
+        });
+    });
+
+    LsBreakdown total;
+    for (auto& b : bd) total += b;
+    g_last_ls_breakdown = total;
+    for (const auto& t : times) metrics::local().add(t);
+}
+
+template <typename Img, typename PredictFn>
+static std::vector<int16_t> predict_stripes_impl(const Img& src, int stripeRows, int threads,
+                                                 const PredictFn& predict) {
+    const int S = stripe_count(src.h, stripeRows);
+    const int rows = (S <= 1) ? src.h : stripeRows;
+    const size_t rowLen = (size_t)src.w*src.c;
+
+    std::vector<int16_t> res;
+    if (S > 1) res.resize(rowLen*src.h);
+    predict_stripes_to_impl(src, stripeRows, threads, predict, [&](int s, std::vector<int16_t>&& r) {
+        if (S == 1) res = std::move(r);
+        else std::copy(r.begin(), r.end(), res.begin() + (ptrdiff_t)(s*rows*rowLen));
+    });
+    return res;
+}
+
+template <typename Img, typename ReconFn>
+static Img reconstruct_stripes_impl(const std::vector<int16_t>& residuals, const Img& shape,
+                                    int stripeRows, int threads, const ReconFn& recon) {
+    const int S = stripe_count(shape.h, stripeRows);
+    const int rows = (S <= 1) ? shape.h : stripeRows;
+    const size_t rowLen = (size_t)shape.w*shape.c;
+    if (residuals.size() != rowLen*shape.h) throw std::runtime_error("reconstruct_stripes: residual count mismatch");
+
+    Img out = stripe_shape(shape, shape.h);
+    out.px.resize(rowLen*shape.h);
+
+    ThreadPool pool(std::max(1, std::min(threads, S)));
+    pool.parallel_for(S, [&](int s) {
+        trace::Scope t("reconstruct stripe", s);
+        int y0 = s*rows, n = std::min(rows, shape.h - y0);
+        std::vector<int16_t> r(residuals.begin() + (ptrdiff_t)(y0*rowLen),
+                               residuals.begin() + (ptrdiff_t)((y0 + n)*rowLen));
+        if constexpr (is_planar<Img>) r = interleaved_to_planes(r, shape.w, n, shape.c);
+        put_rows(out, y0, recon(s, r, stripe_shape(shape, n)));
+    });
+    return out;
+}
+
+std::vector<int16_t> predict_stripes(const Image& src, int stripeRows, int threads,
+                                     const std::function<std::vector<int16_t>(const Image&)>& predict) {
+    return predict_stripes_impl(src, stripeRows, threads, predict);
+}
+std::vector<int16_t> predict_stripes(const Image16& src, int stripeRows, int threads,
+                                     const std::function<std::vector<int16_t>(const Image16&)>& predict) {
+    return predict_stripes_impl(src, stripeRows, threads, predict);
+}
+
+void predict_stripes_to(const Image& src, int stripeRows, int threads,
+                        const std::function<std::vector<int16_t>(const Image&)>& predict,
+                        const StripeConsumer& consume) {
+    predict_stripes_to_impl(src, stripeRows, threads, predict, consume);
+}
+void predict_stripes_to(const Image16& src, int stripeRows, int threads,
+                        const std::function<std::vector<int16_t>(const Image16&)>& predict,
+                        const StripeConsumer& consume) {
+    predict_stripes_to_impl(src, stripeRows, threads, predict, consume);
+}
+void predict_stripes_to(const PlanarImage& src, int stripeRows, int threads,
+                        const std::function<std::vector<int16_t>(const PlanarImage&)>& predict,
+                        const StripeConsumer& consume) {
+    predict_stripes_to_impl(src, stripeRows, threads, predict, consume);
+}
+void predict_stripes_to(const PlanarImage16& src, int stripeRows, int threads,
+                        const std::function<std::vector<int16_t>(const PlanarImage16&)>& predict,
+                        const StripeConsumer& consume) {
+    predict_stripes_to_impl(src, stripeRows, threads, predict, consume);
+}
+
+Image reconstruct_stripes(const std::vector<int16_t>& residuals, const Image& shape,
+                          int stripeRows, int threads,
+                          const std::function<Image(const std::vector<int16_t>&, const Image&)>& rec) {
+    return reconstruct_stripes_impl(residuals, shape, stripeRows, threads, [&](int, const auto& r, const auto& s) { return rec(r, s); });
+}
+Image16 reconstruct_stripes(const std::vector<int16_t>& residuals, const Image16& shape,
+                            int stripeRows, int threads,
+                            const std::function<Image16(const std::vector<int16_t>&, const Image16&)>& rec) {
+    return reconstruct_stripes_impl(residuals, shape, stripeRows, threads, [&](int, const auto& r, const auto& s) { return rec(r, s); });
+}
+
+std::vector<int16_t> predict_stripes(const PlanarImage& src, int stripeRows, int threads,
+                                     const std::function<std::vector<int16_t>(const PlanarImage&)>& predict) {
+    return predict_stripes_impl(src, stripeRows, threads, predict);
+}
+std::vector<int16_t> predict_stripes(const PlanarImage16& src, int stripeRows, int threads,
+                                     const std::function<std::vector<int16_t>(const PlanarImage16&)>& predict) {
+    return predict_stripes_impl(src, stripeRows, threads, predict);
+}
+
+PlanarImage reconstruct_stripes(const std::vector<int16_t>& residuals, const PlanarImage& shape,
+                                int stripeRows, int threads,
+                                const std::function<PlanarImage(const std::vector<int16_t>&, const PlanarImage&)>& rec) {
+    return reconstruct_stripes_impl(residuals, shape, stripeRows, threads, [&](int, const auto& r, const auto& s) { return rec(r, s); });
+}
+PlanarImage16 reconstruct_stripes(const std::vector<int16_t>& residuals, const PlanarImage16& shape,
+                                  int stripeRows, int threads,
+                                  const std::function<PlanarImage16(const std::vector<int16_t>&, const PlanarImage16&)>& rec) {
+    return reconstruct_stripes_impl(residuals, shape, stripeRows, threads, [&](int, const auto& r, const auto& s) { return rec(r, s); });
+}
+
+Image reconstruct_stripes(const std::vector<int16_t>& residuals, const Image& shape,
+                          int stripeRows, int threads, const IndexedStripeRec<Image>& rec) {
+    return reconstruct_stripes_impl(residuals, shape, stripeRows, threads, rec);
+}
+Image16 reconstruct_stripes(const std::vector<int16_t>& residuals, const Image16& shape,
+                            int stripeRows, int threads, const IndexedStripeRec<Image16>& rec) {
+    return reconstruct_stripes_impl(residuals, shape, stripeRows, threads, rec);
+}
+PlanarImage reconstruct_stripes(const std::vector<int16_t>& residuals, const PlanarImage& shape,
+                                int stripeRows, int threads, const IndexedStripeRec<PlanarImage>& rec) {
+    return reconstruct_stripes_impl(residuals, shape, stripeRows, threads, rec);
+}
+PlanarImage16 reconstruct_stripes(const std::vector<int16_t>& residuals, const PlanarImage16& shape,
+                                  int stripeRows, int threads, const IndexedStripeRec<PlanarImage16>& rec) {
+    return reconstruct_stripes_impl(residuals, shape, stripeRows, threads, rec);
+}
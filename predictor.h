@@ -2,10 +2,20 @@
 #include "imageIO.h"
 #include <vector>
 #include <cstdint>
+#include <functional>
 
-//Hook for printing stats in main.cpp
-struct LsBreakdown { uint64_t used_ls=0, used_med=0; };
-extern LsBreakdown g_last_ls_breakdown;
+//Hook for printing stats in main.cpp (per thread, so concurrent stripes don't race)
+// used_ls counts LS predictions (ls_reused of them without a solve), flat the samples
+// predicted as W on a flat neighbourhood (LS reuse > 0 only)
+struct LsBreakdown {
+    uint64_t used_ls=0, used_med=0;
+    uint64_t ls_reused=0, flat=0;
+    LsBreakdown& operator+=(const LsBreakdown& o) {
+        used_ls += o.used_ls; used_med += o.used_med; ls_reused += o.ls_reused; flat += o.flat;
+        return *this;
+    }
+};
+extern thread_local LsBreakdown g_last_ls_breakdown;
 
 // Existing MED:
 int  med_predict(int A, int B, int C);
@@ -18,20 +28,139 @@ Image16 reconstruct_from_residuals_MED_s16(const std::vector<int16_t>& residuals
 Image residuals_visual_rgb8(const std::vector<int16_t>& residuals, const Image& shape);
 Image residuals_visual_s16(const std::vector<int16_t>& residuals, const Image16& shape);
 
+// LS: threads > 1 runs rows as a wavefront, output is identical to threads = 1
+// N = same-channel neighbors 1..8 (W, N, NW, NE, WW, NN, NWW, NNE);
+// inter = cross-channel terms 0..4 (previous channel co-located, the one before, W and N of
+// the previous channel), so U/V or G/B are also predicted from the channels coded before them;
+// reuse = K > 0 skips solves (same rule on both sides, so files record it): a row keeps a
+// channel's last weights for up to K samples while the local activity barely changes, and
+// flat neighbourhoods (W = N = NW = NE) predict W directly. K = 0 solves at every sample
 // RGB/Gray (uint8)
 std::vector<int16_t> compute_residuals_LS_u8(const Image& src,
                                              int N = 4,
-                                             int winW = 4, int winH = 4);
+                                             int winW = 4, int winH = 4,
+                                             int threads = 1, int inter = 0, int reuse = 0);
 Image reconstruct_from_residuals_LS_u8(const std::vector<int16_t>& residuals,
                                        const Image& shape,
                                        int N = 4,
-                                       int winW = 4, int winH = 4);
+                                       int winW = 4, int winH = 4,
+                                       int threads = 1, int inter = 0, int reuse = 0);
 
 // RCT int16 (optional LS on RCT)
 std::vector<int16_t> compute_residuals_LS_s16(const Image16& src,
                                               int N = 4,
-                                              int winW = 4, int winH = 4);
+                                              int winW = 4, int winH = 4,
+                                              int threads = 1, int inter = 0, int reuse = 0);
 Image16 reconstruct_from_residuals_LS_s16(const std::vector<int16_t>& residuals,
                                           const Image16& shape,
                                           int N = 4,
-                                          int winW = 4, int winH = 4);
+                                          int winW = 4, int winH = 4,
+                                          int threads = 1, int inter = 0, int reuse = 0);
+
+// -------- planar (CHW) --------
+// Same predictions per sample as the functions above, on PlanarImage/PlanarImage16.
+// Residuals are planar (plane after plane; planes_to_interleaved gives the .r16ans layout).
+// Planes run concurrently on min(threads, c) threads, LS splits the rest over its rows
+// (with inter > 0 the planes depend on each other and share one wavefront).
+std::vector<int16_t> compute_residuals_MED_planar(const PlanarImage& src, int threads = 1);
+std::vector<int16_t> compute_residuals_MED_planar(const PlanarImage16& src, int threads = 1);
+PlanarImage   reconstruct_from_residuals_MED_planar(const std::vector<int16_t>& residuals,
+                                                    const PlanarImage& shape, int threads = 1);
+PlanarImage16 reconstruct_from_residuals_MED_planar(const std::vector<int16_t>& residuals,
+                                                    const PlanarImage16& shape, int threads = 1);
+
+std::vector<int16_t> compute_residuals_LS_planar(const PlanarImage& src,
+                                                 int N = 4, int winW = 4, int winH = 4, int threads = 1, int inter = 0, int reuse = 0);
+std::vector<int16_t> compute_residuals_LS_planar(const PlanarImage16& src,
+                                                 int N = 4, int winW = 4, int winH = 4, int threads = 1, int inter = 0, int reuse = 0);
+PlanarImage   reconstruct_from_residuals_LS_planar(const std::vector<int16_t>& residuals, const PlanarImage& shape,
+                                                   int N = 4, int winW = 4, int winH = 4, int threads = 1, int inter = 0, int reuse = 0);
+PlanarImage16 reconstruct_from_residuals_LS_planar(const std::vector<int16_t>& residuals, const PlanarImage16& shape,
+                                                   int N = 4, int winW = 4, int winH = 4, int threads = 1, int inter = 0, int reuse = 0);
+
+// -------- block LS (forward adaptive) --------
+// The encoder fits one weight set (same taps as LS, N + inter) per blockW x blockH block and
+// channel on the source and sends it as side data; both sides then predict with an integer
+// dot product, so reconstruction solves nothing. Blocks where LS does not save more than
+// its weights cost, and samples whose taps leave the image, use MED. No row wavefront:
+// stripes give parallelism.
+// side, per block in raster order and per channel: 1 (MED block) or 0 followed by the N
+// weight changes (10 fractional bits) since the last LS block of that channel.
+std::vector<int16_t> compute_residuals_BLS_u8(const Image& src, std::vector<int16_t>& side,
+                                              int N = 4, int blockW = 32, int blockH = 32, int inter = 0);
+Image reconstruct_from_residuals_BLS_u8(const std::vector<int16_t>& residuals, const std::vector<int16_t>& side,
+                                        const Image& shape, int N = 4, int blockW = 32, int blockH = 32, int inter = 0);
+std::vector<int16_t> compute_residuals_BLS_s16(const Image16& src, std::vector<int16_t>& side,
+                                               int N = 4, int blockW = 32, int blockH = 32, int inter = 0);
+Image16 reconstruct_from_residuals_BLS_s16(const std::vector<int16_t>& residuals, const std::vector<int16_t>& side,
+                                           const Image16& shape, int N = 4, int blockW = 32, int blockH = 32, int inter = 0);
+std::vector<int16_t> compute_residuals_BLS_planar(const PlanarImage& src, std::vector<int16_t>& side,
+                                                  int N = 4, int blockW = 32, int blockH = 32, int inter = 0);
+std::vector<int16_t> compute_residuals_BLS_planar(const PlanarImage16& src, std::vector<int16_t>& side,
+                                                  int N = 4, int blockW = 32, int blockH = 32, int inter = 0);
+PlanarImage   reconstruct_from_residuals_BLS_planar(const std::vector<int16_t>& residuals, const std::vector<int16_t>& side,
+                                                    const PlanarImage& shape, int N = 4, int blockW = 32, int blockH = 32, int inter = 0);
+PlanarImage16 reconstruct_from_residuals_BLS_planar(const std::vector<int16_t>& residuals, const std::vector<int16_t>& side,
+                                                    const PlanarImage16& shape, int N = 4, int blockW = 32, int blockH = 32, int inter = 0);
+
+// -------- stripes --------
+// Horizontal bands of stripeRows rows, each predicted on its own (the rows above a stripe
+// are border for it), so stripes can be coded concurrently and decoded one at a time.
+// Residual layout is the same as for the whole image. stripeRows <= 0 -> one stripe.
+// LS breakdown of all stripes is summed into g_last_ls_breakdown of the calling thread.
+// Planar overloads: predict/rec work on planar stripes and residuals, the helpers still
+// return and take the interleaved layout.
+int stripe_count(int h, int stripeRows);
+
+std::vector<int16_t> predict_stripes(const Image& src, int stripeRows, int threads,
+                                     const std::function<std::vector<int16_t>(const Image&)>& predict);
+std::vector<int16_t> predict_stripes(const Image16& src, int stripeRows, int threads,
+                                     const std::function<std::vector<int16_t>(const Image16&)>& predict);
+
+// Fused form: consume(s, residuals) gets the (interleaved) residuals of each stripe on the
+// worker that predicted it, nothing frame-sized is assembled (see ans::compress_stripes_to_sink).
+// A single stripe is predicted on src itself, without a copy.
+using StripeConsumer = std::function<void(int stripe, std::vector<int16_t>&& residuals)>;
+void predict_stripes_to(const Image& src, int stripeRows, int threads,
+                        const std::function<std::vector<int16_t>(const Image&)>& predict,
+                        const StripeConsumer& consume);
+void predict_stripes_to(const Image16& src, int stripeRows, int threads,
+                        const std::function<std::vector<int16_t>(const Image16&)>& predict,
+                        const StripeConsumer& consume);
+void predict_stripes_to(const PlanarImage& src, int stripeRows, int threads,
+                        const std::function<std::vector<int16_t>(const PlanarImage&)>& predict,
+                        const StripeConsumer& consume);
+void predict_stripes_to(const PlanarImage16& src, int stripeRows, int threads,
+                        const std::function<std::vector<int16_t>(const PlanarImage16&)>& predict,
+                        const StripeConsumer& consume);
+
+Image   reconstruct_stripes(const std::vector<int16_t>& residuals, const Image& shape,
+                            int stripeRows, int threads,
+                            const std::function<Image(const std::vector<int16_t>&, const Image&)>& rec);
+Image16 reconstruct_stripes(const std::vector<int16_t>& residuals, const Image16& shape,
+                            int stripeRows, int threads,
+                            const std::function<Image16(const std::vector<int16_t>&, const Image16&)>& rec);
+
+std::vector<int16_t> predict_stripes(const PlanarImage& src, int stripeRows, int threads,
+                                     const std::function<std::vector<int16_t>(const PlanarImage&)>& predict);
+std::vector<int16_t> predict_stripes(const PlanarImage16& src, int stripeRows, int threads,
+                                     const std::function<std::vector<int16_t>(const PlanarImage16&)>& predict);
+
+PlanarImage   reconstruct_stripes(const std::vector<int16_t>& residuals, const PlanarImage& shape,
+                                  int stripeRows, int threads,
+                                  const std::function<PlanarImage(const std::vector<int16_t>&, const PlanarImage&)>& rec);
+PlanarImage16 reconstruct_stripes(const std::vector<int16_t>& residuals, const PlanarImage16& shape,
+                                  int stripeRows, int threads,
+                                  const std::function<PlanarImage16(const std::vector<int16_t>&, const PlanarImage16&)>& rec);
+
+// rec also gets the stripe index, for predictors with side data per stripe (block LS)
+template <typename Img>
+using IndexedStripeRec = std::function<Img(int stripe, const std::vector<int16_t>&, const Img&)>;
+Image         reconstruct_stripes(const std::vector<int16_t>& residuals, const Image& shape,
+                                  int stripeRows, int threads, const IndexedStripeRec<Image>& rec);
+Image16       reconstruct_stripes(const std::vector<int16_t>& residuals, const Image16& shape,
+                                  int stripeRows, int threads, const IndexedStripeRec<Image16>& rec);
+PlanarImage   reconstruct_stripes(const std::vector<int16_t>& residuals, const PlanarImage& shape,
+                                  int stripeRows, int threads, const IndexedStripeRec<PlanarImage>& rec);
+PlanarImage16 reconstruct_stripes(const std::vector<int16_t>& residuals, const PlanarImage16& shape,
+                                  int stripeRows, int threads, const IndexedStripeRec<PlanarImage16>& rec);
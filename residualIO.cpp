@@ -1,4 +1,5 @@
 #include "residualIO.h"
+#include "mappedFile.h"
 #include <fstream>
 #include <stdexcept>
 
@@ -26,26 +27,37 @@ void save_residuals(const std::string& path,
     if (!f) throw std::runtime_error("Write failed: " + path);
 }
 // -------- Load here --------
-ResidualFile load_residuals(const std::string& path)
+MappedResiduals map_residuals(const std::string& path)
 {
-    std::ifstream f(path, std::ios::binary);
-    if (!f) throw std::runtime_error("Cannot open for read: " + path);
-
-    uint32_t magic; f.read(reinterpret_cast<char*>(&magic), 4);
-    if (magic != MAGIC) throw std::runtime_error("Bad residual file");
+    auto file = std::make_shared<const MappedFile>(path);
+    ByteReader r{file->bytes()};
+    if (r.get<uint32_t>() != MAGIC) throw std::runtime_error("Bad residual file");
 
-    ResidualFile rf{};
-    int64_t count=0;
-    f.read(reinterpret_cast<char*>(&rf.mode), 4);
-    f.read(reinterpret_cast<char*>(&rf.w), 4);
-    f.read(reinterpret_cast<char*>(&rf.h), 4);
-    f.read(reinterpret_cast<char*>(&rf.c), 4);
-    f.read(reinterpret_cast<char*>(&count), 8);
+    MappedResiduals mr{};
+    mr.mode = r.get<int32_t>();
+    mr.w    = r.get<int32_t>();
+    mr.h    = r.get<int32_t>();
+    mr.c    = r.get<int32_t>();
+    int64_t count = r.get<int64_t>();
 
-    if (rf.w<=0 || rf.h<=0 || rf.c<=0) throw std::runtime_error("Invalid residual metadata");
-    rf.residuals.resize(static_cast<size_t>(count));
+    if (mr.w<=0 || mr.h<=0 || mr.c<=0 || count < 0 ||
+        static_cast<uint64_t>(count) > r.remaining() / sizeof(int16_t))
+        throw std::runtime_error("Invalid residual metadata");
+    if (count % mr.c != 0 || static_cast<uint64_t>(mr.w) * mr.h != static_cast<uint64_t>(count / mr.c))
+        throw std::runtime_error("Invalid residual metadata");
+    // samples start at byte 28, so they are 2-byte aligned in the (page aligned) mapping
+    auto bytes = r.take(static_cast<uint64_t>(count) * sizeof(int16_t));
+    mr.residuals = {reinterpret_cast<const int16_t*>(bytes.data()), static_cast<size_t>(count)};
+    mr.file = std::move(file);
+    return mr;
+}
 
-    f.read(reinterpret_cast<char*>(rf.residuals.data()), count * sizeof(int16_t));
-    if (!f) throw std::runtime_error("Read failed: " + path);
+ResidualFile load_residuals(const std::string& path)
+{
+    MappedResiduals mr = map_residuals(path);
+    ResidualFile rf{};
+    rf.mode = mr.mode;
+    rf.w = mr.w; rf.h = mr.h; rf.c = mr.c;
+    rf.residuals.assign(mr.residuals.begin(), mr.residuals.end());
     return rf;
 }
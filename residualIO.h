@@ -2,8 +2,12 @@
 #include "imageIO.h"
 #include <vector>
 #include <cstdint>
+#include <memory>
+#include <span>
 #include <string>
 
+class MappedFile;
+
 // mode: 0 = RGB(u8); 1 = RCT(s16)
 void save_residuals(const std::string& path,
                     int mode, int w, int h, int c,
@@ -16,3 +20,14 @@ struct ResidualFile {
 };
 
 ResidualFile load_residuals(const std::string& path);
+
+// Same file without copying: residuals point into a read-only mapping that the view keeps
+// alive. The count must match w*h*c and fit in the file.
+struct MappedResiduals {
+    int mode;
+    int w, h, c;
+    std::span<const int16_t> residuals;
+    std::shared_ptr<const MappedFile> file;
+};
+
+MappedResiduals map_residuals(const std::string& path);
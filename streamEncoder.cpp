@@ -0,0 +1,129 @@
+#include "streamEncoder.h"
+#include "predictor.h"
+#include "checksum.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+
+// ------------------ sources ------------------
+RowSource image_rows(const Image& im) {
+    RowSource src;
+    src.w = im.w; src.h = im.h; src.c = im.c; src.format = im.format;
+    const size_t rowLen = (size_t)im.w*im.c;
+    size_t next = 0;
+    src.next_row = [&im, rowLen, next](unsigned char* row) mutable {
+        if (next + rowLen > im.px.size()) throw std::runtime_error("image_rows: read past last row");
+        std::copy_n(im.px.begin() + (ptrdiff_t)next, rowLen, row);
+        next += rowLen;
+    };
+    return src;
+}
+
+// PNM header token, skipping whitespace and '#' comments
+static int pnm_int(std::istream& f) {
+    int ch = f.get();
+    while (ch != EOF && (std::isspace(ch) || ch == '#')) {
+        if (ch == '#') while (ch != EOF && ch != '\n') ch = f.get();
+        ch = f.get();
+    }
+    int v = 0, digits = 0;
+    while (ch != EOF && std::isdigit(ch)) { v = v*10 + (ch - '0'); ++digits; ch = f.get(); }
+    if (!digits) throw std::runtime_error("bad PNM header");
+    return v; // the single whitespace after the token is consumed here
+}
+
+RowSource open_pnm_rows(const std::string& path) {
+    auto f = std::make_shared<std::ifstream>(path, std::ios::binary);
+    if (!*f) throw std::runtime_error("Failed to open image: " + path);
+
+    char magic[2] = {0, 0};
+    f->read(magic, 2);
+    if (magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6'))
+        throw std::runtime_error("not a binary PPM/PGM: " + path);
+
+    RowSource src;
+    src.c = magic[1] == '6' ? 3 : 1;
+    src.format = magic[1] == '6' ? ImageFormat::PPM : ImageFormat::PGM;
+    src.w = pnm_int(*f);
+    src.h = pnm_int(*f);
+    int maxval = pnm_int(*f);
+    if (src.w <= 0 || src.h <= 0 || maxval != 255)
+        throw std::runtime_error("unsupported PNM (need 8-bit): " + path);
+
+    const std::streamsize rowLen = (std::streamsize)src.w*src.c;
+    src.next_row = [f, rowLen, path](unsigned char* row) {
+        f->read(reinterpret_cast<char*>(row), rowLen);
+        if (f->gcount() != rowLen) throw std::runtime_error("truncated PNM: " + path);
+    };
+    return src;
+}
+
+RowSource open_rows(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    char magic[2] = {0, 0};
+    f.read(magic, 2);
+    if (f && magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6')) {
+        try { return open_pnm_rows(path); }
+        catch (const std::runtime_error&) { /* e.g. 16-bit PNM: let stb decode it */ }
+    }
+
+    // stb has no scanline API, the decoded image is held and handed out row by row
+    auto im = std::make_shared<Image>(load_image(path));
+    RowSource src = image_rows(*im);
+    src.next_row = [im, inner = std::move(src.next_row)](unsigned char* row) { inner(row); };
+    return src;
+}
+
+// ------------------ stripes ------------------
+static Image read_stripe(RowSource& src, int rows) {
+    metrics::Scope t(metrics::LOAD);
+    Image s; s.w = src.w; s.h = rows; s.c = src.c; s.format = src.format;
+    const size_t rowLen = (size_t)src.w*src.c;
+    s.px.resize(rowLen*rows);
+    for (int y = 0; y < rows; ++y) src.next_row(s.px.data() + y*rowLen);
+    return s;
+}
+
+ans::Encoded encode_stream(RowSource& src, int ansMode, const StripePredict& predict,
+                           const std::string& outPath, ans::Options opt) {
+    if (opt.stripeRows <= 0) opt.stripeRows = STREAM_STRIPE_ROWS;
+    ans::StripeWriter out(outPath, ansMode, src.w, src.h, src.c, opt);
+    const ans::Header& H = out.header();
+
+    LsBreakdown total;
+    uint32_t crc = 0;
+    for (int s = 0; s < H.n_stripes; ++s) {
+        const int rows = std::min(H.stripe_rows, H.h - s*H.stripe_rows);
+        Image part = read_stripe(src, rows);
+        if (opt.info.has_checksum) crc = crc32c(part.px.data(), part.px.size(), crc);
+
+        g_last_ls_breakdown = LsBreakdown{};
+        std::vector<int16_t> r = predict(part);
+        total += g_last_ls_breakdown;
+        out.add_stripe(std::move(r));
+    }
+    g_last_ls_breakdown = total;
+    if (opt.info.has_checksum) out.set_checksum(crc);
+    return out.finish();
+}
+
+bool verify_stream(RowSource& src, const std::string& ansPath, const StripeReconstruct& rec) {
+    const ans::FileReader reader(ansPath);
+    const ans::Header& H = reader.header();
+    if (H.w != src.w || H.h != src.h || H.c != src.c) return false;
+
+    bool equal = true;
+    for (int s = 0; s < H.n_stripes; ++s) {
+        const int rows = std::min(H.stripe_rows, H.h - s*H.stripe_rows);
+        Image part = read_stripe(src, rows);
+
+        Image shape; shape.w = H.w; shape.h = rows; shape.c = H.c; shape.format = src.format;
+        Image back = rec(reader.stripe(s), shape);
+        equal = equal && images_equal(part, back);
+    }
+    return equal;
+}
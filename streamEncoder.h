@@ -0,0 +1,39 @@
+#pragma once
+#include "imageIO.h"
+#include "ansResidual.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// -------- scanline sources --------
+// Rows come top to bottom, next_row fills w*c bytes.
+struct RowSource {
+    int w = 0, h = 0, c = 0;
+    ImageFormat format = ImageFormat::Unknown;
+    std::function<void(unsigned char* row)> next_row;
+};
+
+RowSource image_rows(const Image& im);             // im must outlive the source
+RowSource open_pnm_rows(const std::string& path);  // binary P5/P6, maxval 255, read row by row; throws
+RowSource open_rows(const std::string& path);      // PNM streamed, other formats go through load_image
+
+// -------- streaming encode --------
+// Default stripe height when the options ask for a single stripe
+static constexpr int STREAM_STRIPE_ROWS = 64;
+
+// Stripe is an Image of up to stripe_rows rows; predict returns its residuals
+// (colour transform included), reconstruct inverts that back to 8-bit.
+using StripePredict     = std::function<std::vector<int16_t>(const Image& stripe)>;
+using StripeReconstruct = std::function<Image(const std::vector<int16_t>& residuals, const Image& shape)>;
+
+// Pulls one stripe of rows, predicts it and writes its chunk before reading on, so memory
+// is O(w * stripe_rows) instead of several full frames. The file is identical to
+// predict_stripes + ans::compress_to_file with the same stripe height.
+// opt.stripeRows <= 0 -> STREAM_STRIPE_ROWS. opt.info.has_checksum: the CRC is taken over
+// the rows as they are read.
+ans::Encoded encode_stream(RowSource& src, int ansMode, const StripePredict& predict,
+                           const std::string& outPath, ans::Options opt);
+
+// Decodes and reconstructs one stripe at a time and compares it with the rows of src
+bool verify_stream(RowSource& src, const std::string& ansPath, const StripeReconstruct& rec);
@@ -0,0 +1,340 @@
+#include "ansResidual.h"
+#include "residualIO.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// ---------- helpers ----------
+namespace {
+
+// Mostly small residuals with a few escapes
+std::vector<int16_t> make_residuals(size_t n, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<int16_t> r(n);
+    for (auto& v : r) {
+        int t = (int)(rng() % 41) - 20;
+        if (rng() % 64 == 0) t = (int)(rng() % 60000) - 30000;
+        v = (int16_t)t;
+    }
+    return r;
+}
+
+std::string tmp_path(const char* name) {
+    return ::testing::TempDir() + name;
+}
+
+std::vector<char> read_bytes(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()};
+}
+
+void write_bytes(const std::string& path, const std::vector<char>& b, size_t n) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write(b.data(), (std::streamsize)n);
+}
+
+template <class T>
+void poke(std::vector<char>& b, size_t at, T v) {
+    std::memcpy(b.data() + at, &v, sizeof(T));
+}
+
+template <class T>
+T peek(const std::vector<char>& b, size_t at) {
+    T v;
+    std::memcpy(&v, b.data() + at, sizeof(T));
+    return v;
+}
+
+}
+// namespace
+
+TEST(AnsContainer, RoundTripStripes) {
+    const int w = 23, h = 17, c = 3;
+    auto res = make_residuals((size_t)w*h*c, 5);
+    const std::string path = tmp_path("ans_stripes.r16ans");
+
+    for (int rows : {0, 1, 4, 16, 17, 100}) {
+        ans::Options opt;
+        opt.stripeRows = rows;
+        opt.threads = 3;
+        ans::Encoded info = ans::compress_to_file(res, 0, w, h, c, path, opt);
+        EXPECT_EQ(info.n_syms, res.size());
+        EXPECT_EQ(ans::decompress_file(path, 2), res) << "stripe rows=" << rows;
+    }
+    std::remove(path.c_str());
+}
+
+TEST(AnsContainer, DecodeSingleStripe) {
+    const int w = 11, h = 10, c = 1;
+    auto res = make_residuals((size_t)w*h*c, 9);
+    const std::string path = tmp_path("ans_one_stripe.r16ans");
+    ans::Options opt;
+    opt.stripeRows = 4;
+    ans::compress_to_file(res, 1, w, h, c, path, opt);
+
+    ans::Header H = ans::read_header(path);
+    EXPECT_EQ(H.mode, 1);
+    EXPECT_EQ(H.stripe_rows, 4);
+    EXPECT_EQ(H.n_stripes, 3);
+
+    // last stripe is shorter: rows 8..9
+    auto last = ans::decompress_stripe(path, 2);
+    ASSERT_EQ(last.size(), (size_t)2*w*c);
+    EXPECT_TRUE(std::equal(last.begin(), last.end(), res.begin() + 8*w*c));
+    EXPECT_THROW(ans::decompress_stripe(path, 3), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(AnsContainer, InterleavedAndScalarCoders) {
+    const std::string path = tmp_path("ans_coders.r16ans");
+
+    // lengths around the 8-lane / SIMD block boundaries
+    for (size_t n : {1, 7, 8, 9, 63, 64, 65, 1000, 40001}) {
+        auto res = make_residuals(n, (uint32_t)n);
+        for (uint32_t flags : {0u, ans::FLAG_RANS_X8}) {
+            ans::Options opt;
+            opt.flags = flags;
+            ans::compress_to_file(res, 1, (int)n, 1, 1, path, opt);
+            EXPECT_EQ(ans::read_header(path).flags, flags);
+            EXPECT_EQ(ans::decompress_file(path), res) << "n=" << n << " flags=" << flags;
+        }
+    }
+    std::remove(path.c_str());
+}
+
+TEST(AnsContainer, ContextModelRoundTrip) {
+    const std::string path = tmp_path("ans_ctx.r16ans");
+
+    // smooth field with a noisy band: contexts must track neighbours across rows and channels
+    struct Shape { int w, h, c, rows; };
+    for (Shape s : {Shape{1, 1, 1, 0}, Shape{1, 9, 3, 0}, Shape{9, 1, 1, 0},
+                    Shape{31, 20, 3, 0}, Shape{31, 20, 3, 6}}) {
+        std::vector<int16_t> res = make_residuals((size_t)s.w*s.h*s.c, (uint32_t)(s.w*s.h));
+        for (size_t i = 0; i < res.size() / 2; ++i) res[i] = (int16_t)(res[i] / 8);
+
+        ans::Options opt;
+        opt.stripeRows = s.rows;
+        opt.flags = ans::FLAG_CONTEXT | ans::FLAG_RANS_X8;
+        ans::compress_to_file(res, 0, s.w, s.h, s.c, path, opt);
+        EXPECT_EQ(ans::read_header(path).flags, ans::FLAG_CONTEXT);
+        EXPECT_EQ(ans::decompress_file(path, 2), res) << s.w << "x" << s.h << "x" << s.c;
+    }
+    std::remove(path.c_str());
+}
+
+TEST(AnsContainer, CompactModelHeader) {
+    const std::string path = tmp_path("ans_small.r16ans");
+
+    // 8x8 thumbnail with a few distinct residuals: the models must not dominate the file
+    std::vector<int16_t> res(64);
+    for (size_t i = 0; i < res.size(); ++i) res[i] = (int16_t)((int)(i % 5) - 2);
+    res[17] = 30000; // escape
+
+    for (uint32_t flags : {0u, ans::FLAG_RANS_X8, ans::FLAG_CONTEXT}) {
+        ans::Options opt;
+        opt.flags = flags;
+        ans::compress_to_file(res, 1, 8, 8, 1, path, opt);
+        std::ifstream f(path, std::ios::binary | std::ios::ate);
+        EXPECT_LT((long long)f.tellg(), 512) << "flags=" << flags;
+        EXPECT_EQ(ans::decompress_file(path), res) << "flags=" << flags;
+    }
+    std::remove(path.c_str());
+}
+
+TEST(AnsContainer, SelectablePrecision) {
+    const std::string path = tmp_path("ans_prec.r16ans");
+    const int w = 40, h = 25, c = 3;
+    auto res = make_residuals((size_t)w*h*c, 77);
+    std::vector<int16_t> flat((size_t)w*h*c, 3); // one symbol: must not need freq = L at 2^16
+
+    for (int prec = ans::RANS_PREC; prec <= ans::MAX_PREC; ++prec) {
+        for (uint32_t flags : {0u, ans::FLAG_RANS_X8, ans::FLAG_CONTEXT}) {
+            ans::Options opt;
+            opt.flags = flags;
+            opt.precBits = prec;
+            for (const auto* r : {&res, &flat}) {
+                ans::compress_to_file(*r, 0, w, h, c, path, opt);
+                EXPECT_EQ(ans::decompress_file(path), *r) << "prec=" << prec << " flags=" << flags;
+            }
+        }
+    }
+    ans::Options bad;
+    bad.precBits = ans::MAX_PREC + 1;
+    EXPECT_THROW(ans::compress_to_file(res, 0, w, h, c, path, bad), std::invalid_argument);
+    std::remove(path.c_str());
+}
+
+TEST(AnsContainer, ReaderSharesOneMapping) {
+    const int w = 19, h = 13, c = 3;
+    auto res = make_residuals((size_t)w*h*c, 21);
+    const std::string path = tmp_path("ans_reader.r16ans");
+    ans::Options opt;
+    opt.stripeRows = 5;
+    ans::compress_to_file(res, 0, w, h, c, path, opt);
+
+    ans::FileReader reader(path);
+    EXPECT_EQ(reader.header().n_stripes, 3);
+    EXPECT_EQ(reader.decode(3), res);
+    auto mid = reader.stripe(1);
+    EXPECT_TRUE(std::equal(mid.begin(), mid.end(), res.begin() + 5*w*c));
+    std::remove(path.c_str());
+}
+
+TEST(AnsContainer, CorruptSizesAreRejected) {
+    const int w = 16, h = 8, c = 1;
+    auto res = make_residuals((size_t)w*h*c, 3);
+    const std::string path = tmp_path("ans_corrupt.r16ans");
+    ans::Options opt;
+    opt.flags = 0; // one compact model per chunk, so the chunk fields are easy to locate
+    ans::compress_to_file(res, 0, w, h, c, path, opt);
+    const std::vector<char> good = read_bytes(path);
+
+    const size_t table = 44;                              // offset, size of stripe 0
+    const size_t chunk = (size_t)peek<uint64_t>(good, table);
+    const size_t esc   = chunk + 8 + 9 + peek<uint32_t>(good, chunk + 8 + 5); // esc_count
+    auto expect_reject = [&](std::vector<char> b, size_t n, const char* what) {
+        write_bytes(path, b, n);
+        EXPECT_THROW(ans::decompress_file(path), std::runtime_error) << what;
+    };
+
+    expect_reject(good, good.size() - 1, "truncated payload");
+    expect_reject(good, 30, "truncated header");
+
+    std::vector<char> b = good;
+    poke<uint64_t>(b, table + 8, 1ull << 40);
+    expect_reject(b, b.size(), "stripe size past end of file");
+
+    b = good;
+    poke<uint64_t>(b, esc, 1ull << 40);
+    poke<uint64_t>(b, esc + 8, 2ull << 40);
+    expect_reject(b, b.size(), "escape count");
+
+    b = good;
+    poke<uint64_t>(b, esc + 16, 1ull << 40);
+    expect_reject(b, b.size(), "payload size");
+
+    b = good;
+    poke<int32_t>(b, 16, 1 << 30);
+    poke<int32_t>(b, 24, 1 << 30);
+    expect_reject(b, b.size(), "image dimensions");
+
+    b = good;
+    poke<uint32_t>(b, 0, ans::FILE_MAGIC);
+    expect_reject(b, b.size(), "legacy v1 container");
+
+    write_bytes(path, good, good.size());
+    EXPECT_EQ(ans::decompress_file(path), res);
+    std::remove(path.c_str());
+}
+
+TEST(ResidualFile, MappedMatchesLoaded) {
+    const int w = 7, h = 5, c = 3;
+    auto res = make_residuals((size_t)w*h*c, 11);
+    const std::string path = tmp_path("res_raw.r16");
+    save_residuals(path, 1, w, h, c, res);
+
+    MappedResiduals mr = map_residuals(path);
+    EXPECT_EQ(mr.mode, 1);
+    EXPECT_EQ(mr.w, w);
+    EXPECT_TRUE(std::equal(mr.residuals.begin(), mr.residuals.end(), res.begin(), res.end()));
+    EXPECT_EQ(load_residuals(path).residuals, res);
+
+    // count field larger than the file, and one that disagrees with w*h*c
+    std::vector<char> b = read_bytes(path);
+    poke<int64_t>(b, 20, (int64_t)1 << 40);
+    write_bytes(path, b, b.size());
+    EXPECT_THROW(load_residuals(path), std::runtime_error);
+    poke<int64_t>(b, 20, (int64_t)res.size() - 1);
+    write_bytes(path, b, b.size());
+    EXPECT_THROW(map_residuals(path), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(AnsContainer, BufferMatchesFile) {
+    const int w = 21, h = 9, c = 3;
+    auto a = make_residuals((size_t)w*h*c, 31);
+    auto b = make_residuals(40, 32);
+    const std::string path = tmp_path("ans_buffer.r16ans");
+
+    for (uint32_t flags : {0u, ans::FLAG_RANS_X8, ans::FLAG_CONTEXT}) {
+        ans::Options opt;
+        opt.flags = flags;
+        opt.stripeRows = 4;
+        ans::Encoded fi = ans::compress_to_file(a, 0, w, h, c, path, opt);
+
+        // two images in one blob, the second starts where the first ends
+        std::vector<uint8_t> blob;
+        ans::Encoded ia = ans::compress_to_buffer(a, 0, w, h, c, blob, opt);
+        ans::Encoded ib = ans::compress_to_buffer(b, 1, 8, 5, 1, blob, opt);
+        ASSERT_EQ(ia.file_bytes + ib.file_bytes, blob.size());
+        EXPECT_EQ(fi.file_bytes, ia.file_bytes);
+
+        std::vector<char> file = read_bytes(path);
+        EXPECT_TRUE(std::equal(file.begin(), file.end(), blob.begin(), blob.begin() + (long)ia.file_bytes,
+                               [](char x, uint8_t y) { return (uint8_t)x == y; })) << "flags=" << flags;
+
+        std::span<const uint8_t> all(blob);
+        EXPECT_EQ(ans::decompress_from_buffer(all, 2), a) << "flags=" << flags;
+        EXPECT_EQ(ans::read_header(all.subspan(ia.file_bytes)).w, 8);
+        EXPECT_EQ(ans::decompress_from_buffer(all.subspan(ia.file_bytes)), b) << "flags=" << flags;
+        EXPECT_THROW(ans::decompress_from_buffer(all.first(ia.file_bytes - 1)), std::runtime_error);
+    }
+
+    // block LS side data goes through the buffer entry point as well
+    ans::Options opt;
+    opt.flags = ans::FLAG_RANS_X8 | ans::FLAG_SIDE;
+    opt.stripeRows = 4;
+    opt.info.predictor = ans::PRED_BLOCK_LS;
+    const ans::SideData side = {{0, 3, -2, 7, 1}, {1, 1}, {0, -5, 4, 0, 2}};
+    ans::Encoded fi = ans::compress_to_file(a, 0, w, h, c, path, opt, side);
+    std::vector<uint8_t> blob;
+    ans::Encoded ia = ans::compress_to_buffer(a, 0, w, h, c, blob, opt, side);
+    EXPECT_EQ(fi.file_bytes, ia.file_bytes);
+    std::vector<char> file = read_bytes(path);
+    EXPECT_TRUE(std::equal(file.begin(), file.end(), blob.begin(), blob.end(),
+                           [](char x, uint8_t y) { return (uint8_t)x == y; }));
+    EXPECT_EQ(ans::decompress_from_buffer(blob), a);
+    EXPECT_EQ(ans::decompress_side(blob), side);
+    blob.clear();
+    EXPECT_THROW(ans::compress_to_buffer(a, 0, w, h, c, blob, opt), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(AnsContainer, StripesInAnyOrder) {
+    const int w = 13, h = 10, c = 3;
+    const auto r = make_residuals((size_t)w*h*c, 41);
+    ans::Options opt;
+    opt.stripeRows = 4;
+    const size_t stripe = (size_t)4*w*c;
+
+    std::vector<uint8_t> want, got;
+    ans::compress_to_buffer(r, 0, w, h, c, want, opt);
+    auto sink = [&](const uint8_t* d, size_t n) { got.insert(got.end(), d, d + n); };
+    auto part = [&](int s) {
+        return std::vector<int16_t>(r.begin() + (long)(s*stripe), r.begin() + (long)std::min(r.size(), (s + 1)*stripe));
+    };
+    ans::compress_stripes_to_sink(0, w, h, c, [&](const ans::StripeSink& emit) {
+        for (int s : {2, 0, 1}) emit(s, part(s));
+    }, sink, opt);
+    EXPECT_EQ(got, want);
+
+    // every stripe exactly once, with its own size
+    EXPECT_THROW(ans::compress_stripes_to_sink(0, w, h, c, [&](const ans::StripeSink& emit) {
+        emit(0, part(0)); emit(1, part(1));
+    }, sink, opt), std::runtime_error);
+    EXPECT_THROW(ans::compress_stripes_to_sink(0, w, h, c, [&](const ans::StripeSink& emit) {
+        emit(0, part(0)); emit(0, part(0));
+    }, sink, opt), std::runtime_error);
+    EXPECT_THROW(ans::compress_stripes_to_sink(0, w, h, c, [&](const ans::StripeSink& emit) {
+        emit(0, part(2));
+    }, sink, opt), std::runtime_error);
+}
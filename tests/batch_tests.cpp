@@ -0,0 +1,49 @@
+#include "threadPool.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST(RunBatch, RunsEveryTaskWithinBudget) {
+    const int n = 40;
+    const uint64_t budget = 100;
+    std::mutex m;
+    uint64_t inUse = 0, peak = 0;
+    int running = 0;
+    bool oversizeAlone = true;
+    std::vector<int> seen(n, 0);
+
+    auto cost = [](int i) -> uint64_t { return i == 7 ? 250 : 10 + (uint64_t)(i % 4) * 20; };
+    run_batch(n, 4, budget, cost, [&](int i) {
+        {
+            std::lock_guard<std::mutex> lk(m);
+            inUse += cost(i);
+            ++running;
+            if (cost(i) <= budget) peak = std::max(peak, inUse);
+            else oversizeAlone = oversizeAlone && running == 1;
+            seen[i]++;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        std::lock_guard<std::mutex> lk(m);
+        inUse -= cost(i);
+        --running;
+    });
+
+    EXPECT_LE(peak, budget);
+    EXPECT_TRUE(oversizeAlone);
+    EXPECT_TRUE(std::all_of(seen.begin(), seen.end(), [](int v) { return v == 1; }));
+}
+
+TEST(RunBatch, ReleasesBudgetOnException) {
+    std::atomic<int> done{0};
+    EXPECT_THROW(run_batch(6, 3, 10, [](int) -> uint64_t { return 10; }, [&](int i) {
+        if (i == 2) throw std::runtime_error("boom");
+        ++done;
+    }), std::runtime_error);
+    EXPECT_EQ(done.load(), 5); // a leaked reservation would deadlock the rest
+}
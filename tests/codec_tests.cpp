@@ -0,0 +1,286 @@
+#include "codec.h"
+#include "checksum.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// ---------- helpers ----------
+namespace {
+
+Image make_image(int w, int h, int c, uint32_t seed) {
+    std::mt19937 rng(seed);
+    Image im; im.w = w; im.h = h; im.c = c;
+    im.px.resize((size_t)w*h*c);
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x)
+            for (int ch = 0; ch < c; ++ch)
+                im.px[((size_t)y*w + x)*c + ch] = (unsigned char)(x*5 + y*3 + ch*60 + (int)(rng() % 13));
+    return im;
+}
+
+std::string tmp_path(const char* name) {
+    return ::testing::TempDir() + name;
+}
+
+}
+// namespace
+
+TEST(Codec, RoundTripAllPipelines) {
+    const Image rgb  = make_image(29, 21, 3, 1);
+    const Image gray = make_image(17, 12, 1, 2);
+
+    for (auto pred : {codec::Predictor::MED, codec::Predictor::LS, codec::Predictor::BLOCK_LS}) {
+        for (auto color : {codec::Color::RGB, codec::Color::YUV}) {
+            for (int rows : {0, 5}) {
+                codec::Options o;
+                o.predictor = pred;
+                o.color = color;
+                o.N = 6; o.winW = 5; o.winH = 3; o.inter = 2;
+                o.stripeRows = rows;
+                o.threads = 2;
+                const codec::Encoder enc(o);
+                const codec::Decoder dec(2);
+
+                for (const Image* im : {&rgb, &gray}) {
+                    std::vector<uint8_t> blob = enc.encode(*im);
+                    EXPECT_TRUE(images_equal(dec.decode(blob), *im))
+                        << "pred=" << (int)pred << " color=" << (int)color << " rows=" << rows << " c=" << im->c;
+
+                    // fused encode writes what the separate stages write
+                    std::vector<uint8_t> staged;
+                    ans::SideData side;
+                    const std::vector<int16_t> res = enc.predict(*im, &side);
+                    enc.compress(res, *im, [&](const uint8_t* d, size_t n) { staged.insert(staged.end(), d, d + n); }, side);
+                    EXPECT_EQ(staged, blob);
+                    EXPECT_TRUE(images_equal(dec.reconstruct(res, im->w, im->h, im->c, o, side), *im));
+
+                    // planar prediction writes the same bytes
+                    codec::Options p = o;
+                    p.planar = true;
+                    EXPECT_EQ(codec::Encoder(p).encode(*im), blob);
+                }
+            }
+        }
+    }
+}
+
+TEST(Codec, HeaderRecordsOptions) {
+    codec::Options o;
+    o.predictor = codec::Predictor::LS;
+    o.color = codec::Color::YUV;
+    o.N = 8; o.winW = 9; o.winH = 7; o.inter = 4;
+    o.lsReuse = 6;
+    o.stripeRows = 6;
+    o.ansFlags = ans::FLAG_CONTEXT;
+
+    Image rgb = make_image(16, 20, 3, 3);
+    rgb.format = ImageFormat::PPM;
+    const std::string path = tmp_path("codec_header.r16ans");
+    codec::Encoder(o).encode_to_file(rgb, path);
+
+    const ans::Header H = ans::read_header(path);
+    EXPECT_EQ(H.mode, 1);
+    EXPECT_EQ(H.info.predictor, ans::PRED_LS);
+    EXPECT_TRUE(H.flags & ans::FLAG_LS_REUSE);
+    const codec::Options back = codec::options_of(H);
+    EXPECT_EQ(back.predictor, o.predictor);
+    EXPECT_EQ(back.color, o.color);
+    EXPECT_EQ(back.N, 8);
+    EXPECT_EQ(back.inter, 4);
+    EXPECT_EQ(back.winW, 9);
+    EXPECT_EQ(back.winH, 7);
+    EXPECT_EQ(back.lsReuse, 6);
+    EXPECT_EQ(back.stripeRows, 6);
+    EXPECT_EQ(back.ansFlags, ans::FLAG_CONTEXT);
+
+    EXPECT_EQ(codec::format_of(H), ImageFormat::PPM);
+
+    const Image back_im = codec::Decoder().decode_file(path);
+    EXPECT_TRUE(images_equal(back_im, rgb));
+    EXPECT_EQ(back_im.format, ImageFormat::PPM);
+    std::remove(path.c_str());
+}
+
+TEST(Codec, RejectsBadOptionsAndRawStreams) {
+    codec::Options o;
+    o.predictor = codec::Predictor::LS;
+    o.N = 9;
+    EXPECT_THROW(codec::Encoder{o}, std::invalid_argument);
+    o.N = 4; o.winW = 0;
+    EXPECT_THROW(codec::Encoder{o}, std::invalid_argument);
+    o.winW = 4; o.lsReuse = 256;
+    EXPECT_THROW(codec::Encoder{o}, std::invalid_argument);
+    o.predictor = codec::Predictor::MED; o.lsReuse = 1;
+    EXPECT_THROW(codec::Encoder{o}, std::invalid_argument);
+
+    // residuals coded without predictor info cannot be decoded to an image
+    std::vector<int16_t> res(4*4*3, 1);
+    std::vector<uint8_t> blob;
+    ans::compress_to_buffer(res, 0, 4, 4, 3, blob);
+    EXPECT_THROW(codec::Decoder().decode(blob), std::runtime_error);
+}
+
+TEST(Codec, ChecksumStoredAndChecked) {
+    EXPECT_EQ(crc32c("123456789", 9), 0xE3069283u);
+
+    // every length and split point against a bitwise reference
+    std::mt19937 rng(7);
+    std::vector<uint8_t> data(67);
+    for (auto& b : data) b = (uint8_t)rng();
+    for (size_t n = 0; n <= data.size(); ++n) {
+        uint32_t ref = ~0u;
+        for (size_t i = 0; i < n; ++i) {
+            ref ^= data[i];
+            for (int k = 0; k < 8; ++k) ref = (ref >> 1) ^ (0x82F63B78u & (0u - (ref & 1u)));
+        }
+        ref = ~ref;
+        EXPECT_EQ(crc32c(data.data(), n), ref) << "n=" << n;
+        EXPECT_EQ(crc32c(data.data() + n/3, n - n/3, crc32c(data.data(), n/3)), ref) << "n=" << n;
+    }
+
+    codec::Options o;
+    o.predictor = codec::Predictor::LS;
+    o.stripeRows = 4;
+    o.ansFlags = ans::FLAG_CONTEXT;
+    o.checksum = true;
+    const Image rgb = make_image(13, 10, 3, 4);
+    std::vector<uint8_t> blob = codec::Encoder(o).encode(rgb);
+
+    const ans::Header H = ans::read_header(blob);
+    EXPECT_TRUE(H.info.has_checksum);
+    EXPECT_EQ(H.info.checksum, crc32c(rgb.px.data(), rgb.px.size()));
+    EXPECT_TRUE(codec::options_of(H).checksum);
+    EXPECT_EQ(codec::options_of(H).ansFlags, ans::FLAG_CONTEXT);
+    EXPECT_TRUE(images_equal(codec::Decoder().decode(blob), rgb));
+
+    // checksum follows the 8-byte codec info at offset 36
+    blob[44] ^= 1;
+    EXPECT_THROW(codec::Decoder().decode(blob), std::runtime_error);
+
+    // same payload as without the checksum, 4 bytes more header
+    o.checksum = false;
+    EXPECT_EQ(codec::Encoder(o).encode(rgb).size() + 4, blob.size());
+}
+
+TEST(Codec, StagesAreRecorded) {
+    codec::Options o;
+    o.color = codec::Color::YUV;
+    o.stripeRows = 8;
+    o.threads = 3;
+    const Image rgb = make_image(24, 30, 3, 5);
+
+    // worker records are merged into the caller's, capture leaves the outer record alone
+    metrics::local() = metrics::Record{};
+    metrics::local().ns[metrics::SAVE] = 7;
+    const metrics::Record r = metrics::capture([&] { codec::Encoder(o).encode(rgb); });
+    EXPECT_EQ(metrics::local().ns[metrics::SAVE], 7u);
+    for (int s : {metrics::COLOR, metrics::PREDICT, metrics::SYMBOLIZE, metrics::MODEL, metrics::ENCODE, metrics::WRITE})
+        EXPECT_GT(r.ns[s], 0u) << metrics::stage_name(s);
+    EXPECT_EQ(r.ns[metrics::RECONSTRUCT], 0u);
+
+    EXPECT_EQ(metrics::percentile({}, 50), 0u);
+    EXPECT_EQ(metrics::percentile({5, 1, 4, 2, 3}, 50), 3u);
+    EXPECT_EQ(metrics::percentile({5, 1, 4, 2, 3}, 99), 5u);
+    EXPECT_EQ(metrics::percentile({5, 1, 4, 2, 3}, 0), 1u);
+}
+
+TEST(Codec, TraceWritesStageEvents) {
+    codec::Options o;
+    o.predictor = codec::Predictor::LS;
+    o.stripeRows = 6;
+    o.threads = 2;
+    const Image rgb = make_image(12, 14, 3, 6);
+    const std::string path = tmp_path("codec_trace.json");
+
+    EXPECT_FALSE(trace::enabled());
+    {
+        trace::Session session(path);
+        EXPECT_TRUE(trace::enabled());
+        trace::name_thread("test \"main\"");
+        codec::Encoder(o).encode(rgb);
+    }
+    EXPECT_FALSE(trace::enabled());
+
+    std::ifstream f(path);
+    const std::string json((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(json.rfind("{\"displayTimeUnit\"", 0), 0u);
+    for (const char* name : {"\"predict stripe\"", "\"ls row\"", "\"predict\"", "\"encode\"",
+                             "\"code stripe\"", "\"write\"", "\"test \\\"main\\\"\""})
+        EXPECT_NE(json.find(name), std::string::npos) << name;
+    EXPECT_NE(json.find("\"ph\":\"X\""), std::string::npos);
+    std::remove(path.c_str());
+}
+
+TEST(Codec, BlockLsSendsWeights) {
+    // smooth ramps with noise: LS weights pay off, MED does not see the slope
+    std::mt19937 rng(8);
+    Image rgb; rgb.w = 64; rgb.h = 48; rgb.c = 3;
+    rgb.px.resize((size_t)rgb.w*rgb.h*rgb.c);
+    for (int y = 0; y < rgb.h; ++y)
+        for (int x = 0; x < rgb.w; ++x)
+            for (int ch = 0; ch < 3; ++ch)
+                rgb.px[((size_t)y*rgb.w + x)*3 + ch] =
+                    (unsigned char)(100 + 40*std::sin(x*0.2 + ch) + 30*std::cos(y*0.15) + (int)(rng() % 5));
+
+    codec::Options o;
+    o.predictor = codec::Predictor::BLOCK_LS;
+    o.N = 4; o.inter = 1; o.winW = o.winH = 16;
+    o.stripeRows = 20;
+    o.threads = 2;
+    std::vector<uint8_t> blob = codec::Encoder(o).encode(rgb);
+
+    const ans::Header H = ans::read_header(blob);
+    EXPECT_EQ(H.info.predictor, ans::PRED_BLOCK_LS);
+    EXPECT_TRUE(H.flags & ans::FLAG_SIDE);
+    const codec::Options back = codec::options_of(H);
+    EXPECT_EQ(back.predictor, codec::Predictor::BLOCK_LS);
+    EXPECT_EQ(back.winW, 16);
+    EXPECT_EQ(back.ansFlags, ans::FLAG_RANS_X8);
+    EXPECT_TRUE(images_equal(codec::Decoder(2).decode(blob), rgb));
+
+    const std::string path = tmp_path("codec_bls.r16ans");
+    codec::Encoder(o).encode_to_file(rgb, path);
+    EXPECT_TRUE(images_equal(codec::Decoder().decode_file(path), rgb));
+    const ans::SideData side = ans::decompress_side(blob);
+    ASSERT_EQ(side.size(), 3u);
+    EXPECT_EQ(ans::FileReader(path).side(1), side[1]);
+    std::remove(path.c_str());
+
+    // 4 x 2 blocks of 16 rows in the first stripe, then 4 x 1 of 4 rows in the last;
+    // each channel is a MED flag or an LS flag and 5 weight deltas
+    for (size_t s = 0; s < side.size(); ++s) {
+        size_t pos = 0, blocks = 0;
+        while (pos < side[s].size()) { pos += side[s][pos] == 0 ? 6 : 1; ++blocks; }
+        EXPECT_EQ(blocks, (s < 2 ? 8u : 4u) * 3);
+    }
+
+    // blocks only take LS where it lowers the residual sum
+    const codec::Encoder enc(o);
+    ans::SideData sd;
+    const std::vector<int16_t> res = enc.predict(rgb, &sd);
+    o.predictor = codec::Predictor::MED;
+    const std::vector<int16_t> med = codec::Encoder(o).predict(rgb);
+    const auto sad = [](const std::vector<int16_t>& r) {
+        uint64_t t = 0;
+        for (int16_t v : r) t += (uint64_t)std::abs(v);
+        return t;
+    };
+    EXPECT_LT(sad(res), sad(med));
+
+    // weights are checked before use
+    o.predictor = codec::Predictor::BLOCK_LS;
+    EXPECT_THROW(codec::Decoder().reconstruct(res, rgb.w, rgb.h, rgb.c, o), std::runtime_error);
+    sd[0].push_back(1);
+    EXPECT_THROW(codec::Decoder().reconstruct(res, rgb.w, rgb.h, rgb.c, o, sd), std::runtime_error);
+    sd[0].back() = 7;
+    EXPECT_THROW(codec::Decoder().reconstruct(res, rgb.w, rgb.h, rgb.c, o, sd), std::runtime_error);
+}
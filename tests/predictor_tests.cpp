@@ -3,7 +3,9 @@
 
 #include <gtest/gtest.h>
 #include <chrono>
+#include <algorithm>
 #include <cstdlib>
+#include <stdexcept>
 #include <string>
 #include <utility>
 
@@ -153,3 +155,229 @@ static const ModeCfg kModes[] = {
 INSTANTIATE_TEST_SUITE_P(AllPipelines,
                          RoundTripParamTest,
                          ::testing::ValuesIn(kModes));
+
+// Synthetic round trip, runs without TEST_IMAGE (covers the sliding LS window edges)
+TEST(LsPredictor, RoundTripSyntheticWindows) {
+    Image src; src.w=37; src.h=23; src.c=3;
+    src.px.resize((size_t)src.w*src.h*src.c);
+    srand(7);
+    for (int y=0; y<src.h; ++y)
+        for (int x=0; x<src.w; ++x)
+            for (int ch=0; ch<src.c; ++ch)
+                src.px[(size_t)(y*src.w + x)*src.c + ch] = (unsigned char)((x*3 + y*5 + ch*40 + (rand() & 15)) & 255);
+
+    const int wins[][2] = { {0,0}, {1,0}, {4,4}, {7,2}, {64,64} };
+    for (int N = 1; N <= 4; ++N) {
+        for (auto& wh : wins) {
+            auto res = compute_residuals_LS_u8(src, N, wh[0], wh[1]);
+            Image rec = reconstruct_from_residuals_LS_u8(res, src, N, wh[0], wh[1]);
+            EXPECT_TRUE(images_equal(src, rec)) << "u8 N=" << N << " win=" << wh[0] << "x" << wh[1];
+
+            Image16 yuv = rgb_to_yuv(src);
+            auto res16 = compute_residuals_LS_s16(yuv, N, wh[0], wh[1]);
+            Image16 rec16 = reconstruct_from_residuals_LS_s16(res16, yuv, N, wh[0], wh[1]);
+            EXPECT_EQ(yuv.px, rec16.px) << "s16 N=" << N << " win=" << wh[0] << "x" << wh[1];
+        }
+    }
+    EXPECT_THROW(compute_residuals_LS_u8(src, 0, 4, 4), std::invalid_argument);
+    EXPECT_THROW(compute_residuals_LS_u8(src, 9, 4, 4), std::invalid_argument);
+    EXPECT_THROW(compute_residuals_LS_u8(src, 4, 4, 4, 1, 5), std::invalid_argument);
+}
+
+// Wavefront rows must give the serial result for any thread count
+TEST(LsPredictor, WavefrontMatchesSerial) {
+    Image src; src.w=61; src.h=29; src.c=3;
+    src.px.resize((size_t)src.w*src.h*src.c);
+    srand(11);
+    for (auto& v : src.px) v = (unsigned char)(rand() & 255);
+    Image16 yuv = rgb_to_yuv(src);
+
+    auto ref   = compute_residuals_LS_u8(src, 4, 4, 4, 1);
+    auto ref16 = compute_residuals_LS_s16(yuv, 3, 5, 2, 1);
+    for (int threads : {2, 3, 8, 64}) {
+        auto res = compute_residuals_LS_u8(src, 4, 4, 4, threads);
+        EXPECT_EQ(ref, res) << "threads=" << threads;
+        EXPECT_TRUE(images_equal(src, reconstruct_from_residuals_LS_u8(res, src, 4, 4, 4, threads)));
+
+        auto res16 = compute_residuals_LS_s16(yuv, 3, 5, 2, threads);
+        EXPECT_EQ(ref16, res16) << "threads=" << threads;
+        EXPECT_EQ(yuv.px, reconstruct_from_residuals_LS_s16(res16, yuv, 3, 5, 2, threads).px);
+    }
+}
+
+// Stripes are predicted independently and reassemble into the whole-image layout
+TEST(Stripes, RoundTripAndIndependence) {
+    Image src; src.w=19; src.h=31; src.c=3;
+    src.px.resize((size_t)src.w*src.h*src.c);
+    srand(3);
+    for (auto& v : src.px) v = (unsigned char)(rand() & 255);
+
+    for (int rows : {0, 1, 7, 31, 40}) {
+        auto res = predict_stripes(src, rows, 3, [](const Image& s) { return compute_residuals_LS_u8(s, 3, 4, 4); });
+        Image rec = reconstruct_stripes(res, src, rows, 2,
+            [](const std::vector<int16_t>& r, const Image& s) { return reconstruct_from_residuals_LS_u8(r, s, 3, 4, 4); });
+        EXPECT_TRUE(images_equal(src, rec)) << "rows=" << rows;
+    }
+
+    // stripe 1 of 7-row stripes == prediction of rows [7, 14) on their own
+    Image band; band.w=src.w; band.h=7; band.c=src.c;
+    band.px.assign(src.px.begin() + 7*src.w*src.c, src.px.begin() + 14*src.w*src.c);
+    auto bandRes = compute_residuals_MED_u8(band);
+    auto res = predict_stripes(src, 7, 2, [](const Image& s) { return compute_residuals_MED_u8(s); });
+    EXPECT_TRUE(std::equal(bandRes.begin(), bandRes.end(), res.begin() + 7*src.w*src.c));
+    EXPECT_EQ(stripe_count(31, 7), 5);
+    EXPECT_EQ(stripe_count(31, 0), 1);
+}
+
+// MED engine vs. the per-pixel definition, including extreme int16 values (no overflow in SIMD lanes)
+TEST(MedPredictor, MatchesReferenceAndRoundTrips) {
+    auto reference = [](const std::vector<int>& px, int w, int h, int c) {
+        auto at = [&](int x, int y, int ch) { return (x < 0 || y < 0) ? 0 : px[((size_t)y*w + x)*c + ch]; };
+        std::vector<int16_t> r(px.size());
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x)
+                for (int ch = 0; ch < c; ++ch) {
+                    int A = at(x-1, y, ch), B = at(x, y-1, ch), C = at(x-1, y-1, ch);
+                    int pred = (C >= std::max(A, B)) ? std::min(A, B) : (C <= std::min(A, B)) ? std::max(A, B) : A + B - C;
+                    r[((size_t)y*w + x)*c + ch] = (int16_t)(at(x, y, ch) - pred);
+                }
+        return r;
+    };
+
+    uint32_t seed = 12345;
+    auto rnd = [&]() { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+
+    for (int c : {1, 3}) {
+        for (int w : {1, 5, 17, 40}) {
+            const int h = 7;
+            Image im; im.w = w; im.h = h; im.c = c;
+            Image16 im16; im16.w = w; im16.h = h; im16.c = c;
+            std::vector<int> px8, px16;
+            for (int i = 0; i < w*h*c; ++i) {
+                im.px.push_back((unsigned char)(rnd() & 255));
+                int v = (rnd() % 4 == 0) ? ((rnd() & 1) ? 32767 : -32768) : (int)(rnd() % 65536) - 32768;
+                im16.px.push_back((int16_t)v);
+                px8.push_back(im.px.back());
+                px16.push_back(v);
+            }
+
+            auto r8 = compute_residuals_MED_u8(im);
+            EXPECT_EQ(r8, reference(px8, w, h, c)) << "u8 w=" << w << " c=" << c;
+            EXPECT_EQ(reconstruct_from_residuals_MED(r8, im).px, im.px);
+
+            auto r16 = compute_residuals_MED_s16(im16);
+            EXPECT_EQ(r16, reference(px16, w, h, c)) << "s16 w=" << w << " c=" << c;
+            EXPECT_EQ(reconstruct_from_residuals_MED_s16(r16, im16).px, im16.px);
+        }
+    }
+}
+
+// Planar predictors give the interleaved residuals, only laid out plane by plane
+TEST(PlanarPredictor, MatchesInterleaved) {
+    Image src; src.w=29; src.h=17; src.c=3;
+    src.px.resize((size_t)src.w*src.h*src.c);
+    srand(5);
+    for (auto& v : src.px) v = (unsigned char)(rand() & 255);
+    Image16 yuv = rgb_to_yuv(src);
+    PlanarImage planes = to_planar(src);
+    PlanarImage16 yuvPlanes = rgb_to_yuv(planes);
+    EXPECT_EQ(to_interleaved(yuvPlanes).px, yuv.px);
+
+    for (int threads : {1, 3, 8}) {
+        auto med = compute_residuals_MED_planar(planes, threads);
+        EXPECT_EQ(planes_to_interleaved(med, src.w, src.h, src.c), compute_residuals_MED_u8(src));
+        EXPECT_EQ(reconstruct_from_residuals_MED_planar(med, planes, threads).px, planes.px);
+
+        auto med16 = compute_residuals_MED_planar(yuvPlanes, threads);
+        EXPECT_EQ(planes_to_interleaved(med16, src.w, src.h, src.c), compute_residuals_MED_s16(yuv));
+        EXPECT_EQ(reconstruct_from_residuals_MED_planar(med16, yuvPlanes, threads).px, yuvPlanes.px);
+
+        auto ls = compute_residuals_LS_planar(planes, 4, 4, 4, threads);
+        EXPECT_EQ(planes_to_interleaved(ls, src.w, src.h, src.c), compute_residuals_LS_u8(src, 4, 4, 4));
+        EXPECT_EQ(reconstruct_from_residuals_LS_planar(ls, planes, 4, 4, 4, threads).px, planes.px);
+
+        auto ls16 = compute_residuals_LS_planar(yuvPlanes, 3, 5, 2, threads);
+        EXPECT_EQ(planes_to_interleaved(ls16, src.w, src.h, src.c), compute_residuals_LS_s16(yuv, 3, 5, 2));
+        EXPECT_EQ(reconstruct_from_residuals_LS_planar(ls16, yuvPlanes, 3, 5, 2, threads).px, yuvPlanes.px);
+    }
+
+    // planar stripes hand out the interleaved stripe layout
+    auto res = predict_stripes(planes, 5, 2, [](const PlanarImage& s) { return compute_residuals_LS_planar(s, 3, 4, 4); });
+    EXPECT_EQ(res, predict_stripes(src, 5, 2, [](const Image& s) { return compute_residuals_LS_u8(s, 3, 4, 4); }));
+    PlanarImage rec = reconstruct_stripes(res, planes, 5, 2,
+        [](const std::vector<int16_t>& r, const PlanarImage& s) { return reconstruct_from_residuals_LS_planar(r, s, 3, 4, 4); });
+    EXPECT_TRUE(images_equal(src, to_interleaved(rec)));
+}
+
+// Higher orders and cross-channel terms round trip on every path, for any thread count
+TEST(LsPredictor, InterChannelOrdersRoundTrip) {
+    Image src; src.w=33; src.h=21; src.c=3;
+    src.px.resize((size_t)src.w*src.h*src.c);
+    srand(13);
+    for (int y=0; y<src.h; ++y)
+        for (int x=0; x<src.w; ++x) {
+            int base = (x*5 + y*3 + (rand() & 31)) & 255;   // channels share structure
+            for (int ch=0; ch<src.c; ++ch)
+                src.px[(size_t)(y*src.w + x)*src.c + ch] = (unsigned char)((base + ch*20 + (rand() & 3)) & 255);
+        }
+    Image16 yuv = rgb_to_yuv(src);
+    PlanarImage planes = to_planar(src);
+
+    for (auto [N, inter] : { std::pair{6, 0}, std::pair{8, 0}, std::pair{4, 1}, std::pair{4, 4}, std::pair{8, 4} }) {
+        auto ref = compute_residuals_LS_u8(src, N, 4, 4, 1, inter);
+        EXPECT_TRUE(images_equal(src, reconstruct_from_residuals_LS_u8(ref, src, N, 4, 4, 1, inter)))
+            << "u8 N=" << N << " inter=" << inter;
+        EXPECT_EQ(ref, compute_residuals_LS_u8(src, N, 4, 4, 3, inter)) << "wavefront N=" << N << " inter=" << inter;
+
+        auto res16 = compute_residuals_LS_s16(yuv, N, 5, 3, 2, inter);
+        EXPECT_EQ(yuv.px, reconstruct_from_residuals_LS_s16(res16, yuv, N, 5, 3, 2, inter).px);
+
+        auto planar = compute_residuals_LS_planar(planes, N, 4, 4, 3, inter);
+        EXPECT_EQ(planes_to_interleaved(planar, src.w, src.h, src.c), ref) << "planar N=" << N << " inter=" << inter;
+        EXPECT_EQ(reconstruct_from_residuals_LS_planar(planar, planes, N, 4, 4, 3, inter).px, planes.px);
+    }
+
+    // gray: the cross-channel terms have no channel to read and contribute 0
+    Image gray; gray.w = src.w; gray.h = src.h; gray.c = 1;
+    for (size_t i = 0; i < src.px.size(); i += 3) gray.px.push_back(src.px[i]);
+    auto g = compute_residuals_LS_u8(gray, 4, 4, 4, 1, 2);
+    EXPECT_TRUE(images_equal(gray, reconstruct_from_residuals_LS_u8(g, gray, 4, 4, 4, 1, 2)));
+}
+
+// Skipped solves depend on decoded samples only: every path and thread count agrees
+TEST(LsPredictor, SolveSkippingRoundTrips) {
+    Image src; src.w=47; src.h=26; src.c=3;
+    src.px.resize((size_t)src.w*src.h*src.c);
+    srand(17);
+    for (int y=0; y<src.h; ++y)
+        for (int x=0; x<src.w; ++x)
+            for (int ch=0; ch<src.c; ++ch)   // flat page on the left, texture on the right
+                src.px[(size_t)(y*src.w + x)*src.c + ch] =
+                    (unsigned char)(x < 20 ? 200 + ch : (x*4 + y*2 + ch*30 + (rand() & 7)) & 255);
+    Image16 yuv = rgb_to_yuv(src);
+    PlanarImage planes = to_planar(src);
+    const uint64_t total = src.px.size();
+
+    auto plain = compute_residuals_LS_u8(src, 4, 4, 4);
+    EXPECT_EQ(g_last_ls_breakdown.flat, 0u);
+    EXPECT_EQ(plain, compute_residuals_LS_u8(src, 4, 4, 4, 1, 0, 0));
+
+    for (int K : {1, 4, 32}) {
+        auto ref = compute_residuals_LS_u8(src, 4, 4, 4, 1, 1, K);
+        const LsBreakdown b = g_last_ls_breakdown;
+        EXPECT_GT(b.flat, 0u) << "K=" << K;
+        EXPECT_EQ(b.used_ls + b.used_med + b.flat, total);
+        if (K == 1) EXPECT_EQ(b.ls_reused, 0u);
+        else EXPECT_GT(b.ls_reused, 0u) << "K=" << K;
+        EXPECT_TRUE(images_equal(src, reconstruct_from_residuals_LS_u8(ref, src, 4, 4, 4, 3, 1, K))) << "K=" << K;
+        EXPECT_EQ(ref, compute_residuals_LS_u8(src, 4, 4, 4, 4, 1, K)) << "wavefront K=" << K;
+
+        auto planar = compute_residuals_LS_planar(planes, 4, 4, 4, 3, 1, K);
+        EXPECT_EQ(planes_to_interleaved(planar, src.w, src.h, src.c), ref) << "planar K=" << K;
+        EXPECT_EQ(reconstruct_from_residuals_LS_planar(planar, planes, 4, 4, 4, 2, 1, K).px, planes.px);
+
+        auto res16 = compute_residuals_LS_s16(yuv, 3, 5, 2, 2, 0, K);
+        EXPECT_EQ(yuv.px, reconstruct_from_residuals_LS_s16(res16, yuv, 3, 5, 2, 3, 0, K).px) << "s16 K=" << K;
+    }
+    EXPECT_THROW(compute_residuals_LS_u8(src, 4, 4, 4, 1, 0, 256), std::invalid_argument);
+}
@@ -0,0 +1,128 @@
+#include "streamEncoder.h"
+#include "predictor.h"
+#include "checksum.h"
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+// ---------- helpers ----------
+namespace {
+
+Image make_image(int w, int h, int c, uint32_t seed) {
+    std::mt19937 rng(seed);
+    Image im; im.w = w; im.h = h; im.c = c;
+    im.px.resize((size_t)w*h*c);
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x)
+            for (int ch = 0; ch < c; ++ch)
+                im.px[((size_t)y*w + x)*c + ch] = (unsigned char)(x*3 + y*2 + ch*40 + (int)(rng() % 9));
+    return im;
+}
+
+std::vector<char> file_bytes(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()};
+}
+
+std::string tmp_path(const char* name) {
+    return ::testing::TempDir() + name;
+}
+
+}
+// namespace
+
+TEST(StreamEncode, MatchesStripedFullFrameEncode) {
+    Image rgb = make_image(37, 50, 3, 1);
+    const std::string a = tmp_path("stream_a.r16ans"), b = tmp_path("stream_b.r16ans");
+
+    auto ls = [](const Image& s) { return compute_residuals_LS_u8(s, 4, 4, 4); };
+    auto ls_rec = [](const std::vector<int16_t>& r, const Image& s) { return reconstruct_from_residuals_LS_u8(r, s, 4, 4, 4); };
+
+    for (int rows : {1, 8, 13, 50}) {
+        ans::Options opt;
+        opt.stripeRows = rows;
+
+        RowSource src = image_rows(rgb);
+        encode_stream(src, 0, ls, a, opt);
+        ans::compress_to_file(predict_stripes(rgb, rows, 1, ls), 0, rgb.w, rgb.h, rgb.c, b, opt);
+        EXPECT_EQ(file_bytes(a), file_bytes(b)) << "stripe rows=" << rows;
+
+        RowSource again = image_rows(rgb);
+        EXPECT_TRUE(verify_stream(again, a, ls_rec));
+    }
+
+    // the CRC taken stripe by stripe is the one of the whole frame (and lands after the
+    // optional LS reuse byte)
+    ans::Options opt;
+    opt.stripeRows = 8;
+    opt.info.has_checksum = true;
+    opt.info.ls_reuse = 3;
+    RowSource src0 = image_rows(rgb);
+    encode_stream(src0, 0, ls, a, opt);
+    opt.info.checksum = crc32c(rgb.px.data(), rgb.px.size());
+    ans::compress_to_file(predict_stripes(rgb, 8, 1, ls), 0, rgb.w, rgb.h, rgb.c, b, opt);
+    EXPECT_EQ(file_bytes(a), file_bytes(b));
+    EXPECT_EQ(ans::read_header(a).info.checksum, opt.info.checksum);
+    EXPECT_EQ(ans::read_header(a).info.ls_reuse, 3);
+
+    // with solve skipping the streamed LS breakdown is the full-frame one, reused and flat
+    // samples included
+    Image flat = rgb;
+    for (int y = 10; y < 30; ++y)
+        for (size_t i = (size_t)y*flat.w*flat.c; i < (size_t)(y + 1)*flat.w*flat.c; ++i) flat.px[i] = 77;
+    auto lsReuse = [](const Image& s) { return compute_residuals_LS_u8(s, 4, 4, 4, 1, 0, 4); };
+    ans::Options ropt;
+    ropt.stripeRows = 8;
+    RowSource src1 = image_rows(flat);
+    encode_stream(src1, 0, lsReuse, a, ropt);
+    const LsBreakdown streamed = g_last_ls_breakdown;
+    predict_stripes(flat, 8, 1, lsReuse);
+    const LsBreakdown& full = g_last_ls_breakdown;
+    EXPECT_GT(streamed.flat, 0u);
+    EXPECT_EQ(streamed.used_ls, full.used_ls);
+    EXPECT_EQ(streamed.used_med, full.used_med);
+    EXPECT_EQ(streamed.ls_reused, full.ls_reused);
+    EXPECT_EQ(streamed.flat, full.flat);
+
+    // a changed pixel must fail verification
+    Image other = rgb;
+    other.px[1234] ^= 1;
+    RowSource src = image_rows(other);
+    EXPECT_FALSE(verify_stream(src, a, ls_rec));
+
+    std::remove(a.c_str());
+    std::remove(b.c_str());
+}
+
+TEST(StreamEncode, PnmRowsStreamFromDisk) {
+    Image gray = make_image(19, 11, 1, 2);
+    const std::string pgm = tmp_path("stream_src.pgm"), out = tmp_path("stream_pgm.r16ans");
+    {
+        std::ofstream f(pgm, std::ios::binary);
+        f << "P5\n# comment\n" << gray.w << " " << gray.h << "\n255\n";
+        f.write(reinterpret_cast<const char*>(gray.px.data()), (std::streamsize)gray.px.size());
+    }
+
+    RowSource src = open_rows(pgm);
+    ASSERT_EQ(src.w, gray.w);
+    ASSERT_EQ(src.h, gray.h);
+    ASSERT_EQ(src.c, 1);
+
+    auto med = [](const Image& s) { return compute_residuals_MED_u8(s); };
+    auto med_rec = [](const std::vector<int16_t>& r, const Image& s) { return reconstruct_from_residuals_MED(r, s); };
+    ans::Options opt;
+    opt.stripeRows = 4;
+    encode_stream(src, 0, med, out, opt);
+    EXPECT_EQ(ans::read_header(out).n_stripes, 3);
+
+    RowSource again = open_pnm_rows(pgm);
+    EXPECT_TRUE(verify_stream(again, out, med_rec));
+
+    std::remove(pgm.c_str());
+    std::remove(out.c_str());
+}
@@ -124,6 +124,64 @@ TEST(ImageIO_RCT, RoundTrip_Random) {
     }
 }
 
+// ---------- Tests: SIMD transforms vs scalar reference ----------
+
+TEST(ImageIO_SIMD, ForwardMatchesScalar) {
+    // widths around the 16-pixel step exercise the scalar tail
+    for (auto wh : { std::pair{1,1}, std::pair{15,3}, std::pair{16,2}, std::pair{17,5}, std::pair{101,37} }) {
+        Image src = make_random(wh.first, wh.second, 77u);
+        EXPECT_EQ(rgb_to_yuv(src).px, rgb_to_yuv_scalar(src).px) << wh.first << "x" << wh.second;
+        EXPECT_EQ(rct_from_rgb(src).px, rct_from_rgb_scalar(src).px) << wh.first << "x" << wh.second;
+    }
+}
+
+TEST(ImageIO_SIMD, InverseMatchesScalarOnAnyInput) {
+    // arbitrary int16 triplets, not only ones a forward transform produces: clamping must agree
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> full(-32768, 32767), near(-600, 600);
+    const int16_t edges[] = {-32768, -32767, -256, -255, -1, 0, 1, 255, 256, 32766, 32767};
+    for (int round = 0; round < 3; ++round) {
+        Image16 in; in.w = 67; in.h = 31; in.c = 3;
+        in.px.resize(static_cast<size_t>(in.w)*in.h*3);
+        for (size_t i = 0; i < in.px.size(); ++i) {
+            if (round == 0) in.px[i] = static_cast<int16_t>(full(rng));
+            else if (round == 1) in.px[i] = static_cast<int16_t>(near(rng));
+            else in.px[i] = edges[rng() % (sizeof(edges)/sizeof(edges[0]))];
+        }
+        EXPECT_EQ(yuv_to_rgb(in).px, yuv_to_rgb_scalar(in).px) << "round " << round;
+        EXPECT_EQ(rct_to_rgb(in).px, rct_to_rgb_scalar(in).px) << "round " << round;
+    }
+}
+
+// ---------- Tests: planar layout ----------
+
+TEST(ImageIO_Planar, LayoutAndTransformsRoundTrip) {
+    for (auto wh : { std::pair{1,1}, std::pair{7,3}, std::pair{16,4}, std::pair{33,9} }) {
+        Image src = make_random(wh.first, wh.second, 99u);
+        src.format = ImageFormat::PNG;
+        PlanarImage p = to_planar(src);
+        ASSERT_EQ(p.px.size(), src.px.size());
+        EXPECT_EQ(p.plane(1)[p.plane_size() - 1], src.px[src.px.size() - 2]); // G of the last pixel
+        EXPECT_EQ(p.format, ImageFormat::PNG);
+        EXPECT_TRUE(images_equal(to_interleaved(p), src));
+
+        Image16 yuv = rgb_to_yuv(src);
+        PlanarImage16 yuvPlanes = rgb_to_yuv(p);
+        EXPECT_EQ(to_planar(yuv).px, yuvPlanes.px);
+        EXPECT_EQ(to_interleaved(yuvPlanes).px, yuv.px);
+        EXPECT_TRUE(images_equal(to_interleaved(yuv_to_rgb(yuvPlanes)), src));
+
+        EXPECT_EQ(planes_to_interleaved(to_planar(yuv).px, yuv.w, yuv.h, 3), yuv.px);
+        EXPECT_EQ(interleaved_to_planes(yuv.px, yuv.w, yuv.h, 3), yuvPlanes.px);
+    }
+
+    // inverse on arbitrary int16 planes agrees with the interleaved transform
+    std::mt19937 rng(8);
+    Image16 any; any.w = 21; any.h = 5; any.c = 3;
+    for (int i = 0; i < any.w*any.h*3; ++i) any.px.push_back(static_cast<int16_t>(rng()));
+    EXPECT_EQ(to_interleaved(yuv_to_rgb(to_planar(any))).px, yuv_to_rgb(any).px);
+}
+
 TEST(ImageIO_IO, LoadAndRoundTripIfEnvSet) {
     const char* p = std::getenv("TEST_IMAGE");
     if (!p) GTEST_SKIP() << "Set TEST_IMAGE to a PNG/JPG to enable this test";
@@ -0,0 +1,115 @@
+#include "threadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+ThreadPool::ThreadPool(int threads) {
+    for (int i = 1; i < threads; ++i)
+        workers_.emplace_back([this] { worker_loop(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+void ThreadPool::worker_loop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lk(m_);
+            cv_.wait(lk, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) return; // stop_ and drained
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallel_for(int n, const std::function<void(int)>& fn) {
+    if (n <= 0) return;
+    if (workers_.empty() || n == 1) {
+        for (int i = 0; i < n; ++i) fn(i);
+        return;
+    }
+
+    struct Job {
+        std::atomic<int> next{0};
+        int n = 0;
+        int active = 0;
+        std::exception_ptr err;
+        std::mutex m;
+        std::condition_variable done;
+    };
+    auto job = std::make_shared<Job>();
+    job->n = n;
+
+    const int runners = std::min(n, size());
+    job->active = runners;
+
+    // Each runner pulls indices until none are left
+    auto runner = [job, &fn] {
+        for (int i; (i = job->next.fetch_add(1)) < job->n;) {
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lk(job->m);
+                if (!job->err) job->err = std::current_exception();
+            }
+        }
+        std::lock_guard<std::mutex> lk(job->m);
+        if (--job->active == 0) job->done.notify_all();
+    };
+
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        for (int r = 1; r < runners; ++r) queue_.emplace_back(runner);
+    }
+    cv_.notify_all();
+
+    runner(); // calling thread works too
+
+    std::unique_lock<std::mutex> lk(job->m);
+    job->done.wait(lk, [&] { return job->active == 0; });
+    if (job->err) std::rethrow_exception(job->err);
+}
+
+void run_batch(int n, int jobs, uint64_t budgetBytes,
+               const std::function<uint64_t(int)>& cost,
+               const std::function<void(int)>& task) {
+    std::mutex m;
+    std::condition_variable freed;
+    uint64_t inUse = 0;
+    int running = 0;
+
+    ThreadPool pool(std::max(1, jobs));
+    pool.parallel_for(n, [&](int i) {
+        const uint64_t bytes = budgetBytes ? cost(i) : 0;
+        {
+            std::unique_lock<std::mutex> lk(m);
+            freed.wait(lk, [&] { return running == 0 || inUse + bytes <= budgetBytes || !budgetBytes; });
+            inUse += bytes;
+            ++running;
+        }
+        struct Release { // also on exceptions
+            std::mutex& m; std::condition_variable& cv; uint64_t& inUse; int& running; uint64_t bytes;
+            ~Release() {
+                { std::lock_guard<std::mutex> lk(m); inUse -= bytes; --running; }
+                cv.notify_all();
+            }
+        } release{m, freed, inUse, running, bytes};
+        task(i);
+    });
+}
+
+int resolve_thread_count(int requested) {
+    if (requested > 0) return requested;
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw ? (int)hw : 1;
+}
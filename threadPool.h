@@ -0,0 +1,43 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads.
+// threads = total parallelism, the calling thread of parallel_for counts as one worker.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    [[nodiscard]] int size() const { return (int)workers_.size() + 1; }
+
+    // Run fn(i) for i in [0, n) and return when all are done. Rethrows the first exception.
+    void parallel_for(int n, const std::function<void(int)>& fn);
+
+private:
+    void worker_loop();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> queue_;
+    std::mutex m_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
+
+// Runs task(i) for i in [0, n) on `jobs` workers, roughly in index order. While task i runs,
+// cost(i) bytes are held against budgetBytes (0 = no limit); a task that alone exceeds the
+// budget waits until nothing else runs. Rethrows the first exception.
+void run_batch(int n, int jobs, uint64_t budgetBytes,
+               const std::function<uint64_t(int)>& cost,
+               const std::function<void(int)>& task);
+
+// IMG_THREADS value -> thread count (<= 0 means all hardware threads)
+int resolve_thread_count(int requested);
@@ -0,0 +1,147 @@
+#include "trace.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace trace {
+
+namespace {
+
+struct Event {
+    const char* name;
+    uint64_t t0, t1;
+    int64_t index;
+    std::string label;
+};
+
+// One per thread and session; the registry keeps it alive after its thread exits (pool workers)
+struct Buffer {
+    int tid = 0;
+    uint64_t session = 0;
+    std::string name;
+    std::mutex m;                 // only contended while the session writes
+    std::vector<Event> events;
+};
+
+std::mutex g_m;
+std::vector<std::shared_ptr<Buffer>> g_buffers;
+std::atomic<uint64_t> g_session{0};
+uint64_t g_t0 = 0;
+
+// Only this thread replaces its buffer, so the reference stays valid without g_m
+Buffer& local_buffer() {
+    thread_local std::shared_ptr<Buffer> b;
+    const uint64_t session = g_session.load(std::memory_order_acquire);
+    if (!b || b->session != session) {
+        auto fresh = std::make_shared<Buffer>();
+        fresh->session = session;
+        std::lock_guard<std::mutex> lk(g_m);
+        fresh->tid = (int)g_buffers.size() + 1;
+        fresh->name = "thread " + std::to_string(fresh->tid);
+        g_buffers.push_back(fresh);
+        b = std::move(fresh);
+    }
+    return *b;
+}
+
+void put_json_string(std::ostream& o, const std::string& s) {
+    o << '"';
+    for (unsigned char ch : s) {
+        if (ch == '"' || ch == '\\') o << '\\' << (char)ch;
+        else if (ch < 0x20) { char u[8]; std::snprintf(u, sizeof u, "\\u%04x", ch); o << u; }
+        else o << (char)ch;
+    }
+    o << '"';
+}
+
+// Microseconds since the session started, ns resolution
+void put_us(std::ostream& o, uint64_t ns) {
+    char b[32];
+    std::snprintf(b, sizeof b, "%llu.%03llu", (unsigned long long)(ns / 1000), (unsigned long long)(ns % 1000));
+    o << b;
+}
+
+} // namespace
+
+void detail::record(const char* name, uint64_t t0, uint64_t t1, int64_t index, std::string&& label) {
+    if (!enabled()) return;   // session ended while the scope was open
+    Buffer& b = local_buffer();
+    std::lock_guard<std::mutex> lk(b.m);
+    b.events.push_back(Event{name, t0, t1, index, std::move(label)});
+}
+
+void name_thread(const std::string& name) {
+    if (!enabled()) return;
+    Buffer& b = local_buffer();
+    std::lock_guard<std::mutex> lk(b.m);
+    b.name = name;
+}
+
+Session::Session(std::string path) : path_(std::move(path)) {
+    if (path_.empty()) return;
+    std::lock_guard<std::mutex> lk(g_m);
+    if (detail::on.load()) throw std::runtime_error("trace: a session is already open");
+    g_buffers.clear();
+    g_session.fetch_add(1, std::memory_order_release);
+    g_t0 = now_ns();
+    detail::on.store(true);
+}
+
+Session::~Session() {
+    try {
+        write();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+    }
+}
+
+void Session::write() {
+    if (path_.empty()) return;
+    const std::string path = std::move(path_);
+    path_.clear();
+
+    std::vector<std::shared_ptr<Buffer>> buffers;
+    uint64_t t0;
+    {
+        std::lock_guard<std::mutex> lk(g_m);
+        detail::on.store(false);
+        buffers.swap(g_buffers);
+        t0 = g_t0;
+    }
+
+    std::ofstream o(path, std::ios::binary);
+    if (!o) throw std::runtime_error("trace: open write: " + path);
+    o << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    o << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Byte2Bit\"}}";
+    for (const auto& b : buffers) {
+        std::lock_guard<std::mutex> lk(b->m);
+        o << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b->tid << ",\"args\":{\"name\":";
+        put_json_string(o, b->name);
+        o << "}}";
+        for (const Event& e : b->events) {
+            o << ",\n{\"name\":";
+            put_json_string(o, e.name);
+            o << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << b->tid << ",\"ts\":";
+            put_us(o, e.t0 >= t0 ? e.t0 - t0 : 0);
+            o << ",\"dur\":";
+            put_us(o, e.t1 - e.t0);
+            if (e.index >= 0 || !e.label.empty()) {
+                o << ",\"args\":{";
+                if (e.index >= 0) o << "\"i\":" << e.index << (e.label.empty() ? "" : ",");
+                if (!e.label.empty()) { o << "\"label\":"; put_json_string(o, e.label); }
+                o << "}";
+            }
+            o << "}";
+        }
+    }
+    o << "\n]}\n";
+    o.close();
+    if (!o) throw std::runtime_error("trace: write failed: " + path);
+}
+
+} // namespace trace
@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Chrome trace-event timeline (chrome://tracing, ui.perfetto.dev). Off unless a Session is
+// open: a disabled Scope costs one relaxed load and a branch. Events are kept per thread
+// and written as complete ("X") events with thread ids when the session ends.
+namespace trace {
+
+    namespace detail {
+        inline std::atomic<bool> on{false};
+        void record(const char* name, uint64_t t0, uint64_t t1, int64_t index, std::string&& label);
+    }
+
+    inline bool enabled() { return detail::on.load(std::memory_order_relaxed); }
+
+    // steady_clock in ns; also the clock of metrics.h
+    inline uint64_t now_ns() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Event from construction to destruction on this thread. name must outlive the session
+    // (string literals); index (>= 0) and label end up in the event's args.
+    class Scope {
+    public:
+        explicit Scope(const char* name, int64_t index = -1)
+            : name_(name), index_(index), t0_(enabled() ? now_ns() : 0) {}
+        Scope(const char* name, std::string label)
+            : name_(name), index_(-1), t0_(enabled() ? now_ns() : 0) {
+            if (t0_) label_ = std::move(label);
+        }
+        ~Scope() { if (t0_) detail::record(name_, t0_, now_ns(), index_, std::move(label_)); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        const char* name_;
+        int64_t index_;
+        uint64_t t0_;
+        std::string label_;
+    };
+
+    // Names the calling thread in the timeline (default "thread <id>")
+    void name_thread(const std::string& name);
+
+    // Records between construction and destruction and then writes the JSON to path;
+    // an empty path leaves tracing off. One session at a time.
+    class Session {
+    public:
+        explicit Session(std::string path);
+        ~Session();                 // writes, reports failures on std::cerr
+        void write();               // writes now and stops recording; throws std::runtime_error
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+    private:
+        std::string path_;
+    };
+
+} // namespace trace